@@ -0,0 +1,279 @@
+#include "app_common.h"
+#include <stdio.h>
+
+//Headless batch runner. Build this instead of Main.cpp to get a windowless executable that only runs the grid processor.
+//No renderer or input handler is initialized, generations are stepped back to back on this thread as fast as they can be processed.
+
+//NOTE: Override these at compile time (eg: -DHEADLESS_GENERATIONS=100000)
+#ifndef HEADLESS_GENERATIONS
+#define HEADLESS_GENERATIONS 1000	//number of steps.
+#endif
+
+#ifndef HEADLESS_REPORT_INTERVAL
+#define HEADLESS_REPORT_INTERVAL 100	//print a progress line every N steps.
+#endif
+
+//The initial population is a random conway soup of this size centered around the origin.
+#ifndef HEADLESS_SOUP_SIZE
+#define HEADLESS_SOUP_SIZE 128
+#endif
+
+#ifndef HEADLESS_SOUP_DENSITY
+#define HEADLESS_SOUP_DENSITY 35	//percent of cells alive in the soup.
+#endif
+
+//GridEngine used to run the soup. (0: HASHTABLE, 1: TILED, 2: HASHLIFE, 3: SCATTER)
+#ifndef HEADLESS_ENGINE
+#define HEADLESS_ENGINE 0
+#endif
+
+//Each step runs 2^HEADLESS_STEP_LOG2 generations. Only the HashLife engine supports more than 1.
+#ifndef HEADLESS_STEP_LOG2
+#define HEADLESS_STEP_LOG2 0
+#endif
+
+//Life-like rule of the conway cells, as a B/S rulestring. (eg: -DHEADLESS_RULE="\"B36/S23\"") A snapshot brings its own rule.
+#ifndef HEADLESS_RULE
+#define HEADLESS_RULE "B3/S23"
+#endif
+
+#ifndef HEADLESS_SOUP_SEED
+#define HEADLESS_SOUP_SEED 0x2545F4914F6CDD1DULL
+#endif
+
+//Define to start from a pattern file (RLE, Life 1.06, plaintext or macrocell) centered on the origin instead of the soup. (eg: -DHEADLESS_PATTERN_FILE="\"breeder.mc\"")
+//#define HEADLESS_PATTERN_FILE "pattern.rle"
+
+//Define to save the last generation, in the format picked by the file extension (.rle, .lif, .cells, .mc).
+//#define HEADLESS_SAVE_FILE "last_generation.rle"
+
+//Define to resume from a snapshot (see save_snapshot) if the file exists, instead of the pattern or the soup. The last generation is written back to it.
+//#define HEADLESS_SNAPSHOT_FILE "world.snapshot"
+
+//Define to run a regression check instead of the soup: a few small patterns far apart whose population is known (a domino and a diagonal that die out, a blinker and a block),
+//and a sand grain on a brick where a conway cell is born in generation 1, which has to keep the grain.
+//The live cells are compared after every step, from generation 2 on only the blinker, the block, the bricks and the grain are left. The grain is counted from generation 1 on.
+//#define HEADLESS_CHECK
+
+#ifdef HEADLESS_CHECK
+#define HEADLESS_CHECK_LIVE_CELLS 16
+#define HEADLESS_CHECK_SAND_CELLS 1
+
+static void add_check_cells(AppMemory* gm, WorldPos origin, const WorldPos* cells, uint32 count, CellType type)
+{
+	for (uint32 i = 0; i < count; i++)
+	{
+		WorldPos pos = { origin.x + cells[i].x, origin.y + cells[i].y };
+		LiveCell ad = { pos, type };
+		append_new_node(gm->active_table, hash_pos(pos), ad);
+	}
+}
+#endif
+
+static uint64 xorshift64(uint64* state)
+{
+	uint64 x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return x;
+}
+
+static void load_initial_population(PL& pl, AppMemory* gm)
+{
+#if !defined(HEADLESS_SNAPSHOT_FILE) && !defined(HEADLESS_PATTERN_FILE)
+	(void)pl;	//only the files are timed and loaded with it.
+#endif
+#ifdef HEADLESS_SNAPSHOT_FILE
+	PL_poll_timing(pl.time);
+	f64 snapshot_start_time = pl.time.fcurrent_seconds;
+	if (load_snapshot(gm, HEADLESS_SNAPSHOT_FILE))
+	{
+		PL_poll_timing(pl.time);
+		printf("Resumed %s in %.3f s\n", HEADLESS_SNAPSHOT_FILE, pl.time.fcurrent_seconds - snapshot_start_time);
+		return;
+	}
+#endif
+#ifdef HEADLESS_PATTERN_FILE
+	PL_poll_timing(pl.time);
+	f64 start_time = pl.time.fcurrent_seconds;
+	PatternResult result = load_pattern(gm, HEADLESS_PATTERN_FILE, PatternFormat::AUTO, { 0, 0 }, &pl.memory.temp_arena);
+	PL_poll_timing(pl.time);
+	if (result != PatternResult::OK)
+	{
+		printf("Couldn't load %s (error %i), starting from the soup.\n", HEADLESS_PATTERN_FILE, (int32)result);
+	}
+	else
+	{
+		printf("Loaded %s in %.3f s\n", HEADLESS_PATTERN_FILE, pl.time.fcurrent_seconds - start_time);
+		return;
+	}
+#endif
+#ifdef HEADLESS_CHECK
+	WorldPos domino[] = { { 0, 0 }, { 1, 0 } };
+	WorldPos diagonal[] = { { 0, 0 }, { 1, 1 }, { 2, 2 } };
+	WorldPos blinker[] = { { 0, 0 }, { 1, 0 }, { 2, 0 } };
+	WorldPos block[] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 } };
+	//the three cells around the grain give birth under it, then everything but the grain dies. The grain slides down onto the floor.
+	WorldPos tripod[] = { { 0, 0 }, { 2, 0 }, { 1, 2 } };
+	WorldPos grain[] = { { 1, 1 } };
+	WorldPos bricks[] = { { 1, 0 }, { -2, -1 }, { -1, -1 }, { 0, -1 }, { 1, -1 }, { 2, -1 }, { 3, -1 }, { 4, -1 } };
+	add_check_cells(gm, { 0, 0 }, domino, 2, CellType::CONWAY);
+	add_check_cells(gm, { 1000, 0 }, diagonal, 3, CellType::CONWAY);
+	add_check_cells(gm, { 0, 1000 }, blinker, 3, CellType::CONWAY);
+	add_check_cells(gm, { -1000, -1000 }, block, 4, CellType::CONWAY);
+	add_check_cells(gm, { -1000, 1000 }, tripod, 3, CellType::CONWAY);
+	add_check_cells(gm, { -1000, 1000 }, grain, 1, CellType::SAND);
+	add_check_cells(gm, { -1000, 1000 }, bricks, 8, CellType::BRICK);
+	mark_cells_edited(gm);
+	return;
+#endif
+	uint64 rng = HEADLESS_SOUP_SEED;
+	int64 half = HEADLESS_SOUP_SIZE / 2;
+	for (int64 y = -half; y < HEADLESS_SOUP_SIZE - half; y++)
+	{
+		for (int64 x = -half; x < HEADLESS_SOUP_SIZE - half; x++)
+		{
+			if ((xorshift64(&rng) % 100) < HEADLESS_SOUP_DENSITY)
+			{
+				WorldPos pos = { x, y };
+				uint64 hash = hash_pos(pos);
+				LiveCell ad = { pos, CellType::CONWAY };
+				append_new_node(gm->active_table, hash, ad);
+			}
+		}
+	}
+	mark_cells_edited(gm);
+}
+
+static void print_stats(CellGridStats& stats, f64 elapsed_seconds, uint64 generations_run)
+{
+	f64 gens_per_second = (elapsed_seconds > 0.0) ? (f64)generations_run / elapsed_seconds : 0.0;
+	printf("gen %llu: %.2f gens/sec, live cells: %u (sand: %u), active tiles: %u/%u, awake sand chunks: %u/%u, max hash depth: %i, max visited probe depth: %i, table arena high water: %llu/%llu KB, temp arena high water: %llu/%llu KB\n",
+		(unsigned long long)stats.generation, gens_per_second, stats.live_cells, stats.sand_cells, stats.active_tiles, stats.tiles, stats.awake_sand_chunks, stats.sand_chunks, stats.max_hash_depth, stats.max_visited_probe_depth,
+		(unsigned long long)(stats.table_arena_high_water / 1024), (unsigned long long)(stats.table_arena_capacity / 1024),
+		(unsigned long long)(stats.temp_arena_high_water / 1024), (unsigned long long)(stats.temp_arena_capacity / 1024));
+	if (stats.grid_full)
+	{
+		printf("The grid is full: the next generation has cells in more chunks than a table can take.\n");
+	}
+}
+
+void PL_entry_point(PL& pl)
+{
+	//NOTE: Only the grid processor allocates out of these, so they are much smaller than the windowed app's. The cells live in its own virtual memory arenas.
+	pl.memory.main_arena.capacity = Megabytes(27);
+	pl.memory.main_arena.overflow_addon_size = 0;
+	pl.memory.main_arena.top = 0;
+	pl.memory.main_arena.base = pl_arena_buffer_alloc(pl.memory.main_arena.capacity);
+	add_monitoring(&pl.memory.main_arena);
+
+
+	pl.memory.temp_arena.capacity = Megabytes(5) + PATTERN_SCRATCH_SIZE;
+	pl.memory.temp_arena.overflow_addon_size = 0;
+	pl.memory.temp_arena.top = 0;
+	pl.memory.temp_arena.base = pl_arena_buffer_alloc(pl.memory.temp_arena.capacity);
+	add_monitoring(&pl.memory.temp_arena);
+
+	pl.initialized = FALSE;
+	pl.running = TRUE;
+
+	PL_initialize_timing(pl.time);
+
+	AppMemory* gm = (AppMemory*)MARENA_PUSH(&pl.memory.main_arena, sizeof(AppMemory), "Game Memory Struct");
+	pl_buffer_set(gm, 0, sizeof(AppMemory));
+	gm->cellgrid_status = CellGridStatus::FINISHED_PROCESSING;
+
+	//skipping init_renderer and init_input_handler.
+	gm->grid_engine = (GridEngine)HEADLESS_ENGINE;
+	gm->step_log2 = HEADLESS_STEP_LOG2;
+	init_grid_processor(&pl, gm);
+	pl.initialized = TRUE;
+
+	LifeRule rule;
+	if (parse_life_rule(HEADLESS_RULE, &rule))
+	{
+		set_cellgrid_rule(gm, rule);
+	}
+	else
+	{
+		printf("Couldn't parse the rule %s, running B3/S23.\n", HEADLESS_RULE);
+	}
+
+	load_initial_population(pl, gm);
+
+	char rulestring[32];
+	format_life_rule(get_cellgrid_rule(gm), rulestring, sizeof(rulestring));
+	CellGridStats stats;
+	get_cellgrid_stats(gm, &stats);
+	printf("Headless run: %i steps of %llu generations, rule %s, initial population: %u cells\n", HEADLESS_GENERATIONS, 1ULL << HEADLESS_STEP_LOG2, rulestring, stats.live_cells);
+
+	PL_poll_timing(pl.time);
+	f64 start_time = pl.time.fcurrent_seconds;
+	f64 interval_start_time = start_time;
+	uint64 interval_start_generation = 0;
+
+#ifdef HEADLESS_CHECK
+	b32 check_failed = FALSE;
+#endif
+	for (uint32 i = 1; i <= HEADLESS_GENERATIONS; i++)
+	{
+		step_cellgrid_generation(gm);
+
+#ifdef HEADLESS_CHECK
+		get_cellgrid_stats(gm, &stats);
+		if (stats.generation >= 2 && stats.live_cells != HEADLESS_CHECK_LIVE_CELLS)
+		{
+			printf("Check failed at gen %llu: %u live cells, expected %u\n", (unsigned long long)stats.generation, stats.live_cells, HEADLESS_CHECK_LIVE_CELLS);
+			check_failed = TRUE;
+			break;
+		}
+		if (stats.sand_cells != HEADLESS_CHECK_SAND_CELLS)
+		{
+			printf("Check failed at gen %llu: %u sand cells, expected %u\n", (unsigned long long)stats.generation, stats.sand_cells, HEADLESS_CHECK_SAND_CELLS);
+			check_failed = TRUE;
+			break;
+		}
+#endif
+		if (i % HEADLESS_REPORT_INTERVAL == 0)
+		{
+			PL_poll_timing(pl.time);
+			get_cellgrid_stats(gm, &stats);
+			print_stats(stats, pl.time.fcurrent_seconds - interval_start_time, stats.generation - interval_start_generation);
+			interval_start_time = pl.time.fcurrent_seconds;
+			interval_start_generation = stats.generation;
+		}
+	}
+
+	PL_poll_timing(pl.time);
+	get_cellgrid_stats(gm, &stats);
+	printf("Finished in %.3f s\n", pl.time.fcurrent_seconds - start_time);
+	print_stats(stats, pl.time.fcurrent_seconds - start_time, stats.generation);
+#ifdef HEADLESS_CHECK
+	if (!check_failed)
+	{
+		printf("Check passed\n");
+	}
+#endif
+
+#ifdef HEADLESS_SAVE_FILE
+	PatternResult result = save_pattern(gm, HEADLESS_SAVE_FILE, PatternFormat::AUTO, &pl.memory.temp_arena);
+	printf((result == PatternResult::OK) ? "Saved %s\n" : "Couldn't save %s (error %i)\n", HEADLESS_SAVE_FILE, (int32)result);
+#endif
+#ifdef HEADLESS_SNAPSHOT_FILE
+	b32 snapshot_saved = save_snapshot(gm, HEADLESS_SNAPSHOT_FILE);
+	printf(snapshot_saved ? "Saved %s\n" : "Couldn't save %s\n", HEADLESS_SNAPSHOT_FILE);
+#endif
+
+	//lets the process thread exit its loop before the grid processor waits on it.
+	pl.running = FALSE;
+	shutdown_grid_processor(&pl, gm);
+	MARENA_POP(&pl.memory.main_arena, sizeof(AppMemory), "Game Memory Struct");
+
+	remove_monitoring(&pl.memory.temp_arena);
+	pl_arena_buffer_free(pl.memory.temp_arena.base);
+
+	remove_monitoring(&pl.memory.main_arena);
+	pl_arena_buffer_free(pl.memory.main_arena.base);
+}
@@ -4,21 +4,17 @@ static void init(PL* pl, void** game_memory);
 static void update(PL* pl, void** game_memory);
 static void shutdown(PL* pl, void** game_memory);
 
-//---d--
-int32 max_hash_depth = 0;
-
-//---d--
-
 void PL_entry_point(PL& pl)
 {
-	pl.memory.main_arena.capacity = Megabytes(200);
+	//NOTE: The grid processor reserves its own virtual memory arenas (see reserve_arena), none of the cell storage lives in here.
+	pl.memory.main_arena.capacity = Megabytes(105);
 	pl.memory.main_arena.overflow_addon_size = 0;
 	pl.memory.main_arena.top = 0;
 	pl.memory.main_arena.base = pl_arena_buffer_alloc(pl.memory.main_arena.capacity);
 	add_monitoring(&pl.memory.main_arena);
 
 
-	pl.memory.temp_arena.capacity = Megabytes(65);
+	pl.memory.temp_arena.capacity = Megabytes(5) + PATTERN_SCRATCH_SIZE;
 	pl.memory.temp_arena.overflow_addon_size = 0;
 	pl.memory.temp_arena.top = 0;
 	pl.memory.temp_arena.base = pl_arena_buffer_alloc(pl.memory.temp_arena.capacity);
@@ -51,10 +47,25 @@ void PL_entry_point(PL& pl)
 		//Refreshing the FPS counter in the window title bar. Comment out to turn off. 
 		static f64 timing_refresh = 0;
 		static char buffer[256];
+		//generations/sec is measured over half a second, a tenth is too short for slow speeds.
+		static f64 rate_refresh = 0;
+		static uint64 rate_generation = 0;
+		static f64 gens_per_second = 0;
 		if (pl.time.fcurrent_seconds - timing_refresh > 0.1)//refreshing at a tenth(0.1) of a second.
 		{
+			CellGridStats stats;
+			get_cellgrid_stats((AppMemory*)game_memory, &stats);
+			if (pl.time.fcurrent_seconds - rate_refresh > 0.5)
+			{
+				//the generation can go back (restoring a snapshot).
+				gens_per_second = (stats.generation >= rate_generation) ? (f64)(stats.generation - rate_generation) / (pl.time.fcurrent_seconds - rate_refresh) : 0.0;
+				rate_generation = stats.generation;
+				rate_refresh = pl.time.fcurrent_seconds;
+			}
+
 			int32 frame_rate = (int32)(pl.time.cycles_per_second / pl.time.delta_cycles);
-			pl_format_print(buffer, 256, "Time per frame: %.*fms , %dFPS ; Mouse Pos: [x,y]:[%i,%i]\n", 2, (f64)pl.time.fdelta_seconds * 1000, frame_rate, pl.input.mouse.position_x,pl.input.mouse.position_y);
+			pl_format_print(buffer, 256, "Time per frame: %.*fms , %dFPS ; Generation: %llu , %.*f gens/sec ; Mouse Pos: [x,y]:[%i,%i]\n", 2, (f64)pl.time.fdelta_seconds * 1000, frame_rate, 
+				(unsigned long long)stats.generation, 1, gens_per_second, pl.input.mouse.position_x,pl.input.mouse.position_y);
 			pl.window.title = buffer;
 			timing_refresh = pl.time.fcurrent_seconds;
 		}
@@ -89,6 +100,7 @@ static void init(PL* pl, void** game_memory)
 	init_input_handler(pl, gm);
 
 	//initing the grid processor
+	gm->grid_engine = GridEngine::HASHTABLE;
 	init_grid_processor(pl, gm);
 
 	//initing the renderer
@@ -119,8 +131,9 @@ static void update(PL* pl, void** game_memory)
 	ATP_END(main_update_loop);
 
 	//stats n stuff
-	pl_debug_print("No. of live cells: %i\n", gm->active_table->node_list.size);
+	pl_debug_print("No. of live cells: %i\n", table_live_cells(gm->active_table));
 	pl_debug_print("Max hash depth:%i\n", max_hash_depth);
+	pl_debug_print("Max visited set probe depth:%i\n", max_visited_probe_depth);
 	print_out_tests(*pl);
 }
 
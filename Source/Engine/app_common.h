@@ -3,7 +3,7 @@
 
 typedef Vec2<int64> WorldPos;
 
-enum class CellType
+enum class CellType : uint8
 {
 	EMPTY = 0,
 	SAND,
@@ -16,21 +16,179 @@ struct SandCellData
 	
 };
 
-struct LiveCellNode
+//A live cell in world coordinates. Cells are produced and handed around in this form, and packed into LiveCellNodes when they go into a table.
+struct LiveCell
 {
-	LiveCellNode* next;
 	WorldPos pos;
 	CellType type;
-	void* cell_data;
 };
 
+//NOTE: Tables store their cells relative to chunks of TABLE_CHUNK_SIZE x TABLE_CHUNK_SIZE cells. Every table lists the min corner of each chunk its cells are in,
+//so a node only needs the position inside its chunk and the chunk's index. (8 bytes, where a LiveCell is 24)
+//No cell type has any extra data yet. A payload would go in a side array next to the node list, only for the types that need one.
+#define TABLE_CHUNK_BITS 16
+#define TABLE_CHUNK_SIZE (1LL << TABLE_CHUNK_BITS)
+#define TABLE_MAX_CHUNKS (1 << 24)	//chunk indices are 24 bits. A table can't take cells in more chunks than that, they are rejected (loading, painting) or stop the grid (see CellGridStats::grid_full).
+#define TABLE_CHUNK_NONE UINT32MAX
+
+struct LiveCellNode
+{
+	uint16 x;			//position inside the chunk.
+	uint16 y;
+	uint16 chunk_low;	//index into the table's chunk list, split around the type. (see node_chunk)
+	CellType type;
+	uint8 chunk_high;
+};
+
+static FORCEDINLINE uint32 node_chunk(LiveCellNode* node)
+{
+	return node->chunk_low | ((uint32)node->chunk_high << 16);
+}
+
+static FORCEDINLINE WorldPos chunk_corner(WorldPos pos)
+{
+	return { pos.x & ~(TABLE_CHUNK_SIZE - 1), pos.y & ~(TABLE_CHUNK_SIZE - 1) };
+}
+
+static FORCEDINLINE LiveCellNode pack_node(WorldPos pos, WorldPos corner, uint32 chunk, CellType type)
+{
+	ASSERT(chunk < TABLE_MAX_CHUNKS);
+	return { (uint16)(pos.x - corner.x), (uint16)(pos.y - corner.y), (uint16)chunk, type, (uint8)(chunk >> 16) };
+}
+
+//Virtual memory arenas
+//NOTE: The arena's capacity is a range of address space reserved up front. Pages only get backed by memory once they are committed, so the capacity can be far bigger than what's ever used.
+//Pushing past the committed pages faults, so every push on these arenas has to be preceded by commit_arena for its size. Committed pages stay committed until the arena is released.
+#define ARENA_COMMIT_STEP Megabytes(1)	//pages get committed this much at a time (power of 2).
+#ifndef Gigabytes
+#define Gigabytes(x) ((uint64)(x) << 30)
+#endif
+
+void* reserve_memory(uint64 size);
+void commit_memory(void* base, uint64 size);	//fresh pages read as zero.
+void release_memory(void* base, uint64 size);
+
+void reserve_arena(MArena* arena, uint64 capacity);
+void release_arena(MArena* arena);
+void commit_arena_pages(MArena* arena, uint64 end);
+
+//Makes sure the next size bytes pushed on the arena are committed.
+static FORCEDINLINE void commit_arena(MArena* arena, uint64 size)
+{
+	//everything below top (rounded up to a commit step) is always committed.
+	uint64 committed = (arena->top + ARENA_COMMIT_STEP - 1) & ~(uint64)(ARENA_COMMIT_STEP - 1);
+	if (arena->top + size > committed)
+	{
+		commit_arena_pages(arena, arena->top + size);
+	}
+}
+
+//A cell that isn't the same in two consecutive generations.
+struct CellChange
+{
+	WorldPos pos;
+	CellType type;		//EMPTY if the cell died.
+	CellType prev_type;	//EMPTY if the cell was born.
+};
+
+//NOTE: Flat open addressing hash table (swiss table style) over the live node list.
+//The table is split into HASHTABLE_SHARDS independent shards, picked by the top bits of the hash. Probing never leaves a shard, so the grid workers can each fill their own shards in parallel.
+//Each shard is made of groups of 16 slots. Every slot has a control byte that is either CTRL_EMPTY, CTRL_DELETED or the low 7 bits of the cell's hash (the tag).
+//A lookup checks all 16 control bytes of a group at once with SSE2 and only compares the cells whose tag matches. 
+#define HASHTABLE_SHARD_BITS 6
+#define HASHTABLE_SHARDS (1 << HASHTABLE_SHARD_BITS)
+#define HASHTABLE_GROUP_SIZE 16
+#define HASHTABLE_MIN_SHARD_GROUPS 4
+
+#define CTRL_EMPTY ((uint8)0x80)
+#define CTRL_DELETED ((uint8)0xFE)
+
 struct Hashtable
 {
-	MSlice<LiveCellNode*> table;
+	MSlice<uint8> ctrl;		//control byte for every slot.
+	MSlice<uint32> slots;	//index into the node list for every slot.
+	uint32 shard_groups;	//number of groups in every shard (power of 2).
+	uint32 shard_used[HASHTABLE_SHARDS];	//slots that aren't CTRL_EMPTY (tombstones count too) in every shard. Used for the load factor.
+
 	MSlice<LiveCellNode> node_list;
-	MArena arena;
+	uint32 type_counts[4];	//nodes of every type in the node list, indexed by CellType. The EMPTY ones are purged cells and duplicates, the rest are the live cells.
+	MArena arena;			//holds the node list. (virtual memory arena)
+	MArena table_arena;		//holds the control bytes and slots. Gets reset whenever the table is resized. (virtual memory arena)
+
+	MSlice<WorldPos> chunks;	//min corner of every chunk the nodes can be in.
+	MSlice<uint32> chunk_map;	//open addressing (linear probing) from chunk corner to index in chunks. TABLE_CHUNK_NONE is empty.
+	MArena chunk_arena;			//holds the chunk list. (virtual memory arena)
+	MArena chunk_map_arena;		//holds the chunk map. Gets reset whenever the map is rebuilt. (virtual memory arena)
 };
 
+static FORCEDINLINE uint32 table_live_cells(Hashtable* ht)
+{
+	return ht->type_counts[(uint32)CellType::SAND] + ht->type_counts[(uint32)CellType::CONWAY] + ht->type_counts[(uint32)CellType::BRICK];
+}
+
+//Changes the type of a node in the node list, keeping the type counts up to date.
+static FORCEDINLINE void set_node_type(Hashtable* ht, LiveCellNode* node, CellType type)
+{
+	ht->type_counts[(uint32)node->type]--;
+	ht->type_counts[(uint32)type]++;
+	node->type = type;
+}
+
+static FORCEDINLINE WorldPos node_pos(Hashtable* ht, LiveCellNode* node)
+{
+	WorldPos corner = ht->chunks.front[node_chunk(node)];
+	return { corner.x + node->x, corner.y + node->y };
+}
+
+static FORCEDINLINE uint32 chunk_map_index(WorldPos corner)
+{
+	uint64 hash = (uint64)(corner.x >> TABLE_CHUNK_BITS) * 0x9E3779B97F4A7C15ULL + (uint64)(corner.y >> TABLE_CHUNK_BITS) * 0xC2B2AE3D27D4EB4FULL;
+	return (uint32)(hash >> 32);
+}
+
+//Returns the index of the chunk with this min corner, or TABLE_CHUNK_NONE if the table doesn't have it.
+static FORCEDINLINE uint32 find_table_chunk(Hashtable* ht, WorldPos corner)
+{
+	uint32 mask = ht->chunk_map.size - 1;
+	uint32 index = chunk_map_index(corner) & mask;
+	while (ht->chunk_map.front[index] != TABLE_CHUNK_NONE)
+	{
+		uint32 chunk = ht->chunk_map.front[index];
+		if (ht->chunks.front[chunk].x == corner.x && ht->chunks.front[chunk].y == corner.y)
+		{
+			return chunk;
+		}
+		index = (index + 1) & mask;
+	}
+	return TABLE_CHUNK_NONE;
+}
+
+//Returns the index of the chunk with this min corner, adding it to the table if it isn't there yet. TABLE_CHUNK_NONE if the table already has TABLE_MAX_CHUNKS.
+uint32 add_table_chunk(Hashtable* ht, WorldPos corner);
+//Empties the chunk list, with a map sized for expected_chunks.
+void reset_table_chunks(Hashtable* ht, uint32 expected_chunks);
+
+//Packs a cell for the table into node, adding its chunk if needed. FALSE if the chunk doesn't fit in the table.
+//last_corner/last_chunk cache the previous chunk, cells next to each other are usually in the same one.
+static FORCEDINLINE b32 pack_table_node(Hashtable* ht, LiveCell cell, WorldPos* last_corner, uint32* last_chunk, LiveCellNode* node)
+{
+	WorldPos corner = chunk_corner(cell.pos);
+	if (*last_chunk == TABLE_CHUNK_NONE || corner.x != last_corner->x || corner.y != last_corner->y)
+	{
+		*last_chunk = add_table_chunk(ht, corner);
+		*last_corner = corner;
+		if (*last_chunk == TABLE_CHUNK_NONE)
+		{
+			return FALSE;
+		}
+	}
+	*node = pack_node(cell.pos, corner, *last_chunk, cell.type);
+	return TRUE;
+}
+
+//Furthest the camera zooms out (world cells per pixel). Past 1, the renderer shades pixels by the density of live cells under them.
+#define CAMERA_MAX_SCALE 4096.0
+
 struct CameraState
 {
 
@@ -42,6 +200,23 @@ struct CameraState
 
 };
 
+//Which engine the grid processor uses to compute generations. Picked before init_grid_processor.
+enum class GridEngine
+{
+	HASHTABLE = 0,	//processes every live cell one by one through the hash table. Supports every cell type.
+	TILED,			//conway cells as bit packed 64x64 tiles. Other cell types are still processed one by one.
+	HASHLIFE,		//conway cells in a memoized quadtree, can jump 2^step_log2 generations per step. Other cell types still only get one generation per step.
+	SCATTER			//like HASHTABLE, but live conway cells add to their neighbors' counts in a count map instead of every cell looking up its neighbors.
+};
+
+//How the grid processor gets ahead of the display. (see set_cellgrid_fast_forward)
+enum class FastForward
+{
+	OFF = 0,	//every tick moves the display forward through the generations computed ahead.
+	LIMITED,	//only the steps that came due are computed (see add_cellgrid_steps), for speeds where a tick takes more steps than the ring holds.
+	UNLIMITED	//the grid processor runs as fast as it can.
+};
+
 //NOTE: This is only possible with C++11. 
 //If compiling in C, make sure this is 4 bytes (to allign with the thread safe, 32 bit interlocked compare and exchange)
 enum CellGridStatus
@@ -60,7 +235,15 @@ struct AppMemory
 	
 	CellGridStatus cellgrid_status;
 
+	GridEngine grid_engine;
+	uint32 step_log2;		//generations per step are 2^step_log2. Only the HashLife engine goes past 1, the others ignore it.
+	FastForward fast_forward;	//unless OFF, the grid processor doesn't wait for the display and every tick shows the newest generation it has computed. (see set_cellgrid_fast_forward)
+	b32 cells_edited;		//set when cells are added or removed from outside the grid processor (painting, loading). Tells engines with their own world representation to reload it from the active table.
+
 	b32 camera_changed;		//tells the renderer to recalculate the WorldPos for each pixel.
+	b32 grid_changed;		//tells the renderer the active table has changed (moved to another generation or painted on).
+	MSlice<CellChange>* grid_changes;	//set along with grid_changed when the active table just moved one generation forward: every cell that changed. NULL means anything might have.
+	b32 track_grid_changes;	//set by the renderer, makes the grid processor list the cells that changed in every generation.
 
 	//------------------------
 
@@ -79,134 +262,345 @@ void shutdown_input_handler(PL* pl, AppMemory* gm);
 void init_grid_processor(PL* pl, AppMemory* gm);
 CellGridStatus query_cellgrid_update_state(AppMemory* gm);
 void cellgrid_update_step(PL* pl, AppMemory* gm);
+//The grid processor computes generations ahead of the displayed one while unpaused. Pausing waits for it to stop, so the active table can be painted on.
+void set_cellgrid_paused(AppMemory* gm, b32 paused);
+//Only switched through here, the grid processor computes generations ahead differently in fast forward. Switching it off jumps to the newest generation.
+void set_cellgrid_fast_forward(AppMemory* gm, FastForward fast_forward);
+//Steps that came due for the display. Ticks take them as far as they are computed, the rest carries over to the next tick, up to max_pending. Returns the steps pending.
+int32 add_cellgrid_steps(AppMemory* gm, int32 steps, int32 max_pending);
+//Keeps the process thread off the displayed table until it's released, so another thread can read it while the grid runs. Returns NULL while paused (the main thread edits the table then), pausing waits for the release.
+Hashtable* hold_displayed_table(AppMemory* gm);
+void release_held_table(AppMemory* gm);
 void shutdown_grid_processor(PL* pl, AppMemory* gm);
 
+//Processes one generation on the calling thread and moves the active table to it. Used for driving the grid without the render/input loop (headless runner).
+void step_cellgrid_generation(AppMemory* gm);
+
+//Life-like rule followed by the conway cells (outer totalistic, 8 neighbors). Bit n of birth (survive) is set if a dead (live) cell with n live neighbors is alive next generation.
+struct LifeRule
+{
+	uint16 birth;
+	uint16 survive;
+};
+#define CONWAY_BIRTH_MASK (1 << 3)
+#define CONWAY_SURVIVE_MASK ((1 << 2) | (1 << 3))
+
+//Reads "B36/S23" style rulestrings (any case, either order, "S" part optional) and the older "23/36" survive/birth form.
+//Rules with B0 are refused, they would fill the whole infinite grid in one generation.
+b32 parse_life_rule(const char* rulestring, LifeRule* rule);
+//Writes the rule as "B36/S23".
+void format_life_rule(LifeRule rule, char* buffer, uint32 buffer_size);
+
+//The grid processor starts out with B3/S23. Only call while paused, the engines restart from the active table with the new rule.
+void set_cellgrid_rule(AppMemory* gm, LifeRule rule);
+LifeRule get_cellgrid_rule(AppMemory* gm);
+
+struct CellGridStats
+{
+	uint64 generation;			//of the active table.
+	uint32 live_cells;
+	uint32 sand_cells;
+	int32 max_hash_depth;
+	int32 max_visited_probe_depth;
+	uint32 tiles;				//tiled engine only.
+	uint32 active_tiles;		//tiles that weren't skipped as stable in the last generation.
+	uint32 sand_chunks;
+	uint32 awake_sand_chunks;	//sand chunks that weren't asleep in the last generation.
+
+	uint64 table_arena_high_water;
+	uint64 table_arena_capacity;
+	uint64 temp_arena_high_water;
+	uint64 temp_arena_capacity;
+
+	b32 grid_full;				//the next generation has cells in more chunks than a table can take (TABLE_MAX_CHUNKS). The grid stops at the active table until it's unpaused again.
+};
+void get_cellgrid_stats(AppMemory* gm, CellGridStats* stats);
+
+//Cells were added or removed from outside the grid processor (painting, loading).
+static FORCEDINLINE void mark_cells_edited(AppMemory* gm)
+{
+	gm->cells_edited = TRUE;
+	gm->grid_changed = TRUE;
+	gm->grid_changes = NULL;	//the edits aren't in any change list.
+}
+
+//A whole file mapped read only into memory.
+struct MappedFile
+{
+	uint8* data;			//NULL for an empty file.
+	uint64 size;
+	void* file_handle;
+	void* mapping_handle;	//Windows only.
+};
+b32 map_file(const char* path, MappedFile* file);
+void unmap_file(MappedFile* file);
+
+enum class PatternFormat
+{
+	AUTO = 0,	//loading: picked from the contents of the file. saving: picked from the file extension.
+	RLE,		//.rle, multi state (.ABC) when there are cells other than conway.
+	LIFE_106,	//.lif, one "x y" line per live cell.
+	PLAINTEXT,	//.cells
+	MACROCELL	//.mc, golly's quadtree format.
+};
+
+enum class PatternResult
+{
+	OK = 0,
+	FILE_ERROR,
+	PARSE_ERROR,
+	TOO_LARGE,		//doesn't fit in the table's node arena or the scratch arena.
+	NOT_TWO_STATE	//saving: the format only has live and dead cells, but there are sand or brick cells. (.rle and .mc keep them)
+};
+
+//Room to leave free in the temp arena for loading and saving patterns (macrocell node tables, sorted cells for export).
+#define PATTERN_SCRATCH_SIZE Megabytes(64)
+
+//Adds the cells of a pattern file to the active table, with the pattern's origin (the center for RLE and macrocell, the top left corner for plaintext) at 'origin'.
+//Only call when the grid processor isn't running ahead. The scratch arena is only used while loading. Nothing is added if it fails.
+PatternResult load_pattern(AppMemory* gm, const char* path, PatternFormat format, WorldPos origin, MArena* scratch);
+//Writes every live cell of the active table to a pattern file. If it fails, a file already at path is left as it was.
+PatternResult save_pattern(AppMemory* gm, const char* path, PatternFormat format, MArena* scratch);
+
+//Binary checkpoint of the active table (node list and hash index as they are in memory), the camera and the generation count.
+//Restoring copies the table back in whole blocks, nothing gets rehashed. Only call while paused. Returns FALSE (leaving the grid untouched) if the file can't be read or doesn't fit.
+b32 save_snapshot(AppMemory* gm, const char* path);
+b32 load_snapshot(AppMemory* gm, const char* path);
+
 void init_renderer(PL* pl, AppMemory* gm);
 void render(PL* pl, AppMemory* gm);
 void shutdown_renderer(PL* pl, AppMemory* gm);
 
-static FORCEDINLINE uint32 hash_pos(WorldPos value, uint32 table_size)
+//Proper mixing hash for a world position (murmur3 finalizer over both coordinates). 
+static FORCEDINLINE uint64 hash_pos(WorldPos value)
 {
-	//NOTE: If hash algo is changed, respectively change the wide version used during pixel fill.
-
-	//TODO: proper hash function LOL.
-	uint32 hash = (uint32)(value.x * 16 + value.y * 3) & (table_size - 1);
+	uint64 hash = (uint64)value.x * 0x9E3779B97F4A7C15ULL;
+	hash ^= (uint64)value.y + 0x632BE59BD9B4E019ULL + (hash << 6) + (hash >> 2);
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ULL;
+	hash ^= hash >> 33;
 	return hash;
 }
 
 #define INVALID_CELL INT64MAX
 
-static inline b32 purge_cell(Hashtable* ht, uint32 slot_index, WorldPos pos)
+static FORCEDINLINE uint32 bit_scan_forward(uint32 mask)
 {
-	LiveCellNode* it = ht->table[slot_index];
-	if (it == 0)
-	{
-		return FALSE;
-	}
-	else
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (uint32)index;
+#else
+	return (uint32)__builtin_ctz(mask);
+#endif
+}
+
+static FORCEDINLINE uint32 bit_scan_forward_64(uint64 mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, mask);
+	return (uint32)index;
+#else
+	return (uint32)__builtin_ctzll(mask);
+#endif
+}
+
+static FORCEDINLINE uint32 popcount_64(uint64 mask)
+{
+#ifdef _MSC_VER
+	return (uint32)__popcnt64(mask);
+#else
+	return (uint32)__builtin_popcountll(mask);
+#endif
+}
+
+static FORCEDINLINE uint32 hash_shard(uint64 hash)
+{
+	return (uint32)(hash >> (64 - HASHTABLE_SHARD_BITS));
+}
+
+static FORCEDINLINE uint8 hash_tag(uint64 hash)
+{
+	return (uint8)(hash & 0x7F);
+}
+
+//Returns the index of the slot holding the cell, or UINT32MAX if it isn't in the table. 
+static inline uint32 find_slot(Hashtable* ht, uint64 hash, WorldPos pos)
+{
+	uint32 group_mask = ht->shard_groups - 1;
+	uint32 shard_base = hash_shard(hash) * ht->shard_groups;
+	uint32 group = (uint32)(hash >> 7) & group_mask;
+
+	__m128i tag_16x = _mm_set1_epi8((char)hash_tag(hash));
+	__m128i empty_16x = _mm_set1_epi8((char)CTRL_EMPTY);
+
+	//triangular probing over the groups of the shard. Visits every group since shard_groups is a power of 2. 
+	for (uint32 step = 1; step <= ht->shard_groups; step++)
 	{
-		if (it->pos.x == pos.x && it->pos.y == pos.y)
-		{
-			it->type = CellType::EMPTY;
-			ht->table[slot_index] = it->next;
-			return TRUE;
-		}
-		else
+		uint32 base = (shard_base + group) * HASHTABLE_GROUP_SIZE;
+		__m128i ctrl_16x = _mm_loadu_si128((__m128i*)(ht->ctrl.front + base));
+
+		uint32 match = (uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl_16x, tag_16x));
+		while (match)
 		{
-			LiveCellNode* prev = it;
-			LiveCellNode* next = it->next;
-			if (next == 0)
+			uint32 slot = base + bit_scan_forward(match);
+			LiveCellNode* node = ht->node_list.front + ht->slots[slot];
+			WorldPos corner = ht->chunks.front[node_chunk(node)];
+			if (corner.x + node->x == pos.x && corner.y + node->y == pos.y)
 			{
-				return FALSE;	//Cell doesn't exist.
-			}
-			else
-			{
-				while ((next->pos.x != pos.x && next->pos.y != pos.y))
-				{
-					prev = next;
-					next = next->next;
-					if (next == 0)
-					{
-						return FALSE;	//Cell doesn't exist. End of list. 
-					}
-				}
-				next->type = CellType::EMPTY;
-				prev->next = next->next;
-				return TRUE;
+				return slot;
 			}
+			match &= match - 1;
 		}
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl_16x, empty_16x)))
+		{
+			return UINT32MAX;	//an empty slot ends the probe sequence.
+		}
+		group = (group + step) & group_mask;
 	}
+	return UINT32MAX;
 }
 
-static inline CellType lookup_cell(Hashtable* ht, uint32 slot_index, WorldPos pos)
+//---d--
+extern int32 max_hash_depth;
+extern int32 max_visited_probe_depth;
+//---d--
+
+//Puts the node index in the first free slot along the probe sequence. Doesn't check if the cell is already in the table or if the shard has room. 
+//Returns the number of groups probed. 
+static inline int32 insert_slot(Hashtable* ht, uint64 hash, uint32 node_index)
 {
-	LiveCellNode* front = ht->table[slot_index];
-	while (front != 0)
+	uint32 shard = hash_shard(hash);
+	uint32 group_mask = ht->shard_groups - 1;
+	uint32 shard_base = shard * ht->shard_groups;
+	uint32 group = (uint32)(hash >> 7) & group_mask;
+
+	int32 depth = 1;
+	for (uint32 step = 1; ; step++)
 	{
-		if (front->pos.x == pos.x && front->pos.y == pos.y)
+		uint32 base = (shard_base + group) * HASHTABLE_GROUP_SIZE;
+		__m128i ctrl_16x = _mm_loadu_si128((__m128i*)(ht->ctrl.front + base));
+		uint32 free_mask = (uint32)_mm_movemask_epi8(ctrl_16x);	//CTRL_EMPTY and CTRL_DELETED are the only control bytes with the top bit set. 
+		if (free_mask)
 		{
-			return front->type;
+			uint32 slot = base + bit_scan_forward(free_mask);
+			if (ht->ctrl[slot] == CTRL_EMPTY)
+			{
+				ht->shard_used[shard]++;
+			}
+			ht->ctrl[slot] = hash_tag(hash);
+			ht->slots[slot] = node_index;
+			return depth;
 		}
-		front = front->next;
+		group = (group + step) & group_mask;
+		depth++;
 	}
-	return CellType::EMPTY;
 }
- 
-static inline LiveCellNode* get_cell(Hashtable* ht, uint32 slot_index, WorldPos pos)
+
+static FORCEDINLINE uint32 hashtable_shard_capacity(Hashtable* ht)
 {
-	LiveCellNode* front = ht->table[slot_index];
-	while (front != 0)
+	return ht->shard_groups * HASHTABLE_GROUP_SIZE;
+}
+
+//Max load factor of a shard is 7/8.
+static FORCEDINLINE b32 hashtable_shard_full(Hashtable* ht, uint32 shard, uint32 incoming)
+{
+	uint32 capacity = hashtable_shard_capacity(ht);
+	return (ht->shard_used[shard] + incoming) > (capacity - (capacity >> 3));
+}
+
+//Smallest number of groups per shard that keeps a shard with this many cells under the max load factor.
+static FORCEDINLINE uint32 hashtable_groups_for(uint32 max_shard_count)
+{
+	uint32 shard_groups = HASHTABLE_MIN_SHARD_GROUPS;
+	while (max_shard_count > (shard_groups * HASHTABLE_GROUP_SIZE) - ((shard_groups * HASHTABLE_GROUP_SIZE) >> 3))
 	{
-		if (front->pos.x == pos.x && front->pos.y == pos.y)
-		{
-			return front;
-		}
-		front = front->next;
+		shard_groups <<= 1;
 	}
-	return NULL;
+	return shard_groups;
 }
 
-//---d--
-extern int32 max_hash_depth;
-//---d--
+//Allocates an empty table with the given number of groups per shard (throws away the previous control bytes and slots).
+void reset_hashtable(Hashtable* ht, uint32 shard_groups);
+//Resizes the table and re-inserts every live node of the node list.
+void rehash_hashtable(Hashtable* ht, uint32 shard_groups);
+//Bulk insert: puts the nodes appended to the node list from first_new_node on into the table, growing it once for all of them.
+//With check_duplicates, a new node whose cell is already in the table overwrites its type and is left in the node list as EMPTY. Without it, the new cells must not be in the table yet.
+void insert_new_nodes(Hashtable* ht, uint32 first_new_node, b32 check_duplicates);
 
-static inline void append_new_node(Hashtable* ht, uint32 hash_index, LiveCellNode cell)
+static inline b32 purge_cell(Hashtable* ht, uint64 hash, WorldPos pos)
 {
-	//---d--
-	int32 depth = 1;
-	//---d--
+	uint32 slot = find_slot(ht, hash, pos);
+	if (slot == UINT32MAX)
+	{
+		return FALSE;	//Cell doesn't exist.
+	}
+	set_node_type(ht, ht->node_list.front + ht->slots[slot], CellType::EMPTY);
+	ht->ctrl[slot] = CTRL_DELETED;
+	return TRUE;
+}
 
+//Index of the cell's node in the node list, UINT32MAX if it isn't in the table.
+static inline uint32 lookup_node(Hashtable* ht, uint64 hash, WorldPos pos)
+{
+	uint32 slot = find_slot(ht, hash, pos);
+	return (slot == UINT32MAX) ? UINT32MAX : ht->slots[slot];
+}
+
+static inline CellType lookup_cell(Hashtable* ht, uint64 hash, WorldPos pos)
+{
+	uint32 slot = find_slot(ht, hash, pos);
+	if (slot == UINT32MAX)
+	{
+		return CellType::EMPTY;
+	}
+	return ht->node_list[ht->slots[slot]].type;
+}
+ 
+static inline LiveCellNode* get_cell(Hashtable* ht, uint64 hash, WorldPos pos)
+{
+	uint32 slot = find_slot(ht, hash, pos);
+	if (slot == UINT32MAX)
+	{
+		return NULL;
+	}
+	return ht->node_list.front + ht->slots[slot];
+}
+
+static inline void append_new_node(Hashtable* ht, uint64 hash, LiveCell cell)
+{
 	//checking if already in table 
-	LiveCellNode* cell_in_table = get_cell(ht, hash_index, cell.pos);
+	LiveCellNode* cell_in_table = get_cell(ht, hash, cell.pos);
 	if (cell_in_table != NULL)
 	{
-		*cell_in_table = cell;
+		set_node_type(ht, cell_in_table, cell.type);
 		return;
 	}
 
-	LiveCellNode* new_node = ht->node_list.add(&ht->arena, cell);
-	//append to table list
-	LiveCellNode* iterator = ht->table[hash_index];
-	if (iterator == 0)
+	if (hashtable_shard_full(ht, hash_shard(hash), 1))
 	{
-		ht->table[hash_index] = new_node;
+		rehash_hashtable(ht, ht->shard_groups * 2);
 	}
-	else
+
+	WorldPos corner = chunk_corner(cell.pos);
+	uint32 chunk = add_table_chunk(ht, corner);
+	if (chunk == TABLE_CHUNK_NONE)
 	{
-		while (iterator->next != 0)
-		{
-			//---d--
-			depth++;
-			//---d--
-			iterator = iterator->next;
-		}
-		iterator->next = new_node;
+		return;	//the table can't take cells in another chunk.
 	}
+	commit_arena(&ht->arena, sizeof(LiveCellNode));
+	ht->node_list.add(&ht->arena, pack_node(cell.pos, corner, chunk, cell.type));
+	ht->type_counts[(uint32)cell.type]++;
+	int32 depth = insert_slot(ht, hash, ht->node_list.size - 1);
+
 	//---d--
 	if (depth > max_hash_depth)
 		max_hash_depth = depth;
 	//---d--
-
 }
 
 static FORCEDINLINE int64 f64_to_int64(f64 value)
@@ -242,4 +636,49 @@ static inline WorldPos screen_to_world(WorldPos screen_coord, CameraState cm)
 	WorldPos world = { f64_to_int64(screen_coordf.x + (f64)cm.sub_world_center.x),f64_to_int64(screen_coordf.y + (f64)cm.sub_world_center.y) };
 	world += cm.world_center;
 	return world;
-}
\ No newline at end of file
+}
+
+//Returns the incremented value.
+static FORCEDINLINE int32 interlocked_increment(int32 volatile* value)
+{
+	int32 prev;
+	do
+	{
+		prev = *value;
+	} while (interlocked_compare_exchange_i32(value, prev + 1, prev) != prev);
+	return prev + 1;
+}
+
+//Returns the new value.
+static FORCEDINLINE int32 interlocked_add(int32 volatile* value, int32 addend)
+{
+	int32 prev;
+	do
+	{
+		prev = *value;
+	} while (interlocked_compare_exchange_i32(value, prev + addend, prev) != prev);
+	return prev + addend;
+}
+
+//Blocks the thread while *value == compare, until another thread changes it and calls wake_value_waiters. (futex / WaitOnAddress, see thread_wait.cpp)
+//NOTE: It can return without the value changing, so it's always called in a loop.
+void wait_on_value(int32 volatile* value, int32 compare);
+void wake_value_waiters(int32 volatile* value);
+
+//Spins for a bit before blocking, so back to back jobs don't pay for a wakeup. Whoever changes the value has to wake its waiters.
+static inline void wait_while_equal(int32 volatile* value, int32 compare)
+{
+	uint32 spins = 0;
+	while (*value == compare)
+	{
+		if (spins < 4000)
+		{
+			_mm_pause();
+			spins++;
+		}
+		else
+		{
+			wait_on_value(value, compare);
+		}
+	}
+}
@@ -0,0 +1,257 @@
+#pragma once
+#include "app_common.h"
+
+//Interfaces of the alternative simulation engines used by the grid processor.
+//NOTE: The grid processor always hands the result of a generation to the rest of the app through the double buffered Hashtable.
+//These engines keep their own representation of the world and only export the live cells into the next table.
+
+//-----------------------------------------
+//Life-like rule kernels
+//Every engine steps conway cells through a kernel templated on the rule, picked once per generation (never per cell).
+//The common rules are instantiated with their masks as template arguments, so the masks fold into constants. Any other rule goes through DynamicLifeRule.
+template<uint32 BIRTH, uint32 SURVIVE>
+struct StaticLifeRule
+{
+	static const uint32 birth = BIRTH;
+	static const uint32 survive = SURVIVE;
+	FORCEDINLINE StaticLifeRule(LifeRule) {}
+};
+
+struct DynamicLifeRule
+{
+	uint32 birth;
+	uint32 survive;
+	FORCEDINLINE DynamicLifeRule(LifeRule rule) : birth(rule.birth), survive(rule.survive) {}
+};
+
+typedef StaticLifeRule<CONWAY_BIRTH_MASK, CONWAY_SURVIVE_MASK> ConwayRule;								//B3/S23
+typedef StaticLifeRule<(1 << 3) | (1 << 6), (1 << 2) | (1 << 3)> HighLifeRule;							//B36/S23
+typedef StaticLifeRule<(1 << 3) | (1 << 6) | (1 << 7) | (1 << 8), (1 << 3) | (1 << 4) | (1 << 6) | (1 << 7) | (1 << 8)> DayAndNightRule;	//B3678/S34678
+typedef StaticLifeRule<(1 << 2), 0> SeedsRule;															//B2/S
+typedef StaticLifeRule<(1 << 3), 0x1FF> LifeWithoutDeathRule;											//B3/S012345678
+typedef StaticLifeRule<(1 << 3), (1 << 1) | (1 << 2) | (1 << 3) | (1 << 4) | (1 << 5)> MazeRule;		//B3/S12345
+typedef StaticLifeRule<(1 << 1) | (1 << 3) | (1 << 5) | (1 << 7), (1 << 1) | (1 << 3) | (1 << 5) | (1 << 7)> ReplicatorRule;	//B1357/S1357
+
+//Kernel tables list an instantiation for every rule here, in this order, followed by the DynamicLifeRule one.
+#define LIFE_RULE_KERNELS(KERNEL) KERNEL(ConwayRule) KERNEL(HighLifeRule) KERNEL(DayAndNightRule) KERNEL(SeedsRule) KERNEL(LifeWithoutDeathRule) KERNEL(MazeRule) KERNEL(ReplicatorRule)
+
+#define LIFE_RULE_OF_KERNEL(RULE) { (uint16)RULE::birth, (uint16)RULE::survive },
+static const LifeRule life_rule_kernel_rules[] = { LIFE_RULE_KERNELS(LIFE_RULE_OF_KERNEL) };
+#define DYNAMIC_LIFE_RULE_KERNEL ArrayCount(life_rule_kernel_rules)
+
+//Index of the rule's kernel in the kernel tables.
+static inline uint32 life_rule_kernel(LifeRule rule)
+{
+	for (uint32 i = 0; i < ArrayCount(life_rule_kernel_rules); i++)
+	{
+		if (life_rule_kernel_rules[i].birth == rule.birth && life_rule_kernel_rules[i].survive == rule.survive)
+		{
+			return i;
+		}
+	}
+	return DYNAMIC_LIFE_RULE_KERNEL;
+}
+
+//Next state of a single cell with count live neighbors.
+template<typename Rule>
+static FORCEDINLINE b32 life_rule_next(Rule rule, uint32 count, b32 alive)
+{
+	uint32 table = rule.birth | (rule.survive << 9);
+	return (table >> (count + 9 * alive)) & 1;
+}
+
+//Next state of a whole word of cells, from the bits of their live neighbor counts (ones + 2 twos + 4 fours + 8 eights).
+//NOTE: The loop is over counts, not cells. With a StaticLifeRule every branch is decided at compile time.
+template<typename Rule, typename Word>
+static FORCEDINLINE Word life_rule_next_word(Rule rule, Word ones, Word twos, Word fours, Word eights, Word alive)
+{
+	Word result = 0;
+	for (uint32 count = 0; count <= 8; count++)
+	{
+		b32 birth = (rule.birth >> count) & 1;
+		b32 survive = (rule.survive >> count) & 1;
+		if (birth || survive)
+		{
+			Word match = ((count & 1) ? ones : ~ones) & ((count & 2) ? twos : ~twos) & ((count & 4) ? fours : ~fours) & ((count & 8) ? eights : ~eights);
+			result |= match & (birth ? (survive ? ~(Word)0 : ~alive) : alive);
+		}
+	}
+	return result;
+}
+
+//B3/S23 reduced by hand: alive next if the count is 3, or 2 and already alive. (a count of 8 has no twos bit either)
+template<typename Word>
+static FORCEDINLINE Word life_rule_next_word(ConwayRule, Word ones, Word twos, Word fours, Word /*eights*/, Word alive)
+{
+	return twos & ~fours & (ones | alive);
+}
+
+//-----------------------------------------
+//Tiled engine (tiled_engine.cpp)
+//Conway cells packed as 64x64 bit tiles (one uint64 per row), keyed by tile coordinate in a sparse open addressing map.
+//A generation is computed a whole row of 64 cells at a time with bitwise full adders.
+//Tiles whose whole 3x3 neighborhood is the same as 2 generations ago (still lifes and period 2 oscillators) are skipped, the other buffer already holds their next state.
+#define TILE_SIZE_BITS 6
+#define TILE_SIZE (1 << TILE_SIZE_BITS)
+
+struct Tile
+{
+	int64 tx;
+	int64 ty;
+	uint64 rows[2][TILE_SIZE];	//double buffered, TileWorld::parity picks the current one. Bit b of rows[..][r] is the cell at (tx * 64 + b, ty * 64 + r).
+	uint8 changed[2];			//changed[parity] is set if the current state differs from the one 2 generations ago. 
+};
+
+struct TileWorld
+{
+	MArena arena;			//holds the tile pool.
+	MArena map_arena;		//holds the tile map. Gets reset whenever the map is rebuilt.
+
+	MSlice<Tile> tiles;
+	MSlice<uint32> map;		//open addressing (linear probing) from tile coordinate to index in tiles. UINT32MAX is empty.
+	uint32 parity;
+	uint64 live_cells;
+	uint32 active_tiles;	//tiles that weren't skipped in the last step.
+	uint32 unsettled_steps;	//steps left that can't skip any tile. After a load the other buffer doesn't hold a real generation yet, so changed[] isn't either.
+};
+
+void init_tile_world(TileWorld* tw);
+void shutdown_tile_world(TileWorld* tw);
+
+//Rebuilds the tile world from the conway cells of the table.
+void load_tile_world(TileWorld* tw, Hashtable* table);
+
+//A generation is 3 steps. Only tile_world_step_range can be run by several workers at once (on disjoint ranges).
+//Adds the empty neighbor tiles that could get births from the border cells of a tile.
+void tile_world_prepare_step(TileWorld* tw);
+//Computes the next state of the tiles in [begin, end). Returns how many of them weren't stable. 
+//NOTE: Stable tiles are only skipped correctly if the rule stays the same until the tile world is reloaded.
+uint32 tile_world_step_range(TileWorld* tw, uint32 begin, uint32 end, LifeRule rule);
+//Makes the next state current and throws away tiles that died out (and stayed dead for a generation, so a missing tile always means unchanged).
+void tile_world_finish_step(TileWorld* tw);
+
+//Appends every live cell of the tiles in [begin, end) to the list as a conway cell.
+void tile_world_export_range(TileWorld* tw, uint32 begin, uint32 end, MSlice<LiveCell>* out, MArena* out_arena);
+
+//-----------------------------------------
+//Sand world (sand_engine.cpp)
+//Sand grains packed as 64x64 bit chunks, used by every engine in place of processing sand cells one by one.
+//A grain falls down if it can, else down-left, else down-right. When several grains go for the same cell, falling straight down wins, then down-left. 
+//The grains that lose stay where they are, so sand is never lost. Every cell's next state only depends on the current generation, so the chunks can be computed in any order.
+//Every other live cell (conway, brick) blocks the grains, it's copied into the chunks before every step.
+//Chunks whose whole 3x3 neighborhood is the same as 2 generations ago (settled piles) sleep, like stable tiles.
+#define SAND_CHUNK_SIZE_BITS 6
+#define SAND_CHUNK_SIZE (1 << SAND_CHUNK_SIZE_BITS)
+
+struct SandChunk
+{
+	int64 cx;
+	int64 cy;
+	uint64 sand[2][SAND_CHUNK_SIZE];	//double buffered, SandWorld::parity picks the current one. Bit b of sand[..][r] is the grain at (cx * 64 + b, cy * 64 + r).
+	uint64 solid[2][SAND_CHUNK_SIZE];	//the other live cells, at the generation of the matching sand buffer.
+	uint8 changed[2];					//changed[parity] is set if the current grains differ from the ones 2 generations ago. 
+	uint8 solid_changed[2];				//solid_changed[parity] is set if solid[parity] differs from solid[parity ^ 1].
+	uint8 has_solid[2];
+	uint8 keep;
+};
+
+struct SandWorld
+{
+	MArena arena;			//holds the chunk pool.
+	MArena map_arena;		//holds the chunk map. Gets reset whenever the map is rebuilt.
+
+	MSlice<SandChunk> chunks;
+	MSlice<uint32> map;		//open addressing (linear probing) from chunk coordinate to index in chunks. UINT32MAX is empty.
+	uint32 parity;
+	uint64 grains;
+	uint32 awake_chunks;	//chunks that weren't asleep in the last step.
+};
+
+void init_sand_world(SandWorld* sw);
+void shutdown_sand_world(SandWorld* sw);
+
+//Rebuilds the sand world from the sand cells of the table.
+void load_sand_world(SandWorld* sw, Hashtable* table);
+
+//A step has the same 3 parts as the tiled engine's. Only sand_world_step_range can be run by several workers at once (on disjoint ranges).
+//Adds the chunks around the ones holding sand and copies the other cells of the table into them.
+void sand_world_prepare_step(SandWorld* sw, Hashtable* table);
+//Computes the next grains of the chunks in [begin, end). Returns how many of them weren't asleep.
+uint32 sand_world_step_range(SandWorld* sw, uint32 begin, uint32 end);
+//Makes the next grains current and throws away the chunks that sand can't reach next step.
+void sand_world_finish_step(SandWorld* sw);
+
+//Appends every grain of the chunks in [begin, end) to the list as a sand cell.
+void sand_world_export_range(SandWorld* sw, uint32 begin, uint32 end, MSlice<LiveCell>* out, MArena* out_arena);
+
+//-----------------------------------------
+//HashLife engine (hashlife.cpp)
+//Conway cells in a canonicalized quadtree: every distinct node exists once, so repeated structure (in space and time) is only computed once.
+//Each node memoizes its RESULT, the center half of the node advanced by 2^step_log2 generations.
+#define HASHLIFE_LEAF_LEVEL 3		//leaves are 8x8 cells.
+#define HASHLIFE_LEAF_SIZE (1 << HASHLIFE_LEAF_LEVEL)
+#define HASHLIFE_MIN_ROOT_LEVEL 5
+#define HASHLIFE_MAX_LEVEL 62		//keeps the universe inside int64 coordinates.
+#define HASHLIFE_MAX_STEP_LOG2 (HASHLIFE_MAX_LEVEL - 4)
+#define HASHLIFE_MAX_SUBTREES 256
+
+struct HLNode
+{
+	union
+	{
+		struct
+		{
+			uint32 nw;
+			uint32 ne;
+			uint32 sw;
+			uint32 se;
+		};
+		uint64 bits;		//leaves only. Bit (r * 8 + c) is the cell at column c (west to east), row r (north to south).
+	};
+	uint32 result;			//0 until it's computed.
+	uint32 level;			//the node covers 2^level x 2^level cells.
+	uint64 population;
+};
+
+struct HLSubtree
+{
+	uint32 node;
+	int64 x;	//min corner of the node.
+	int64 y;
+};
+
+struct HashLife
+{
+	MArena arena;			//holds the node pool.
+	MArena map_arena;		//holds the node map. Gets reset whenever the map is rebuilt.
+
+	MSlice<HLNode> nodes;	//index 0 is unused, so 0 can mean 'no node'. Children are always created before their parents.
+	MSlice<uint32> map;		//open addressing (linear probing) from node contents to index in nodes. 0 is empty.
+	uint32 empty[HASHLIFE_MAX_LEVEL + 1];	//the empty node of each level.
+	uint32 root;			//always centered on the origin.
+	uint32 step_log2;
+	uint32 results_step_log2;	//step size the memoized results were computed with.
+	uint32 gc_threshold;		//garbage gets collected once the pool grows past this many nodes.
+	LifeRule rule;
+	LifeRule results_rule;		//rule the memoized results were computed with.
+
+	HLSubtree subtrees[HASHLIFE_MAX_SUBTREES];	//the pieces of the root handed out to the workers for export.
+	uint32 subtree_count;
+};
+
+void init_hashlife(HashLife* hl);
+void shutdown_hashlife(HashLife* hl);
+
+//Rebuilds the tree from the conway cells of the table.
+void load_hashlife(HashLife* hl, Hashtable* table);
+
+void set_hashlife_step_size(HashLife* hl, uint32 step_log2);
+void set_hashlife_rule(HashLife* hl, LifeRule rule);
+//Advances the whole universe by 2^step_log2 generations and returns the number of generations. Collects garbage when the node pool gets half full.
+uint64 hashlife_step(HashLife* hl);
+uint64 hashlife_population(HashLife* hl);
+
+//Splits the root into at least wanted_subtrees non empty pieces (when it can), then every piece can be exported on its own.
+void hashlife_prepare_export(HashLife* hl, uint32 wanted_subtrees);
+//Appends every live cell of the subtrees in [begin, end) to the list as a conway cell.
+void hashlife_export_range(HashLife* hl, uint32 begin, uint32 end, MSlice<LiveCell>* out, MArena* out_arena);
@@ -1,227 +1,1848 @@
-#include "app_common.h"
+#include "grid_engines.h"
 #include "ATProfiler/atp.h"
+#include <thread>
+#include <stdio.h>
 
+//---d--
+int32 max_hash_depth = 0;
+int32 max_visited_probe_depth = 0;
+//---d--
 
+//NOTE: The generation step is split across a pool of workers. The process thread acts as worker 0 and coordinates the others. 
+//Each generation runs in 3 phases so that no two workers ever write to the same memory:
+//	EVALUATE: each worker processes its own slice of the active node list and appends the resulting cells to its own output list (counted per hashtable shard).
+//	SCATTER:  each worker copies its output list into the next table's node list. The node list is laid out shard by shard, so every shard ends up contiguous.
+//	LINK:	  each worker inserts the nodes of its own range of shards into the hash table. Probing never leaves a shard, so no slot is shared between workers.
+#define MAX_GRID_WORKERS 32
+#define GRID_PARALLEL_MIN_CELLS 4096	//below this many live cells, the whole generation is processed on the process thread alone. 
+#ifndef GRID_WORKER_COUNT
+#define GRID_WORKER_COUNT 0		//0 means one worker per core (minus one for the main thread). 
+#endif
 
-//Grid Processor Memory
-struct GPM
+//Number of generation tables. The process thread can compute up to GRID_RING_SIZE - 1 generations ahead of the displayed one.
+#ifndef GRID_RING_SIZE
+#define GRID_RING_SIZE 4
+#endif
+//Address space reserved for every table of the ring and every worker. Only what the population actually uses gets committed. (see commit_arena)
+#define GRID_TABLE_NODE_RESERVE Gigabytes(4)		//node list, ~500M live cells.
+#define GRID_TABLE_INDEX_RESERVE Gigabytes(8)		//control bytes and slots.
+#define GRID_CHANGES_RESERVE Gigabytes(2)			//change list of a single table. Generations with more changes than fit aren't listed.
+#define GRID_WORKER_VISITED_RESERVE Gigabytes(4)
+#define GRID_WORKER_OUTPUT_RESERVE Gigabytes(16)
+#define GRID_TABLE_CHUNK_RESERVE (TABLE_MAX_CHUNKS * sizeof(WorldPos))
+#define GRID_TABLE_CHUNK_MAP_RESERVE (TABLE_MAX_CHUNKS * 2 * sizeof(uint32))
+#define BULK_INSERT_PREFETCH_DISTANCE 16	//nodes ahead whose slots get prefetched in insert_new_nodes.
+
+enum GridJob
+{
+	GRID_JOB_NONE = 0,
+	GRID_JOB_TILE_STEP,		//only for the tiled engine, computes the next state of the tiles before they are exported in EVALUATE.
+	GRID_JOB_SAND_STEP,		//computes the next grains of the sand world before they are exported in EVALUATE.
+	GRID_JOB_EVALUATE,		//the scatter engine's conway cells are split by rows instead of by node list slice, see scatter_conway_cells.
+	GRID_JOB_SCATTER,
+	GRID_JOB_LINK,
+	GRID_JOB_DIFF,			//only when gm->track_grid_changes is set, lists the cells that differ between the active and next table.
+	GRID_JOB_EXIT			//published once by shutdown_grid_processor, after the process thread is done.
+};
+
+struct VisitedSlot
+{
+	WorldPos pos;
+	uint32 stamp;	//slot is only occupied if this matches the set's current stamp. 
+	uint8 live_neighbors;	//count map only.
+	uint8 alive;			//count map only.
+};
+
+//Open addressing (linear probing) set of the dead neighbor cells that have already been tested in this generation. 
+//NOTE: Slots are tagged with a generation stamp, so starting a new generation is just bumping the stamp. Nothing has to be cleared.
+//Only the first (mask + 1) slots are used each generation, sized to the number of cells being processed, so small populations stay in cache. 
+//The scatter engine uses the same slots as a map from cell to the number of live conway cells around it.
+struct VisitedSet
+{
+	VisitedSlot* slots;
+	uint32 capacity;	//power of 2
+	uint32 committed;	//slots backed by memory, the rest of the capacity is only reserved. Fresh pages are zeroed, so their stamps never match.
+	uint32 mask;
+	uint32 count;
+	uint32 stamp;
+	int32 max_probe_depth;
+};
+
+//The cells that changed going into a generation of the ring, for the renderer to repaint.
+struct GenerationChanges
 {
-	MArena gpm_arena;
-	MArena gpm_temp_arena; 
+	MArena arena;
+	MSlice<CellChange> cells;
+	b32 complete;	//FALSE if the changes didn't fit (or weren't listed).
+};
+
+struct GPM;
+struct GridWorker
+{
+	GPM* gpm;
+	uint32 index;
+
+	MArena arena;			//holds the visited set of dead neighbor cells, and the chunk set and list.
+	VisitedSet visited;
+	VisitedSet chunk_set;	//table chunks of the output list, listed once in chunk_list. Slots use pos for the chunk corner.
+	MSlice<WorldPos> chunk_list;
+	b32 chunks_overflow;	//the output is in more chunks than a table can take, chunk_list stops at TABLE_MAX_CHUNKS.
+	MArena out_arena;		//holds the cells produced for the next generation (before being scattered into the next table). 
+	MSlice<LiveCell> out;
+	MSlice<CellChange> changes;	//also in the out arena, once the output list is scattered.
+	b32 changes_overflow;
 
-	//A double buffer that stores the hash table and all the live cells. Refer active_table pointer for the 'active table'. 
-	Hashtable table1;
-	Hashtable table2;
+	uint32 shard_counts[HASHTABLE_SHARDS];	
+	uint32 shard_cursor[HASHTABLE_SHARDS];	//where in the next table's node list each shard of this worker's output gets written. 
 
-	b32 trigger_buffer_swap;
-	int32 live_status;	//This value is a CellGridStatus used by the grid processor and can change state throughout the frame (on seperate thread)
+	int32 max_hash_depth;
+	uint32 type_counts[4];	//of the nodes this worker linked into the next table.
+	uint64 arena_high_water;
+	uint32 active_tiles;	//tiled engine only, tiles computed (not skipped as stable) in the last step.
+	uint32 awake_sand_chunks;
+
+	ThreadHandle thread;
+};
+
+//Grid Processor Memory
+struct GPM
+{
+	//A ring of tables holding consecutive generations. gm->active_table is ring[display], the one being shown (and painted on). 
+	//The process thread keeps computing the generations after ring[newest] while run_ahead is set, until the next one would overwrite ring[display].
+	//The main thread moves display forward on every tick. The tables it leaves behind are reused (and cleared) by the process thread as it goes around the ring.
+	//NOTE: In fast forward the process thread doesn't wait for the display, it steps over it. The ring is then out of order and only ring[newest] is ever shown.
+	Hashtable ring[GRID_RING_SIZE];
+	GenerationChanges ring_changes[GRID_RING_SIZE];	//ring_changes[i] is the difference between ring[i - 1] and ring[i].
+	uint64 ring_generation[GRID_RING_SIZE];			//generation number of every table.
+	int32 display;
+	int32 newest;			//written by the process thread once a generation is complete.
+	int32 run_ahead;		//written by the main thread.
+	int32 process_busy;		//set by the process thread while it might be touching the tables. Its waiters are woken when it's cleared.
+	int32 process_signal;	//bumped by the main thread whenever the process thread might have something new to do (see signal_process_thread).
+	b32 advance_pending;	//a tick was triggered, but the generation wasn't ready yet.
+	int32 pending_steps;	//steps that came due and aren't displayed yet (see add_cellgrid_steps). In LIMITED fast forward, the process thread takes them off as it computes them.
+	int32 held;				//ring index of the table being read off the main thread (see hold_displayed_table), -1 if none. The process thread doesn't write to it.
+	b32 grid_full;			//the generation after ring[newest] didn't fit in a table (see update_cellgrid). Nothing is computed until it's unpaused again.
 	b32* running;
 
 	ThreadHandle process_thread;
+
+	GridEngine engine;
+	TileWorld tile_world;	//only used by the tiled engine.
+	SandWorld sand_world;	//used by every engine.
+	HashLife hashlife;		//only used by the HashLife engine.
+	LifeRule rule;			//rule of the conway cells, only changed while paused.
+	uint32 rule_kernel;		//index into the kernel tables below, picked once per generation.
+
+	//worker pool
+	GridWorker workers[MAX_GRID_WORKERS];
+	uint32 worker_count;		//including the process thread (worker 0).
+	uint32 active_workers;		//workers taking part in the current generation.
+	int32 job;
+	int32 job_id;				//incremented by the process thread to wake the workers up for the next job.
+	int32 jobs_done;
+	Hashtable* job_active_table;
+	Hashtable* job_next_table;
+	uint32 shard_begin[HASHTABLE_SHARDS + 1];	//range of the next table's node list belonging to each shard.
+
+	//stats
+	uint64 generation;	//number of generations processed since init.
+	uint64 table_arena_high_water;
+	uint64 temp_arena_high_water;
 };
-static void process_cell(LiveCellNode* cell, Hashtable* active_table, Hashtable* next_table, MSlice<WorldPos>& new_cells_tested, MArena* temp_arena);
-static void update_cellgrid(AppMemory* gm)
+
+//The hashtable shards are split into contiguous ranges, one per worker. 
+static FORCEDINLINE uint32 first_shard_of_worker(uint32 worker_index, uint32 worker_count)
+{
+	return (worker_index * HASHTABLE_SHARDS) / worker_count;
+}
+
+static void visited_set_commit(VisitedSet* set, uint32 size)
+{
+	if (size > set->committed)
+	{
+		commit_memory(set->slots, (uint64)size * sizeof(VisitedSlot));
+		set->committed = size;
+	}
+}
+
+static void visited_set_begin(VisitedSet* set, uint32 cells_to_process)
+{
+	set->stamp++;
+	if (set->stamp == 0)	//stamp wrapped around, so old stamps could match again. 
+	{
+		pl_buffer_set(set->slots, 0, set->committed * sizeof(VisitedSlot));
+		set->stamp = 1;
+	}
+
+	//Every cell has at most 8 dead neighbors. Sized for a load factor of at most 0.5.
+	uint64 wanted = (uint64)cells_to_process * 16;
+	uint32 size = 64;
+	while (size < wanted && size < set->capacity)
+	{
+		size <<= 1;
+	}
+	visited_set_commit(set, size);
+	set->mask = size - 1;
+	set->count = 0;
+	set->max_probe_depth = 0;
+}
+
+//Returns TRUE if the position wasn't in the set (and adds it).
+static FORCEDINLINE b32 visited_set_add(VisitedSet* set, WorldPos pos)
+{
+	//NOTE: If the set is getting too full (only when the arena can't fit the wanted size), cells just get tested again. 
+	//Duplicate births are resolved when linking the next table, so this only costs time. 
+	if (set->count >= (set->mask - (set->mask >> 2)))
+	{
+		return TRUE;
+	}
+
+	uint32 index = (uint32)hash_pos(pos) & set->mask;
+	int32 depth = 1;
+	while (set->slots[index].stamp == set->stamp)
+	{
+		if (set->slots[index].pos.x == pos.x && set->slots[index].pos.y == pos.y)
+		{
+			return FALSE;
+		}
+		index = (index + 1) & set->mask;
+		depth++;
+	}
+	set->slots[index].pos = pos;
+	set->slots[index].stamp = set->stamp;
+	set->count++;
+	//---d--
+	if (depth > set->max_probe_depth)
+		set->max_probe_depth = depth;
+	//---d--
+	return TRUE;
+}
+
+//Returns FALSE if the map can't fit that many entries at a load factor of 0.5. 
+static b32 count_map_begin(VisitedSet* set, uint64 expected_entries)
+{
+	uint64 wanted = expected_entries * 2;
+	if (wanted > set->capacity)
+	{
+		return FALSE;
+	}
+	set->stamp++;
+	if (set->stamp == 0)
+	{
+		pl_buffer_set(set->slots, 0, set->committed * sizeof(VisitedSlot));
+		set->stamp = 1;
+	}
+	uint32 size = 64;
+	while (size < wanted)
+	{
+		size <<= 1;
+	}
+	visited_set_commit(set, size);
+	set->mask = size - 1;
+	set->count = 0;
+	set->max_probe_depth = 0;
+	return TRUE;
+}
+
+static FORCEDINLINE VisitedSlot* count_map_get(VisitedSet* set, WorldPos pos)
+{
+	uint32 index = (uint32)hash_pos(pos) & set->mask;
+	int32 depth = 1;
+	while (set->slots[index].stamp == set->stamp)
+	{
+		if (set->slots[index].pos.x == pos.x && set->slots[index].pos.y == pos.y)
+		{
+			return &set->slots[index];
+		}
+		index = (index + 1) & set->mask;
+		depth++;
+	}
+	VisitedSlot* slot = &set->slots[index];
+	slot->pos = pos;
+	slot->stamp = set->stamp;
+	slot->live_neighbors = 0;
+	slot->alive = 0;
+	set->count++;
+	//---d--
+	if (depth > set->max_probe_depth)
+		set->max_probe_depth = depth;
+	//---d--
+	return slot;
+}
+
+static void process_cell(LiveCellNode* cell, Hashtable* active_table, GridWorker* worker);
+
+//Every conway step is compiled once per rule in LIFE_RULE_KERNELS, with DynamicLifeRule as the fallback for any other rule.
+template<typename Rule> static void process_node_slice(Hashtable* active_table, GridWorker* worker, uint32 slice_begin, uint32 slice_end, LifeRule life_rule);
+template<typename Rule> static void scatter_conway_cells(Hashtable* active_table, GridWorker* worker, LifeRule life_rule);
+
+typedef void NodeSliceKernel(Hashtable* active_table, GridWorker* worker, uint32 slice_begin, uint32 slice_end, LifeRule life_rule);
+#define NODE_SLICE_KERNEL(RULE) process_node_slice<RULE>,
+static NodeSliceKernel* node_slice_kernels[] = { LIFE_RULE_KERNELS(NODE_SLICE_KERNEL) process_node_slice<DynamicLifeRule> };
+
+typedef void ScatterKernel(Hashtable* active_table, GridWorker* worker, LifeRule life_rule);
+#define SCATTER_KERNEL(RULE) scatter_conway_cells<RULE>,
+static ScatterKernel* scatter_kernels[] = { LIFE_RULE_KERNELS(SCATTER_KERNEL) scatter_conway_cells<DynamicLifeRule> };
+
+static FORCEDINLINE void get_worker_slice(uint32 total, uint32 worker_index, uint32 worker_count, uint32* begin, uint32* end)
+{
+	*begin = (uint32)(((uint64)total * worker_index) / worker_count);
+	*end = (uint32)(((uint64)total * (worker_index + 1)) / worker_count);
+}
+
+//Returns FALSE if the worker's out arena is full.
+static FORCEDINLINE b32 add_change(GridWorker* worker, CellChange change)
+{
+	if (worker->out_arena.top + sizeof(CellChange) > worker->out_arena.capacity)
+	{
+		return FALSE;
+	}
+	commit_arena(&worker->out_arena, sizeof(CellChange));
+	worker->changes.add(&worker->out_arena, change);
+	return TRUE;
+}
+
+//Appends a cell for the next generation to the worker's output list.
+static FORCEDINLINE void add_output(GridWorker* worker, LiveCell cell)
+{
+	commit_arena(&worker->out_arena, sizeof(LiveCell));
+	worker->out.add(&worker->out_arena, cell);
+}
+
+//Which type a cell keeps when the output has it more than once. A fixed order, so it doesn't depend on which worker wrote what where.
+//Sand wins over a conway birth, the grain is still in the sand world and would otherwise be missing from the table.
+static FORCEDINLINE uint32 merge_precedence(CellType type)
+{
+	switch (type)
+	{
+		case CellType::BRICK: return 3;
+		case CellType::SAND: return 2;
+		case CellType::CONWAY: return 1;
+		default: return 0;
+	}
+}
+
+//Counts the output per shard and lists the table chunks it lands in, so the next table's chunk list can be made before it's scattered.
+static void count_output(GridWorker* worker)
 {
+	pl_buffer_set(worker->shard_counts, 0, sizeof(worker->shard_counts));
+	worker->chunk_list.init(&worker->arena, "Grid Worker Chunk List");
+	worker->chunks_overflow = FALSE;
+	uint32 expected_chunks = (worker->out.size < TABLE_MAX_CHUNKS) ? worker->out.size : TABLE_MAX_CHUNKS;
+	count_map_begin(&worker->chunk_set, expected_chunks);
+
+	WorldPos last_corner = { INVALID_CELL, INVALID_CELL };	//never a chunk corner.
+	for (uint32 i = 0; i < worker->out.size; i++)
+	{
+		WorldPos pos = worker->out[i].pos;
+		worker->shard_counts[hash_shard(hash_pos(pos))]++;
+
+		WorldPos corner = chunk_corner(pos);
+		if ((corner.x != last_corner.x || corner.y != last_corner.y) && !worker->chunks_overflow)
+		{
+			last_corner = corner;
+			VisitedSlot* slot = count_map_get(&worker->chunk_set, corner);
+			if (!slot->alive)
+			{
+				if (worker->chunk_list.size == TABLE_MAX_CHUNKS)
+				{
+					worker->chunks_overflow = TRUE;	//the set is only sized for that many.
+					continue;
+				}
+				slot->alive = 1;
+				commit_arena(&worker->arena, sizeof(WorldPos));
+				worker->chunk_list.add(&worker->arena, corner);
+			}
+		}
+	}
+}
+
+static void run_worker_job(GridWorker* worker, GridJob job)
+{
+	GPM* gpm = worker->gpm;
+	Hashtable* active_table = gpm->job_active_table;
+	Hashtable* next_table = gpm->job_next_table;
+
+	switch (job)
+	{
+		case GRID_JOB_TILE_STEP:
+		{
+			uint32 tile_begin, tile_end;
+			get_worker_slice(gpm->tile_world.tiles.size, worker->index, gpm->active_workers, &tile_begin, &tile_end);
+			worker->active_tiles = tile_world_step_range(&gpm->tile_world, tile_begin, tile_end, gpm->rule);
+		}break;
+		case GRID_JOB_SAND_STEP:
+		{
+			uint32 chunk_begin, chunk_end;
+			get_worker_slice(gpm->sand_world.chunks.size, worker->index, gpm->active_workers, &chunk_begin, &chunk_end);
+			worker->awake_sand_chunks = sand_world_step_range(&gpm->sand_world, chunk_begin, chunk_end);
+		}break;
+		case GRID_JOB_EVALUATE:
+		{
+			uint32 slice_begin, slice_end;
+			get_worker_slice(active_table->node_list.size, worker->index, gpm->active_workers, &slice_begin, &slice_end);
+
+			worker->out.init(&worker->out_arena, "grid worker output list");
+			visited_set_begin(&worker->visited, slice_end - slice_begin);
+
+			//sand cells come from the sand world with every engine, process_cell skips them.
+			uint32 chunk_begin, chunk_end;
+			get_worker_slice(gpm->sand_world.chunks.size, worker->index, gpm->active_workers, &chunk_begin, &chunk_end);
+			sand_world_export_range(&gpm->sand_world, chunk_begin, chunk_end, &worker->out, &worker->out_arena);
+
+			if (gpm->engine == GridEngine::TILED || gpm->engine == GridEngine::HASHLIFE)
+			{
+				//conway cells come from the engine's own world, every other cell type is still processed one by one.
+				if (gpm->engine == GridEngine::TILED)
+				{
+					uint32 tile_begin, tile_end;
+					get_worker_slice(gpm->tile_world.tiles.size, worker->index, gpm->active_workers, &tile_begin, &tile_end);
+					tile_world_export_range(&gpm->tile_world, tile_begin, tile_end, &worker->out, &worker->out_arena);
+				}
+				else
+				{
+					uint32 subtree_begin, subtree_end;
+					get_worker_slice(gpm->hashlife.subtree_count, worker->index, gpm->active_workers, &subtree_begin, &subtree_end);
+					hashlife_export_range(&gpm->hashlife, subtree_begin, subtree_end, &worker->out, &worker->out_arena);
+				}
+
+				LiveCellNode* it = active_table->node_list.front + slice_begin;
+				for (uint32 i = slice_begin; i < slice_end; i++)
+				{
+					if (it->type != CellType::CONWAY)
+					{
+						process_cell(it, active_table, worker);
+					}
+					it++;
+				}
+			}
+			else if (gpm->engine == GridEngine::SCATTER)
+			{
+				scatter_kernels[gpm->rule_kernel](active_table, worker, gpm->rule);
+
+				LiveCellNode* it = active_table->node_list.front + slice_begin;
+				for (uint32 i = slice_begin; i < slice_end; i++)
+				{
+					if (it->type != CellType::CONWAY)
+					{
+						process_cell(it, active_table, worker);
+					}
+					it++;
+				}
+			}
+			else
+			{
+				node_slice_kernels[gpm->rule_kernel](active_table, worker, slice_begin, slice_end, gpm->rule);
+			}
+
+			uint64 arena_usage = (worker->visited.mask + 1) * sizeof(VisitedSlot) + worker->out_arena.top;
+			if (arena_usage > worker->arena_high_water)
+			{
+				worker->arena_high_water = arena_usage;
+			}
+
+			count_output(worker);
+		}break;
+		case GRID_JOB_SCATTER:
+		{
+			//NOTE: Every chunk of the output is already in the next table's chunk list, the chunk map is only read here.
+			LiveCellNode* node_list = next_table->node_list.front;
+			WorldPos last_corner = { INVALID_CELL, INVALID_CELL };
+			uint32 last_chunk = TABLE_CHUNK_NONE;
+			for (uint32 i = 0; i < worker->out.size; i++)
+			{
+				LiveCell cell = worker->out[i];
+				uint32 shard = hash_shard(hash_pos(cell.pos));
+				WorldPos corner = chunk_corner(cell.pos);
+				if (corner.x != last_corner.x || corner.y != last_corner.y)
+				{
+					last_chunk = find_table_chunk(next_table, corner);
+					last_corner = corner;
+				}
+				node_list[worker->shard_cursor[shard]++] = pack_node(cell.pos, corner, last_chunk, cell.type);
+			}
+			worker->out.clear(&worker->out_arena);
+		}break;
+		case GRID_JOB_LINK:
+		{
+			//NOTE: Only touches the slots of this worker's shards. The next table was already sized to fit every shard.
+			worker->max_hash_depth = 0;
+			pl_buffer_set(worker->type_counts, 0, sizeof(worker->type_counts));
+			uint32 begin = gpm->shard_begin[first_shard_of_worker(worker->index, gpm->active_workers)];
+			uint32 end = gpm->shard_begin[first_shard_of_worker(worker->index + 1, gpm->active_workers)];
+			LiveCellNode* node = next_table->node_list.front + begin;
+			for (uint32 i = begin; i < end; i++)
+			{
+				WorldPos pos = node_pos(next_table, node);
+				uint64 hash = hash_pos(pos);
+				LiveCellNode* cell_in_table = get_cell(next_table, hash, pos);
+				if (cell_in_table != NULL)
+				{
+					//Same cell produced twice (by two workers, or a sand move and a birth). The duplicate stays in the node list as an EMPTY cell. 
+					if (merge_precedence(node->type) > merge_precedence(cell_in_table->type))
+					{
+						worker->type_counts[(uint32)cell_in_table->type]--;
+						worker->type_counts[(uint32)node->type]++;
+						cell_in_table->type = node->type;
+					}
+					node->type = CellType::EMPTY;
+					worker->type_counts[(uint32)CellType::EMPTY]++;
+				}
+				else
+				{
+					worker->type_counts[(uint32)node->type]++;
+					int32 depth = insert_slot(next_table, hash, i);
+					if (depth > worker->max_hash_depth)
+					{
+						worker->max_hash_depth = depth;
+					}
+				}
+				node++;
+			}
+		}break;
+		case GRID_JOB_DIFF:
+		{
+			worker->changes.init(&worker->out_arena, "grid worker change list");
+			worker->changes_overflow = FALSE;
+
+			//born or changed type.
+			uint32 begin, end;
+			get_worker_slice(next_table->node_list.size, worker->index, gpm->active_workers, &begin, &end);
+			LiveCellNode* node = next_table->node_list.front + begin;
+			for (uint32 i = begin; i < end && !worker->changes_overflow; i++, node++)
+			{
+				if (node->type != CellType::EMPTY)	//duplicates are left in the node list as EMPTY.
+				{
+					WorldPos pos = node_pos(next_table, node);
+					CellType prev_type = lookup_cell(active_table, hash_pos(pos), pos);
+					if (prev_type != node->type)
+					{
+						worker->changes_overflow = !add_change(worker, { pos, node->type, prev_type });
+					}
+				}
+			}
+
+			//died.
+			get_worker_slice(active_table->node_list.size, worker->index, gpm->active_workers, &begin, &end);
+			node = active_table->node_list.front + begin;
+			for (uint32 i = begin; i < end && !worker->changes_overflow; i++, node++)
+			{
+				if (node->type != CellType::EMPTY)
+				{
+					WorldPos pos = node_pos(active_table, node);
+					if (lookup_cell(next_table, hash_pos(pos), pos) == CellType::EMPTY)
+					{
+						worker->changes_overflow = !add_change(worker, { pos, CellType::EMPTY, node->type });
+					}
+				}
+			}
+		}break;
+		default:
+		{
+			ASSERT(FALSE);	//invalid job
+		}break;
+	}
+}
+
+//Runs a job on every active worker (including the calling process thread as worker 0) and waits for all of them to finish. 
+static void run_job(GPM* gpm, GridJob job)
+{
+	if (gpm->active_workers > 1)
+	{
+		gpm->jobs_done = 0;
+		gpm->job = job;
+		interlocked_exchange_i32(&gpm->job_id, gpm->job_id + 1);	//publishes the job to the workers.
+		wake_value_waiters(&gpm->job_id);
+	}
+
+	run_worker_job(&gpm->workers[0], job);
+
+	if (gpm->active_workers > 1)
+	{
+		int32 done;
+		while ((done = gpm->jobs_done) != (int32)gpm->active_workers - 1)
+		{
+			wait_while_equal(&gpm->jobs_done, done);
+		}
+	}
+}
+
+static void grid_worker_thread(void* worker_memory)
+{
+	GridWorker* worker = (GridWorker*)worker_memory;
+	GPM* gpm = worker->gpm;
+	int32 seen_job_id = 0;	//NOTE: Not read from gpm->job_id, since the first job might already be published by the time this thread starts.
+	//NOTE: Doesn't check running. Every published job gets finished, so the process thread never waits on a worker that left. shutdown_grid_processor publishes GRID_JOB_EXIT instead.
+	while (TRUE)
+	{
+		wait_while_equal(&gpm->job_id, seen_job_id);
+		seen_job_id = gpm->job_id;
+		if (gpm->job == GRID_JOB_EXIT)
+		{
+			break;
+		}
+
+		if (worker->index < gpm->active_workers)
+		{
+			run_worker_job(worker, (GridJob)gpm->job);
+			interlocked_increment(&gpm->jobs_done);
+			wake_value_waiters(&gpm->jobs_done);
+		}
+	}
+}
+
+//Gathers the change lists of the workers into the next generation's list.
+static void list_changed_cells(GPM* gpm, GenerationChanges* changes)
+{
+	run_job(gpm, GRID_JOB_DIFF);
+
+	changes->cells.clear(&changes->arena);
+	uint32 total = 0;
+	b32 overflow = FALSE;
+	for (uint32 w = 0; w < gpm->active_workers; w++)
+	{
+		total += gpm->workers[w].changes.size;
+		overflow |= gpm->workers[w].changes_overflow;
+	}
+
+	changes->complete = !overflow && ((uint64)total * sizeof(CellChange) <= changes->arena.capacity);
+	if (changes->complete)
+	{
+		commit_arena(&changes->arena, (uint64)total * sizeof(CellChange));
+		changes->cells.init_and_allocate(&changes->arena, total, "Generation Change List");
+		CellChange* it = changes->cells.front;
+		for (uint32 w = 0; w < gpm->active_workers; w++)
+		{
+			pl_buffer_copy(it, gpm->workers[w].changes.front, gpm->workers[w].changes.size * sizeof(CellChange));
+			it += gpm->workers[w].changes.size;
+		}
+	}
+
+	for (uint32 w = 0; w < gpm->active_workers; w++)
+	{
+		gpm->workers[w].changes.clear(&gpm->workers[w].out_arena);
+	}
+}
+
+//Empties the table, with shard_groups groups per shard and a chunk map sized for expected_chunks.
+//NOTE: Tables are only cleared right before cells are written into them (the next generation, or a loaded snapshot), not when the display moves past them.
+//That keeps the O(table size) reset of the control bytes on the process thread, where it overlaps with the frames, and a resize resets them only once.
+static void clear_table(Hashtable* table, uint32 shard_groups, uint32 expected_chunks)
+{
+	table->node_list.clear(&table->arena);
+	table->node_list.front = (LiveCellNode*)MARENA_TOP(&table->arena);
+	pl_buffer_set(table->type_counts, 0, sizeof(table->type_counts));
+	reset_table_chunks(table, expected_chunks);
+
+	if (shard_groups != table->shard_groups)
+	{
+		reset_hashtable(table, shard_groups);
+	}
+	else
+	{
+		//setting all the control bytes to empty
+		pl_buffer_set(table->ctrl.front, CTRL_EMPTY, table->ctrl.size);
+		pl_buffer_set(table->shard_used, 0, sizeof(table->shard_used));
+	}
+}
+
+//Computes the generation after active_table into next_table (clearing whatever it held). Lists the cells that changed into changes, unless it's NULL.
+//FALSE if the generation has cells in more chunks than a table can take. next_table is left empty and the engines restart from active_table on the next try.
+static b32 update_cellgrid(AppMemory* gm, Hashtable* active_table, Hashtable* next_table, GenerationChanges* changes)
+{
+	GPM* gpm = (GPM*)gm->grid_processor_memory;
+
+	gpm->job_active_table = active_table;
+	gpm->job_next_table = next_table;
+	gpm->active_workers = (active_table->node_list.size < GRID_PARALLEL_MIN_CELLS) ? 1 : gpm->worker_count;
+	gpm->rule_kernel = life_rule_kernel(gpm->rule);
+
+	//the table was painted on (or loaded), so the worlds of the engines don't match it anymore.
+	b32 reload = gm->cells_edited;
+	gm->cells_edited = FALSE;
+
+	if (reload)
+	{
+		load_sand_world(&gpm->sand_world, active_table);
+	}
+	if (gpm->sand_world.chunks.size != 0)
+	{
+		sand_world_prepare_step(&gpm->sand_world, active_table);
+		run_job(gpm, GRID_JOB_SAND_STEP);
+		gpm->sand_world.awake_chunks = 0;
+		for (uint32 w = 0; w < gpm->active_workers; w++)
+		{
+			gpm->sand_world.awake_chunks += gpm->workers[w].awake_sand_chunks;
+		}
+		sand_world_finish_step(&gpm->sand_world);
+	}
+
+	if (gpm->engine == GridEngine::TILED)
+	{
+		if (reload)
+		{
+			load_tile_world(&gpm->tile_world, active_table);
+		}
+		tile_world_prepare_step(&gpm->tile_world);
+		run_job(gpm, GRID_JOB_TILE_STEP);
+		gpm->tile_world.active_tiles = 0;
+		for (uint32 w = 0; w < gpm->active_workers; w++)
+		{
+			gpm->tile_world.active_tiles += gpm->workers[w].active_tiles;
+		}
+		tile_world_finish_step(&gpm->tile_world);
+	}
+
+	uint64 generations = 1;
+	if (gpm->engine == GridEngine::HASHLIFE)
+	{
+		if (reload)
+		{
+			load_hashlife(&gpm->hashlife, active_table);
+		}
+		set_hashlife_step_size(&gpm->hashlife, gm->step_log2);
+		set_hashlife_rule(&gpm->hashlife, gpm->rule);
+		generations = hashlife_step(&gpm->hashlife);	//single threaded, the node cache is shared by the whole tree.
+
+		if (hashlife_population(&gpm->hashlife) >= GRID_PARALLEL_MIN_CELLS)
+		{
+			gpm->active_workers = gpm->worker_count;
+		}
+		hashlife_prepare_export(&gpm->hashlife, gpm->active_workers * 4);
+	}
+
+	run_job(gpm, GRID_JOB_EVALUATE);
+
+	//Laying out the next node list shard by shard. Within a shard, every worker gets its own range. 
+	uint32 total = 0;
+	uint32 max_shard_count = 0;
+	for (uint32 shard = 0; shard < HASHTABLE_SHARDS; shard++)
+	{
+		gpm->shard_begin[shard] = total;
+		for (uint32 w = 0; w < gpm->active_workers; w++)
+		{
+			gpm->workers[w].shard_cursor[shard] = total;
+			total += gpm->workers[w].shard_counts[shard];
+		}
+		uint32 shard_count = total - gpm->shard_begin[shard];
+		if (shard_count > max_shard_count)
+		{
+			max_shard_count = shard_count;
+		}
+	}
+	gpm->shard_begin[HASHTABLE_SHARDS] = total;
+
+	//the next table only gets the chunks its cells are in.
+	uint32 expected_chunks = 0;
+	for (uint32 w = 0; w < gpm->active_workers; w++)
+	{
+		expected_chunks += gpm->workers[w].chunk_list.size;
+	}
+
+	//Sizing the next table so the fullest shard stays under the max load factor (7/8). This also shrinks it back down when the population drops.
+	//NOTE: The next table still holds whatever generation it had the last time around the ring.
+	clear_table(next_table, hashtable_groups_for(max_shard_count), expected_chunks);
+	b32 chunks_fit = TRUE;
+	for (uint32 w = 0; w < gpm->active_workers; w++)
+	{
+		GridWorker* worker = &gpm->workers[w];
+		chunks_fit &= !worker->chunks_overflow;
+		for (uint32 i = 0; i < worker->chunk_list.size && chunks_fit; i++)
+		{
+			chunks_fit &= (add_table_chunk(next_table, worker->chunk_list[i]) != TABLE_CHUNK_NONE);
+		}
+		worker->chunk_list.clear(&worker->arena);
+	}
+	if (!chunks_fit)
+	{
+		//NOTE: The tile world, sand world and hashlife tree already took the step. Marking the cells as edited has them reload from active_table instead.
+		for (uint32 w = 0; w < gpm->active_workers; w++)
+		{
+			gpm->workers[w].out.clear(&gpm->workers[w].out_arena);
+		}
+		reset_table_chunks(next_table, 0);
+		gm->cells_edited = TRUE;
+		return FALSE;
+	}
+
+	ASSERT(next_table->node_list.size == 0);
+	commit_arena(&next_table->arena, (uint64)total * sizeof(LiveCellNode));
+	next_table->node_list.front = (LiveCellNode*)MARENA_PUSH(&next_table->arena, total * sizeof(LiveCellNode), "HashTable -> live node list");
+	next_table->node_list.size = total;
+
+	run_job(gpm, GRID_JOB_SCATTER);
+	run_job(gpm, GRID_JOB_LINK);
+	for (uint32 w = 0; w < gpm->active_workers; w++)
+	{
+		for (uint32 type = 0; type < ArrayCount(next_table->type_counts); type++)
+		{
+			next_table->type_counts[type] += gpm->workers[w].type_counts[type];
+		}
+	}
+
+	if (changes)
+	{
+		list_changed_cells(gpm, changes);
+	}
+
 	//---d--
 	max_hash_depth = 0;
+	max_visited_probe_depth = 0;
+	for (uint32 w = 0; w < gpm->active_workers; w++)
+	{
+		if (gpm->workers[w].max_hash_depth > max_hash_depth)
+		{
+			max_hash_depth = gpm->workers[w].max_hash_depth;
+		}
+		if (gpm->workers[w].visited.max_probe_depth > max_visited_probe_depth)
+		{
+			max_visited_probe_depth = gpm->workers[w].visited.max_probe_depth;
+		}
+	}
 	//---d--
 
+	//keeping track of the high water marks.
+	uint64 table_usage = next_table->arena.top + next_table->table_arena.top;
+	if (table_usage > gpm->table_arena_high_water)
+	{
+		gpm->table_arena_high_water = table_usage;
+	}
+	uint64 temp_usage = 0;
+	for (uint32 w = 0; w < gpm->worker_count; w++)
+	{
+		temp_usage += gpm->workers[w].arena_high_water;
+	}
+	if (temp_usage > gpm->temp_arena_high_water)
+	{
+		gpm->temp_arena_high_water = temp_usage;
+	}
+	gpm->generation += generations;
+	return TRUE;
+}
+void reset_hashtable(Hashtable* ht, uint32 shard_groups)
+{
+	//throwing away the old control bytes and slots. They are the only thing in the table arena.
+	if (ht->ctrl.size != 0)
+	{
+		ht->slots.clear(&ht->table_arena);
+		ht->ctrl.clear(&ht->table_arena);
+	}
+
+	uint32 slot_count = HASHTABLE_SHARDS * shard_groups * HASHTABLE_GROUP_SIZE;
+	if ((uint64)slot_count * (sizeof(uint8) + sizeof(uint32)) > ht->table_arena.capacity)
+	{
+		ERRORBOX("Hashtable index arena is too small to grow the table any further!");
+	}
+	commit_arena(&ht->table_arena, (uint64)slot_count * (sizeof(uint8) + sizeof(uint32)));
+	ht->ctrl.init_and_allocate(&ht->table_arena, slot_count, "HashTable -> control bytes");
+	ht->slots.init_and_allocate(&ht->table_arena, slot_count, "HashTable -> slots");
+	pl_buffer_set(ht->ctrl.front, CTRL_EMPTY, slot_count);
+	pl_buffer_set(ht->shard_used, 0, sizeof(ht->shard_used));
+	ht->shard_groups = shard_groups;
+}
+
+void rehash_hashtable(Hashtable* ht, uint32 shard_groups)
+{
+	reset_hashtable(ht, shard_groups);
+	LiveCellNode* node = ht->node_list.front;
+	for (uint32 i = 0; i < ht->node_list.size; i++)
+	{
+		if (node->type != CellType::EMPTY)	//purged cells and duplicates are left in the node list as EMPTY.
+		{
+			insert_slot(ht, hash_pos(node_pos(ht, node)), i);
+		}
+		node++;
+	}
+}
+
+void insert_new_nodes(Hashtable* ht, uint32 first_new_node, b32 check_duplicates)
+{
+	LiveCellNode* new_nodes = ht->node_list.front + first_new_node;
+	uint32 new_count = ht->node_list.size - first_new_node;
+
+	//Counting what every shard ends up with first, so the table is sized once. (tombstones are counted too, so it's an upper bound)
+	uint32 shard_counts[HASHTABLE_SHARDS] = {};
+	for (uint32 i = 0; i < new_count; i++)
+	{
+		shard_counts[hash_shard(hash_pos(node_pos(ht, new_nodes + i)))]++;
+	}
+	uint32 max_shard_count = 0;
+	for (uint32 shard = 0; shard < HASHTABLE_SHARDS; shard++)
+	{
+		if (ht->shard_used[shard] + shard_counts[shard] > max_shard_count)
+		{
+			max_shard_count = ht->shard_used[shard] + shard_counts[shard];
+		}
+	}
+
+	uint32 shard_groups = hashtable_groups_for(max_shard_count);
+	if (shard_groups > ht->shard_groups)
+	{
+		reset_hashtable(ht, shard_groups);
+		LiveCellNode* node = ht->node_list.front;
+		for (uint32 i = 0; i < first_new_node; i++)
+		{
+			if (node->type != CellType::EMPTY)
+			{
+				insert_slot(ht, hash_pos(node_pos(ht, node)), i);
+			}
+			node++;
+		}
+	}
+
+	for (uint32 i = 0; i < new_count; i++)
+	{
+		ht->type_counts[(uint32)new_nodes[i].type]++;
+	}
+
+	LiveCellNode* node = new_nodes;
+	for (uint32 i = first_new_node; i < ht->node_list.size; i++)
+	{
+		//the slots are all over the table, so the first group a node probes is fetched a few nodes ahead.
+		if (i + BULK_INSERT_PREFETCH_DISTANCE < ht->node_list.size)
+		{
+			uint64 ahead = hash_pos(node_pos(ht, node + BULK_INSERT_PREFETCH_DISTANCE));
+			uint32 base = (hash_shard(ahead) * ht->shard_groups + ((uint32)(ahead >> 7) & (ht->shard_groups - 1))) * HASHTABLE_GROUP_SIZE;
+			_mm_prefetch((const char*)(ht->ctrl.front + base), _MM_HINT_T0);
+			_mm_prefetch((const char*)(ht->slots.front + base), _MM_HINT_T0);
+		}
+		if (node->type != CellType::EMPTY)
+		{
+			WorldPos pos = node_pos(ht, node);
+			uint64 hash = hash_pos(pos);
+			uint32 slot = check_duplicates ? find_slot(ht, hash, pos) : UINT32MAX;
+			if (slot != UINT32MAX)
+			{
+				set_node_type(ht, ht->node_list.front + ht->slots[slot], node->type);
+				set_node_type(ht, node, CellType::EMPTY);
+			}
+			else
+			{
+				insert_slot(ht, hash, i);
+			}
+		}
+		node++;
+	}
+}
+
+static void rebuild_chunk_map(Hashtable* ht, uint32 map_size)
+{
+	if (ht->chunk_map.size != 0)
+	{
+		ht->chunk_map.clear(&ht->chunk_map_arena);
+	}
+	commit_arena(&ht->chunk_map_arena, (uint64)map_size * sizeof(uint32));
+	ht->chunk_map.init_and_allocate(&ht->chunk_map_arena, map_size, "HashTable -> chunk map");
+	pl_buffer_set(ht->chunk_map.front, 0xFF, map_size * sizeof(uint32));	//TABLE_CHUNK_NONE
+	uint32 mask = map_size - 1;
+	for (uint32 i = 0; i < ht->chunks.size; i++)
+	{
+		uint32 index = chunk_map_index(ht->chunks[i]) & mask;
+		while (ht->chunk_map[index] != TABLE_CHUNK_NONE)
+		{
+			index = (index + 1) & mask;
+		}
+		ht->chunk_map[index] = i;
+	}
+}
+
+uint32 add_table_chunk(Hashtable* ht, WorldPos corner)
+{
+	uint32 chunk = find_table_chunk(ht, corner);
+	if (chunk != TABLE_CHUNK_NONE)
+	{
+		return chunk;
+	}
+	if (ht->chunks.size >= TABLE_MAX_CHUNKS)
+	{
+		return TABLE_CHUNK_NONE;
+	}
+
+	commit_arena(&ht->chunk_arena, sizeof(WorldPos));
+	ht->chunks.add(&ht->chunk_arena, corner);
+	if (ht->chunks.size * 2 > ht->chunk_map.size)	//keeping the load factor under 0.5
+	{
+		rebuild_chunk_map(ht, ht->chunk_map.size * 2);
+	}
+	else
+	{
+		uint32 mask = ht->chunk_map.size - 1;
+		uint32 index = chunk_map_index(corner) & mask;
+		while (ht->chunk_map[index] != TABLE_CHUNK_NONE)
+		{
+			index = (index + 1) & mask;
+		}
+		ht->chunk_map[index] = ht->chunks.size - 1;
+	}
+	return ht->chunks.size - 1;
+}
+
+void reset_table_chunks(Hashtable* ht, uint32 expected_chunks)
+{
+	ht->chunks.clear(&ht->chunk_arena);
+	uint32 map_size = 16;
+	while (map_size < expected_chunks * 2 && map_size < TABLE_MAX_CHUNKS * 2)
+	{
+		map_size <<= 1;
+	}
+	rebuild_chunk_map(ht, map_size);
+}
+
+static void create_hashtable(Hashtable* ht)
+{
+	reserve_arena(&ht->arena, GRID_TABLE_NODE_RESERVE);
+	add_monitoring(&ht->arena);
+
+	reserve_arena(&ht->table_arena, GRID_TABLE_INDEX_RESERVE);
+	add_monitoring(&ht->table_arena);
+
+	reserve_arena(&ht->chunk_arena, GRID_TABLE_CHUNK_RESERVE);
+	add_monitoring(&ht->chunk_arena);
+
+	reserve_arena(&ht->chunk_map_arena, GRID_TABLE_CHUNK_MAP_RESERVE);
+	add_monitoring(&ht->chunk_map_arena);
+
+	ht->ctrl.size = 0;
+	reset_hashtable(ht, HASHTABLE_MIN_SHARD_GROUPS);
+	ht->node_list.init(&ht->arena, "HashTable -> live node list");
+	pl_buffer_set(ht->type_counts, 0, sizeof(ht->type_counts));
+	ht->chunks.init(&ht->chunk_arena, "HashTable -> chunks");
+	ht->chunk_map.size = 0;
+	reset_table_chunks(ht, 0);
+}
+
+static void destroy_hashtable(Hashtable* ht)
+{
+	ht->chunk_map.clear(&ht->chunk_map_arena);
+	ht->chunks.clear(&ht->chunk_arena);
+	ht->node_list.clear(&ht->arena);
+	ht->slots.clear(&ht->table_arena);
+	ht->ctrl.clear(&ht->table_arena);
+
+	remove_monitoring(&ht->chunk_map_arena);
+	release_arena(&ht->chunk_map_arena);
+	remove_monitoring(&ht->chunk_arena);
+	release_arena(&ht->chunk_arena);
+	remove_monitoring(&ht->table_arena);
+	release_arena(&ht->table_arena);
+	remove_monitoring(&ht->arena);
+	release_arena(&ht->arena);
+}
+
+static void thread_process_cell(void* app_memory);
+
+//Wakes the process thread up if it's waiting, so it checks for work again.
+static void signal_process_thread(GPM* gpm)
+{
+	interlocked_increment(&gpm->process_signal);
+	wake_value_waiters(&gpm->process_signal);
+}
+
+void init_grid_processor(PL* pl, AppMemory* gm)
+{
+
+	gm->grid_processor_memory = MARENA_PUSH(&pl->memory.main_arena, sizeof(GPM), "Grid Processor Memory Struct");
+
+	GPM *gpm = (GPM*)gm->grid_processor_memory;
+
+	//NOTE: Tables, change lists, worker lists and engine worlds all live in their own virtual memory arenas, not in the main arena. They only commit what they use, so the population isn't capped by a size picked at compile time.
+	gpm->engine = gm->grid_engine;
+	gpm->rule = { CONWAY_BIRTH_MASK, CONWAY_SURVIVE_MASK };
+	gm->cells_edited = TRUE;
+
+	//hashtable stuff
+	//NOTE: THESE HAVE TO BE THE SAME SIZE!
+	ASSERT(GRID_RING_SIZE >= 2);
+	for (uint32 i = 0; i < GRID_RING_SIZE; i++)
+	{
+		create_hashtable(&gpm->ring[i]);
+
+		GenerationChanges* changes = &gpm->ring_changes[i];
+		reserve_arena(&changes->arena, GRID_CHANGES_RESERVE);
+		add_monitoring(&changes->arena);
+		changes->cells.init(&changes->arena, "Generation Change List");
+		changes->complete = FALSE;
+	}
+	gpm->display = 0;
+	gpm->newest = 0;
+	gpm->run_ahead = FALSE;	//the input handler starts out paused.
+	gpm->process_busy = FALSE;
+	gpm->process_signal = 0;
+	gpm->advance_pending = FALSE;
+	gpm->pending_steps = 0;
+	gpm->held = -1;
+
+	gm->active_table = &gpm->ring[0];
+	gm->grid_changed = TRUE;
+
+	init_sand_world(&gpm->sand_world);
+	if (gpm->engine == GridEngine::TILED)
+	{
+		init_tile_world(&gpm->tile_world);
+	}
+	else if (gpm->engine == GridEngine::HASHLIFE)
+	{
+		init_hashlife(&gpm->hashlife);
+	}
+
+	gpm->generation = 0;
+	pl_buffer_set(gpm->ring_generation, 0, sizeof(gpm->ring_generation));
+	gpm->table_arena_high_water = gpm->ring[0].arena.top + gpm->ring[0].table_arena.top;
+	gpm->temp_arena_high_water = 0;
+	//---------------
+	gpm->running = &pl->running;
+
+	//worker pool stuff
+	//NOTE: One core is left for the main (render) thread. 
+	uint32 core_count = std::thread::hardware_concurrency();
+	gpm->worker_count = (core_count > 1) ? core_count - 1 : 1;
+	if (GRID_WORKER_COUNT != 0)
+	{
+		gpm->worker_count = GRID_WORKER_COUNT;
+	}
+	gpm->worker_count = clamp(gpm->worker_count, (uint32)1, (uint32)MAX_GRID_WORKERS);
+	gpm->active_workers = 1;
+	gpm->job = GRID_JOB_NONE;
+	gpm->job_id = 0;
+	gpm->jobs_done = 0;
+
+	//Each worker gets an arena for the tested cells list and one for its output list.
+	for (uint32 i = 0; i < gpm->worker_count; i++)
+	{
+		GridWorker* worker = &gpm->workers[i];
+		worker->gpm = gpm;
+		worker->index = i;
+		worker->max_hash_depth = 0;
+		worker->arena_high_water = 0;
+
+		reserve_arena(&worker->arena, GRID_WORKER_VISITED_RESERVE);
+		add_monitoring(&worker->arena);
+
+		//the visited set takes up the largest power of 2 number of slots that fit in the worker arena (leaving room for the chunk set and list). Slots get committed as the set grows.
+		worker->visited.capacity = 64;
+		while ((uint64)worker->visited.capacity * 2 * sizeof(VisitedSlot) <= worker->arena.capacity)
+		{
+			worker->visited.capacity <<= 1;
+		}
+		worker->visited.slots = (VisitedSlot*)MARENA_PUSH(&worker->arena, worker->visited.capacity * sizeof(VisitedSlot), "Grid Worker Visited Set");
+		worker->visited.committed = 0;
+		worker->visited.stamp = 0;
+		worker->visited.mask = 63;
+		worker->visited.count = 0;
+		worker->visited.max_probe_depth = 0;
+
+		//enough slots to list every chunk a table can have at a load factor of 0.5.
+		worker->chunk_set.capacity = TABLE_MAX_CHUNKS * 2;
+		worker->chunk_set.slots = (VisitedSlot*)MARENA_PUSH(&worker->arena, worker->chunk_set.capacity * sizeof(VisitedSlot), "Grid Worker Chunk Set");
+		worker->chunk_set.committed = 0;
+		worker->chunk_set.stamp = 0;
+		worker->chunk_set.mask = 63;
+		worker->chunk_set.count = 0;
+		worker->chunk_set.max_probe_depth = 0;
+		worker->chunk_list.size = 0;
+
+		reserve_arena(&worker->out_arena, GRID_WORKER_OUTPUT_RESERVE);
+		add_monitoring(&worker->out_arena);
+
+		if (i != 0)	//worker 0 is the process thread itself. 
+		{
+			worker->thread = pl_create_thread(grid_worker_thread, (void*)worker);
+		}
+	}
+
+	gpm->process_thread = pl_create_thread(thread_process_cell, (void*)gm);
+
+}
+
+void shutdown_grid_processor(PL* pl, AppMemory* gm)
+{
+	GPM* gpm = (GPM*)gm->grid_processor_memory;
+	
+	signal_process_thread(gpm);	//running is already cleared, this gets it out of its wait.
+	b32 thread_is_not_done = pl_wait_for_thread(gpm->process_thread, 30000);	//waits for the process thread to finish...waits for 30 seconds. 
+	if (thread_is_not_done)
+	{
+		ERRORBOX("Grid Processing Thread is running for too long after shutdown initiated! Force kill the app...");
+	}
+
+	pl_close_thread(&gpm->process_thread);
+
+	//no more jobs can come from the process thread, so the workers can be told to leave.
+	gpm->job = GRID_JOB_EXIT;
+	interlocked_exchange_i32(&gpm->job_id, gpm->job_id + 1);
+	wake_value_waiters(&gpm->job_id);
+
+	for (int32 i = (int32)gpm->worker_count - 1; i >= 0; i--)
+	{
+		GridWorker* worker = &gpm->workers[i];
+		if (i != 0)
+		{
+			thread_is_not_done = pl_wait_for_thread(worker->thread, 30000);
+			if (thread_is_not_done)
+			{
+				ERRORBOX("Grid Worker Thread is running for too long after shutdown initiated! Force kill the app...");
+			}
+			pl_close_thread(&worker->thread);
+		}
+
+		remove_monitoring(&worker->out_arena);
+		release_arena(&worker->out_arena);
+		MARENA_POP(&worker->arena, worker->chunk_set.capacity * sizeof(VisitedSlot), "Grid Worker Chunk Set");
+		MARENA_POP(&worker->arena, worker->visited.capacity * sizeof(VisitedSlot), "Grid Worker Visited Set");
+		remove_monitoring(&worker->arena);
+		release_arena(&worker->arena);
+	}
+
+	if (gpm->engine == GridEngine::TILED)
+	{
+		shutdown_tile_world(&gpm->tile_world);
+	}
+	else if (gpm->engine == GridEngine::HASHLIFE)
+	{
+		shutdown_hashlife(&gpm->hashlife);
+	}
+	shutdown_sand_world(&gpm->sand_world);
+
+	for (int32 i = GRID_RING_SIZE - 1; i >= 0; i--)
+	{
+		GenerationChanges* changes = &gpm->ring_changes[i];
+		changes->cells.clear(&changes->arena);
+		remove_monitoring(&changes->arena);
+		release_arena(&changes->arena);
+
+		destroy_hashtable(&gpm->ring[i]);
+	}
+
+	MARENA_POP(&pl->memory.main_arena, sizeof(GPM), "Grid Processor Memory Struct");
+}
+
+ATP_REGISTER(process_cell_grid);
+static void thread_process_cell(void* app_memory)
+{
+	AppMemory* gm = (AppMemory*)app_memory;
+	GPM *gpm = (GPM*)gm->grid_processor_memory;
+	while (*gpm->running)
+	{
+		//NOTE: Read before checking for work, so a signal sent while checking makes the wait below return right away.
+		int32 signal = gpm->process_signal;
+
+		//NOTE: Busy is set before checking run_ahead, so once the main thread clears run_ahead and sees busy cleared, nothing is touching the tables.
+		interlocked_exchange_i32(&gpm->process_busy, TRUE);
+		int32 display = gpm->display;
+		int32 held = gpm->held;
+		int32 next = (gpm->newest + 1) % GRID_RING_SIZE;
+		while ((next == display || next == held) && gm->fast_forward != FastForward::OFF)
+		{
+			next = (next + 1) % GRID_RING_SIZE;	//steps over the displayed and held tables, only the newest one is going to be shown.
+		}
+		b32 limited = (gm->fast_forward == FastForward::LIMITED);
+		if (gpm->run_ahead && !gpm->grid_full && next != display && next != held && next != gpm->newest && (!limited || gpm->pending_steps > 0))
+		{
+			ATP_BLOCK(process_cell_grid);
+			//the renderer only uses the changes of single steps, which fast forward never takes.
+			b32 track_changes = gm->track_grid_changes && gm->fast_forward == FastForward::OFF;
+			gpm->ring_changes[next].complete = FALSE;
+			if (update_cellgrid(gm, &gpm->ring[gpm->newest], &gpm->ring[next], track_changes ? &gpm->ring_changes[next] : NULL))
+			{
+				gpm->ring_generation[next] = gpm->generation;
+				interlocked_exchange_i32(&gpm->newest, next);	//publishes the generation.
+				if (limited)
+				{
+					interlocked_add(&gpm->pending_steps, -1);
+				}
+			}
+			else
+			{
+				gpm->grid_full = TRUE;
+			}
+			interlocked_exchange_i32(&gpm->process_busy, FALSE);
+			wake_value_waiters(&gpm->process_busy);
+		}
+		else
+		{
+			interlocked_exchange_i32(&gpm->process_busy, FALSE);
+			wake_value_waiters(&gpm->process_busy);
+			wait_on_value(&gpm->process_signal, signal);	//paused, the ring is full until the display moves on (or the held table is released), or no steps are due.
+		}
+	}
+}
+
+//Moves the displayed generation forward by the pending steps (as far as they're computed ahead, at least one), or to the newest one in fast forward.
+static void advance_display(AppMemory* gm)
+{
+	GPM* gpm = (GPM*)gm->grid_processor_memory;
+	ASSERT(gpm->newest != gpm->display);
+	int32 target;
+	b32 single_step;
+	//NOTE: The tables left behind aren't cleared here. The process thread clears them when it gets back around the ring to them (see clear_table).
+	if (gm->fast_forward != FastForward::OFF)
+	{
+		//NOTE: The process thread reuses every table but the displayed and newest ones. If it published more generations between reading newest and moving the display, 
+		//target could already be getting overwritten, so it's read again until it's still the newest one once displayed.
+		do
+		{
+			target = gpm->newest;
+			interlocked_exchange_i32(&gpm->display, target);
+		} while (gpm->newest != target);
+		single_step = FALSE;
+		if (gm->fast_forward == FastForward::UNLIMITED)
+		{
+			interlocked_exchange_i32(&gpm->pending_steps, 0);
+		}
+	}
+	else
+	{
+		int32 computed = (gpm->newest - gpm->display + GRID_RING_SIZE) % GRID_RING_SIZE;
+		int32 steps = (gpm->pending_steps > 1) ? gpm->pending_steps : 1;
+		if (steps > computed)
+		{
+			steps = computed;
+		}
+		interlocked_exchange_i32(&gpm->pending_steps, (gpm->pending_steps > steps) ? gpm->pending_steps - steps : 0);	//the rest carries over to the next tick.
+		target = (gpm->display + steps) % GRID_RING_SIZE;
+		single_step = (steps == 1);
+		interlocked_exchange_i32(&gpm->display, target);
+	}
+	signal_process_thread(gpm);	//frees up room in the ring.
+	gm->active_table = &gpm->ring[target];
+	gm->grid_changed = TRUE;
+	gm->grid_changes = (gm->track_grid_changes && single_step && gpm->ring_changes[target].complete) ? &gpm->ring_changes[target].cells : NULL;
+}
+
+//returns the state of the thread processing the cellgrid. Also moves to the next generation if one was triggered and it's ready.
+CellGridStatus query_cellgrid_update_state(AppMemory* gm)
+{
+	GPM* gpm = (GPM*)gm->grid_processor_memory;
+	if (gpm->advance_pending)
+	{
+		if (gpm->newest == gpm->display && gpm->grid_full)
+		{
+			gpm->advance_pending = FALSE;	//there's no next generation to wait for.
+		}
+		else if (gpm->newest == gpm->display)
+		{
+			return CellGridStatus::PROCESSING;	//the process thread hasn't caught up yet.
+		}
+		else
+		{
+			advance_display(gm);
+			gpm->advance_pending = FALSE;
+		}
+	}
+	return CellGridStatus::FINISHED_PROCESSING;
+}
 
+void set_cellgrid_paused(AppMemory* gm, b32 paused)
+{
 	GPM* gpm = (GPM*)gm->grid_processor_memory;
+	if (paused)
+	{
+		//waiting for the process thread to let go of the tables, so they can be painted on.
+		interlocked_exchange_i32(&gpm->run_ahead, FALSE);
+		while (gpm->process_busy)
+		{
+			wait_on_value(&gpm->process_busy, TRUE);
+		}
+		int32 held;
+		while ((held = gpm->held) != -1)	//nor is anything else reading them.
+		{
+			wait_on_value(&gpm->held, held);
+		}
+		interlocked_exchange_i32(&gpm->pending_steps, 0);	//the time spent paused isn't caught up on.
+		return;
+	}
 
-	Hashtable* next_table;
-	if (gm->active_table == &gpm->table1)
+	if (gm->cells_edited)	//the generations computed ahead came from the old cells.
 	{
-		next_table = &gpm->table2;
+		gpm->newest = gpm->display;
+		gpm->generation = gpm->ring_generation[gpm->display];
 	}
-	else
+	gpm->grid_full = FALSE;	//trying again, the cells might have been erased.
+	interlocked_exchange_i32(&gpm->run_ahead, TRUE);
+	signal_process_thread(gpm);
+}
+
+void set_cellgrid_fast_forward(AppMemory* gm, FastForward fast_forward)
+{
+	GPM* gpm = (GPM*)gm->grid_processor_memory;
+	if (gm->fast_forward == fast_forward)
 	{
-		next_table = &gpm->table1;
+		return;
 	}
 
-	MSlice<WorldPos> new_cells_tested;	//used to keep track of all the neighbors of lives cells that have been already processed
-	new_cells_tested.init(&gpm->gpm_temp_arena, "new cells process queue");
+	//NOTE: The process thread is stopped while switching, since it picks the table it writes to differently in fast forward.
+	int32 run_ahead = gpm->run_ahead;
+	interlocked_exchange_i32(&gpm->run_ahead, FALSE);
+	while (gpm->process_busy)
+	{
+		wait_on_value(&gpm->process_busy, TRUE);
+	}
 
-	//Just iterating through node stack instead of table.
-	LiveCellNode* it = gm->active_table->node_list.front;
-	for (uint32 i = 0; i < gm->active_table->node_list.size; i++)
+	//Fast forward leaves the ring out of order. Showing the newest generation right away puts the display back in front of the others.
+	if (fast_forward == FastForward::OFF && gpm->newest != gpm->display)
 	{
-		process_cell(it, gm->active_table, next_table, new_cells_tested, &gpm->gpm_temp_arena);
-		it++;
+		interlocked_exchange_i32(&gpm->display, gpm->newest);
+		gm->active_table = &gpm->ring[gpm->display];
+		gm->grid_changed = TRUE;
+		gm->grid_changes = NULL;
 	}
+	gm->fast_forward = fast_forward;
 
-	//resetting top of the arena to just having the hashtable. 
-	new_cells_tested.clear(&gpm->gpm_temp_arena);
-	
+	interlocked_exchange_i32(&gpm->run_ahead, run_ahead);
+	signal_process_thread(gpm);
 }
-static void thread_process_cell(void* app_memory);
-void init_grid_processor(PL* pl, AppMemory* gm)
+
+int32 add_cellgrid_steps(AppMemory* gm, int32 steps, int32 max_pending)
 {
+	GPM* gpm = (GPM*)gm->grid_processor_memory;
+	//NOTE: The process thread takes steps off concurrently in LIMITED fast forward, so the cap is applied in the exchange.
+	int32 prev;
+	int32 pending;
+	do
+	{
+		prev = gpm->pending_steps;
+		pending = (prev + steps < max_pending) ? prev + steps : max_pending;
+		pending = (pending > prev) ? pending : prev;
+	} while (interlocked_compare_exchange_i32(&gpm->pending_steps, pending, prev) != prev);
 
-	gm->grid_processor_memory = MARENA_PUSH(&pl->memory.main_arena, sizeof(GPM), "Grid Processor Memory Struct");
+	if (steps > 0 && gm->fast_forward == FastForward::LIMITED)
+	{
+		signal_process_thread(gpm);
+	}
+	return pending;
+}
 
-	GPM *gpm = (GPM*)gm->grid_processor_memory;
+Hashtable* hold_displayed_table(AppMemory* gm)
+{
+	GPM* gpm = (GPM*)gm->grid_processor_memory;
+	ASSERT(gpm->held == -1);	//only one table is held at a time.
+	if (!gpm->run_ahead)
+	{
+		return NULL;
+	}
+	//NOTE: The display only moves on the main thread, and the process thread never writes to the displayed table, so it's safe from the moment it's held.
+	interlocked_exchange_i32(&gpm->held, gpm->display);
+	return &gpm->ring[gpm->display];
+}
 
-	gpm->gpm_arena.capacity = Megabytes(25);
-	gpm->gpm_arena.overflow_addon_size = 0;
-	gpm->gpm_arena.top = 0;
-	gpm->gpm_arena.base = MARENA_PUSH(&pl->memory.main_arena, gpm->gpm_arena.capacity, "Grid Processor Memory Arena");
-	add_monitoring(&gpm->gpm_arena);
+void release_held_table(AppMemory* gm)
+{
+	GPM* gpm = (GPM*)gm->grid_processor_memory;
+	interlocked_exchange_i32(&gpm->held, -1);
+	wake_value_waiters(&gpm->held);
+	signal_process_thread(gpm);	//the ring might have been full up to the held table.
+}
 
-	
-	gpm->gpm_temp_arena.capacity = Megabytes(10);
-	gpm->gpm_temp_arena.overflow_addon_size = 0;
-	gpm->gpm_temp_arena.top = 0;
-	gpm->gpm_temp_arena.base = MARENA_PUSH(&pl->memory.temp_arena, gpm->gpm_temp_arena.capacity, "Grid Processor temp Memory Arena");
-	add_monitoring(&gpm->gpm_temp_arena);
+void step_cellgrid_generation(AppMemory* gm)
+{
+	GPM* gpm = (GPM*)gm->grid_processor_memory;
+	//NOTE: Runs on the calling thread, so the process thread must not be running ahead.
+	ASSERT(gpm->run_ahead == FALSE);
+	ASSERT(gpm->newest == gpm->display);
 
+	int32 next = (gpm->display + 1) % GRID_RING_SIZE;
+	gpm->ring_changes[next].complete = FALSE;
+	gpm->grid_full = !update_cellgrid(gm, &gpm->ring[gpm->display], &gpm->ring[next], gm->track_grid_changes ? &gpm->ring_changes[next] : NULL);
+	if (gpm->grid_full)
+	{
+		return;
+	}
+	gpm->ring_generation[next] = gpm->generation;
+	gpm->newest = next;
+	advance_display(gm);
+}
 
-	//hashtable stuff
-	//table size needs to be a power of 2. 
-	uint32 table_size = (1 << 20);
+void get_cellgrid_stats(AppMemory* gm, CellGridStats* stats)
+{
+	GPM* gpm = (GPM*)gm->grid_processor_memory;
+	stats->generation = gpm->ring_generation[gpm->display];
+	stats->live_cells = table_live_cells(gm->active_table);
+	stats->sand_cells = gm->active_table->type_counts[(uint32)CellType::SAND];
+	stats->max_hash_depth = max_hash_depth;
+	stats->max_visited_probe_depth = max_visited_probe_depth;
+	stats->tiles = (gpm->engine == GridEngine::TILED) ? gpm->tile_world.tiles.size : 0;
+	stats->active_tiles = (gpm->engine == GridEngine::TILED) ? gpm->tile_world.active_tiles : 0;
+	stats->sand_chunks = gpm->sand_world.chunks.size;
+	stats->awake_sand_chunks = gpm->sand_world.awake_chunks;
+	stats->table_arena_high_water = gpm->table_arena_high_water;
+	stats->table_arena_capacity = gpm->ring[0].arena.capacity + gpm->ring[0].table_arena.capacity;
+	stats->temp_arena_high_water = gpm->temp_arena_high_water;
+	stats->grid_full = gpm->grid_full;
+	stats->temp_arena_capacity = 0;
+	for (uint32 w = 0; w < gpm->worker_count; w++)
+	{
+		stats->temp_arena_capacity += gpm->workers[w].arena.capacity + gpm->workers[w].out_arena.capacity;
+	}
+}
 
-	//NOTE: THESE HAVE TO BE THE SAME SIZE!
-	gpm->table1.arena.capacity = Megabytes(10);
-	gpm->table1.arena.overflow_addon_size = 0;
-	gpm->table1.arena.top = 0;
-	gpm->table1.arena.base = MARENA_PUSH(&gpm->gpm_arena, gpm->table1.arena.capacity, "Sub Arena: HashTable-1");
-	add_monitoring(&gpm->table1.arena);
+void cellgrid_update_step(PL* pl, AppMemory* gm)
+{
+	GPM* gpm = (GPM*)gm->grid_processor_memory;
+
+	if (gm->cellgrid_status == CellGridStatus::TRIGGER_PROCESSING)
+	{
+		ASSERT(!gpm->advance_pending);	//Triggering processing while already processing!
+		gpm->advance_pending = TRUE;	//picked up by query_cellgrid_update_state, as soon as the generation is ready.
+	}
+}
 
-	gpm->table1.table.init_and_allocate(&gpm->table1.arena, table_size, "HashTable - 1->table");
-	gpm->table1.node_list.init(&gpm->table1.arena, "HashTable-1 -> live node list");
+//Life-like rules
+b32 parse_life_rule(const char* rulestring, LifeRule* rule)
+{
+	const char* c = rulestring;
+	while (*c == ' ' || *c == '\t')
+	{
+		c++;
+	}
 
-	gpm->table2.arena.capacity = gpm->table1.arena.capacity;
-	gpm->table2.arena.overflow_addon_size = 0;
-	gpm->table2.arena.top = 0;
-	gpm->table2.arena.base = MARENA_PUSH(&gpm->gpm_arena, gpm->table2.arena.capacity, "Sub Arena: HashTable-2");
-	add_monitoring(&gpm->table2.arena);
+	uint32 masks[2] = {};	//birth, survive
+	b32 seen[2] = {};
+	b32 lettered = (*c == 'B' || *c == 'b' || *c == 'S' || *c == 's');
+	uint32 part = 1;	//"23/3" style rulestrings start with the survive counts.
+	for (;;)
+	{
+		if (lettered)
+		{
+			if (*c == 'B' || *c == 'b')
+			{
+				part = 0;
+			}
+			else if (*c == 'S' || *c == 's')
+			{
+				part = 1;
+			}
+			else
+			{
+				return FALSE;
+			}
+			c++;
+		}
+		if (seen[part])
+		{
+			return FALSE;
+		}
+		seen[part] = TRUE;
 
-	gpm->table2.table.init_and_allocate(&gpm->table2.arena, table_size, "HashTable - 2->table");
-	gpm->table2.node_list.init(&gpm->table2.arena, "HashTable-2 -> live node list");
+		while (*c >= '0' && *c <= '8')
+		{
+			masks[part] |= 1 << (*c - '0');
+			c++;
+		}
+		if (*c != '/')
+		{
+			break;
+		}
+		c++;
+		part = 0;
+	}
 
-	gm->active_table = &gpm->table1;
-	//---------------
-	gpm->live_status = (int32)CellGridStatus::FINISHED_PROCESSING;	//Doesn't do anything tell input handler triggers. 
-	gpm->running = &pl->running;
+	while (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n')
+	{
+		c++;
+	}
+	if (*c != '\0' || !seen[0] || (masks[0] & 1))
+	{
+		return FALSE;
+	}
+	rule->birth = (uint16)masks[0];
+	rule->survive = (uint16)masks[1];
+	return TRUE;
+}
 
+void format_life_rule(LifeRule rule, char* buffer, uint32 buffer_size)
+{
+	ASSERT(buffer_size > 0);
+	char text[32];
+	uint32 length = 0;
+	text[length++] = 'B';
+	for (uint32 count = 0; count <= 8; count++)
+	{
+		if (rule.birth & (1 << count))
+		{
+			text[length++] = (char)('0' + count);
+		}
+	}
+	text[length++] = '/';
+	text[length++] = 'S';
+	for (uint32 count = 0; count <= 8; count++)
+	{
+		if (rule.survive & (1 << count))
+		{
+			text[length++] = (char)('0' + count);
+		}
+	}
 
-	gpm->process_thread = pl_create_thread(thread_process_cell, (void*)gm);
+	if (length > buffer_size - 1)
+	{
+		length = buffer_size - 1;
+	}
+	pl_buffer_copy(buffer, text, length);
+	buffer[length] = '\0';
+}
 
+void set_cellgrid_rule(AppMemory* gm, LifeRule rule)
+{
+	GPM* gpm = (GPM*)gm->grid_processor_memory;
+	ASSERT(gpm->run_ahead == FALSE);
+	ASSERT((rule.birth & 1) == 0);	//B0 isn't supported.
+	gpm->rule = rule;
+	mark_cells_edited(gm);	//the tile world and the hashlife tree restart from the active table.
 }
 
-void shutdown_grid_processor(PL* pl, AppMemory* gm)
+LifeRule get_cellgrid_rule(AppMemory* gm)
 {
 	GPM* gpm = (GPM*)gm->grid_processor_memory;
-	
-	b32 thread_is_not_done = pl_wait_for_thread(gpm->process_thread, 30000);	//waits for the process thread to finish...waits for 30 seconds. 
-	if (thread_is_not_done)
-	{
-		ERRORBOX("Grid Processing Thread is running for too long after shutdown initiated! Force kill the app...");
-	}
+	return gpm->rule;
+}
 
-	pl_close_thread(&gpm->process_thread);
+//Snapshots
+//NOTE: The file is the header followed by the node list, the chunk list, the control bytes and the slots, each starting on a 64 byte boundary. 
+//Slots hold indices into the node list and nodes hold indices into the chunk list, so the whole table is copied back as is, without rehashing anything.
+#define SNAPSHOT_MAGIC 0x50414E53	//"SNAP"
+#define SNAPSHOT_VERSION 3
+#define SNAPSHOT_ALIGNMENT 64
+
+struct SnapshotHeader
+{
+	uint32 magic;
+	uint32 version;
+	uint32 node_size;		//sizeof(LiveCellNode) when it was written.
+	uint32 node_count;
+	uint32 chunk_count;
+	uint64 generation;
+	CameraState camera;
+	uint32 shard_groups;
+	LifeRule rule;
+	uint32 shard_used[HASHTABLE_SHARDS];
+	uint64 nodes_offset;
+	uint64 chunks_offset;
+	uint64 ctrl_offset;
+	uint64 slots_offset;
+	uint64 file_size;
+};
 
-	gpm->table2.node_list.clear(&gpm->table2.arena);
-	gpm->table2.table.clear(&gpm->table2.arena);
+static FORCEDINLINE uint64 snapshot_align(uint64 offset)
+{
+	return (offset + SNAPSHOT_ALIGNMENT - 1) & ~(uint64)(SNAPSHOT_ALIGNMENT - 1);
+}
 
-	MARENA_POP(&gpm->gpm_arena, gpm->table2.arena.capacity, "Sub Arena: HashTable-2");
-	remove_monitoring(&gpm->table2.arena);
+static b32 write_snapshot_padding(FILE* file, uint64 written, uint64 offset)
+{
+	static const uint8 zeroes[SNAPSHOT_ALIGNMENT] = {};
+	ASSERT(offset - written <= SNAPSHOT_ALIGNMENT);
+	return fwrite(zeroes, 1, (size_t)(offset - written), file) == offset - written;
+}
 
+b32 save_snapshot(AppMemory* gm, const char* path)
+{
+	GPM* gpm = (GPM*)gm->grid_processor_memory;
+	Hashtable* ht = gm->active_table;
 
-	gpm->table1.node_list.clear(&gpm->table1.arena);
-	gpm->table1.table.clear(&gpm->table1.arena);
+	SnapshotHeader header = {};
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	header.node_size = sizeof(LiveCellNode);
+	header.node_count = ht->node_list.size;
+	header.chunk_count = ht->chunks.size;
+	header.generation = gpm->ring_generation[gpm->display];
+	header.camera = gm->cm;
+	header.shard_groups = ht->shard_groups;
+	header.rule = gpm->rule;
+	pl_buffer_copy(header.shard_used, ht->shard_used, sizeof(header.shard_used));
+	header.nodes_offset = snapshot_align(sizeof(SnapshotHeader));
+	header.chunks_offset = snapshot_align(header.nodes_offset + (uint64)ht->node_list.size * sizeof(LiveCellNode));
+	header.ctrl_offset = snapshot_align(header.chunks_offset + (uint64)ht->chunks.size * sizeof(WorldPos));
+	header.slots_offset = snapshot_align(header.ctrl_offset + ht->ctrl.size);
+	header.file_size = header.slots_offset + (uint64)ht->slots.size * sizeof(uint32);
 
-	MARENA_POP(&gpm->gpm_arena, gpm->table1.arena.capacity, "Sub Arena: HashTable-1");
-	remove_monitoring(&gpm->table1.arena);
+	FILE* file;
+#ifdef _MSC_VER
+	if (fopen_s(&file, path, "wb") != 0)
+	{
+		file = NULL;
+	}
+#else
+	file = fopen(path, "wb");
+#endif
+	if (file == NULL)
+	{
+		return FALSE;
+	}
 
-	MARENA_POP(&pl->memory.temp_arena, gpm->gpm_temp_arena.capacity, "Grid Processor temp Memory Arena");
-	remove_monitoring(&gpm->gpm_temp_arena);
+	b32 ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && write_snapshot_padding(file, sizeof(header), header.nodes_offset);
 
-	remove_monitoring(&gpm->gpm_arena);
+	ok = ok && fwrite(ht->node_list.front, sizeof(LiveCellNode), ht->node_list.size, file) == ht->node_list.size;
+	ok = ok && write_snapshot_padding(file, header.nodes_offset + (uint64)ht->node_list.size * sizeof(LiveCellNode), header.chunks_offset);
+	ok = ok && fwrite(ht->chunks.front, sizeof(WorldPos), ht->chunks.size, file) == ht->chunks.size;
+	ok = ok && write_snapshot_padding(file, header.chunks_offset + (uint64)ht->chunks.size * sizeof(WorldPos), header.ctrl_offset);
+	ok = ok && fwrite(ht->ctrl.front, 1, ht->ctrl.size, file) == ht->ctrl.size;
+	ok = ok && write_snapshot_padding(file, header.ctrl_offset + ht->ctrl.size, header.slots_offset);
+	ok = ok && fwrite(ht->slots.front, sizeof(uint32), ht->slots.size, file) == ht->slots.size;
 
-	MARENA_POP(&pl->memory.main_arena, gpm->gpm_arena.capacity, "Grid Processor Memory Arena");
-	MARENA_POP(&pl->memory.main_arena, sizeof(GPM), "Grid Processor Memory Struct");
+	ok = (fclose(file) == 0) && ok;
+	return ok;
 }
 
-ATP_REGISTER(process_cell_grid);
-static void thread_process_cell(void* app_memory)
+//Checks everything the table indexes with: every node's chunk, every occupied slot's node, and that each chunk corner is listed once. 
+//A slot's control byte is either a tag (occupied), CTRL_EMPTY or CTRL_DELETED, and the counts of used slots must match so inserts always find a free one.
+static b32 snapshot_contents_valid(GPM* gpm, SnapshotHeader* header, uint8* data)
 {
-	AppMemory* gm = (AppMemory*)app_memory;
-	GPM *gpm = (GPM*)gm->grid_processor_memory;
-	while (*gpm->running)
+	LiveCellNode* nodes = (LiveCellNode*)(data + header->nodes_offset);
+	for (uint32 i = 0; i < header->node_count; i++)
 	{
-		CellGridStatus result = (CellGridStatus)interlocked_compare_exchange_i32(&gpm->live_status, (int32)CellGridStatus::PROCESSING, (int32)CellGridStatus::TRIGGER_PROCESSING);
-		if(result == CellGridStatus::TRIGGER_PROCESSING)
+		if (node_chunk(&nodes[i]) >= header->chunk_count || (uint8)nodes[i].type > (uint8)CellType::BRICK)
 		{
-			ATP_BLOCK(process_cell_grid);
-			update_cellgrid(gm);
-			CellGridStatus finished_result = (CellGridStatus)interlocked_compare_exchange_i32(&gpm->live_status, (int32)CellGridStatus::FINISHED_PROCESSING, (int32)CellGridStatus::PROCESSING);
-			ASSERT(gpm->trigger_buffer_swap == FALSE);
-			gpm->trigger_buffer_swap = TRUE; 
-			ASSERT(finished_result == CellGridStatus::PROCESSING);
+			return FALSE;
 		}
-		else
+	}
+
+	//NOTE: The workers are idle while paused, so the first one's chunk set is free to find the corners listed twice.
+	VisitedSet* corner_set = &gpm->workers[0].chunk_set;
+	b32 set_fits = count_map_begin(corner_set, header->chunk_count);
+	ASSERT(set_fits);	//sized for TABLE_MAX_CHUNKS.
+	WorldPos* corners = (WorldPos*)(data + header->chunks_offset);
+	for (uint32 i = 0; i < header->chunk_count; i++)
+	{
+		WorldPos corner = chunk_corner(corners[i]);
+		if (corner.x != corners[i].x || corner.y != corners[i].y)
+		{
+			return FALSE;
+		}
+		VisitedSlot* slot = count_map_get(corner_set, corner);
+		if (slot->alive)
 		{
-			pl_sleep_thread(1);
+			return FALSE;
 		}
+		slot->alive = 1;
 	}
-}
 
-//returns the state of the thread processing the cellgrid. Also performs hashtable swap in case of GPM->trigger_buffer_swap
-CellGridStatus query_cellgrid_update_state(AppMemory* gm)
-{
-	GPM* gpm = (GPM*)gm->grid_processor_memory;
-	if (gpm->trigger_buffer_swap)
+	uint8* ctrl = data + header->ctrl_offset;
+	uint32* slots = (uint32*)(data + header->slots_offset);
+	uint32 shard_slots = header->shard_groups * HASHTABLE_GROUP_SIZE;
+	for (uint32 shard = 0; shard < HASHTABLE_SHARDS; shard++)
 	{
-		gm->active_table->node_list.clear(&gm->active_table->arena);
-		gm->active_table->node_list.front = (LiveCellNode*)MARENA_TOP(&gm->active_table->arena);
-
-		//Clearing out previous hashtable (setting to zero to clear it out)
-		pl_buffer_set(gm->active_table->table.front, 0, gm->active_table->table.size * sizeof(LiveCellNode*));
-		//setting new active table.
-
-		ASSERT(gpm->live_status == (int32)CellGridStatus::FINISHED_PROCESSING);
-		Hashtable* next_table;
-		if (gm->active_table == &gpm->table1)
+		uint32 used = 0;
+		for (uint32 i = shard * shard_slots; i < (shard + 1) * shard_slots; i++)
 		{
-			next_table = &gpm->table2;
+			if (ctrl[i] < 0x80)
+			{
+				if (slots[i] >= header->node_count)
+				{
+					return FALSE;
+				}
+			}
+			else if (ctrl[i] != CTRL_EMPTY && ctrl[i] != CTRL_DELETED)
+			{
+				return FALSE;
+			}
+			used += (ctrl[i] != CTRL_EMPTY);
 		}
-		else
+		if (used != header->shard_used[shard])
 		{
-			next_table = &gpm->table1;
+			return FALSE;
 		}
-		gm->active_table = next_table;
-		gpm->trigger_buffer_swap = FALSE;
 	}
-	CellGridStatus state = (CellGridStatus)gpm->live_status;
-	return state;
+	return TRUE;
 }
 
-void cellgrid_update_step(PL* pl, AppMemory* gm)
+b32 load_snapshot(AppMemory* gm, const char* path)
 {
 	GPM* gpm = (GPM*)gm->grid_processor_memory;
+	Hashtable* ht = gm->active_table;
+	ASSERT(gpm->run_ahead == FALSE);
 
-	if (gm->cellgrid_status == CellGridStatus::TRIGGER_PROCESSING)
+	MappedFile file;
+	if (!map_file(path, &file))
+	{
+		return FALSE;
+	}
+
+	//checking everything before touching the table, so a bad file leaves the grid as it was.
+	SnapshotHeader header;
+	b32 valid = file.size >= sizeof(SnapshotHeader);
+	if (valid)
+	{
+		pl_buffer_copy(&header, file.data, sizeof(header));
+		uint64 slot_count = (uint64)HASHTABLE_SHARDS * header.shard_groups * HASHTABLE_GROUP_SIZE;
+		uint64 nodes_size = (uint64)header.node_count * sizeof(LiveCellNode);
+		valid = header.magic == SNAPSHOT_MAGIC && header.version == SNAPSHOT_VERSION && header.node_size == sizeof(LiveCellNode) &&
+			header.file_size == file.size &&
+			(header.rule.birth & 1) == 0 && header.rule.birth <= 0x1FF && header.rule.survive <= 0x1FF &&
+			header.shard_groups >= HASHTABLE_MIN_SHARD_GROUPS && (header.shard_groups & (header.shard_groups - 1)) == 0 &&
+			header.chunk_count <= TABLE_MAX_CHUNKS &&
+			((header.nodes_offset | header.chunks_offset | header.ctrl_offset | header.slots_offset) & (SNAPSHOT_ALIGNMENT - 1)) == 0 &&
+			header.nodes_offset >= sizeof(SnapshotHeader) && header.nodes_offset + nodes_size <= header.chunks_offset &&
+			header.chunks_offset + (uint64)header.chunk_count * sizeof(WorldPos) <= header.ctrl_offset &&
+			header.ctrl_offset + slot_count <= header.slots_offset && header.slots_offset + slot_count * sizeof(uint32) <= file.size &&
+			nodes_size <= ht->arena.capacity - (ht->arena.top - ht->node_list.size * sizeof(LiveCellNode)) &&
+			slot_count * (sizeof(uint8) + sizeof(uint32)) <= ht->table_arena.capacity;
+		valid = valid && snapshot_contents_valid(gpm, &header, file.data);
+	}
+	if (!valid)
+	{
+		unmap_file(&file);
+		return FALSE;
+	}
+
+	clear_table(ht, header.shard_groups, header.chunk_count);
+	commit_arena(&ht->arena, (uint64)header.node_count * sizeof(LiveCellNode));
+	MARENA_PUSH(&ht->arena, (uint64)header.node_count * sizeof(LiveCellNode), "HashTable -> live node list");
+	pl_buffer_copy(ht->node_list.front, file.data + header.nodes_offset, (uint64)header.node_count * sizeof(LiveCellNode));
+	ht->node_list.size = header.node_count;
+	for (uint32 i = 0; i < header.node_count; i++)
+	{
+		ht->type_counts[(uint32)ht->node_list[i].type]++;
+	}
+
+	//the corners are all different, so every chunk gets its old index back.
+	WorldPos* corners = (WorldPos*)(file.data + header.chunks_offset);
+	for (uint32 i = 0; i < header.chunk_count; i++)
 	{
-		ASSERT(gpm->live_status != (int32)CellGridStatus::PROCESSING);	//Triggering processing while already processing!
-		interlocked_exchange_i32(&gpm->live_status, (int32)CellGridStatus::TRIGGER_PROCESSING);
+		add_table_chunk(ht, corners[i]);
 	}
+
+	pl_buffer_copy(ht->ctrl.front, file.data + header.ctrl_offset, ht->ctrl.size);
+	pl_buffer_copy(ht->slots.front, file.data + header.slots_offset, (uint64)ht->slots.size * sizeof(uint32));
+	pl_buffer_copy(ht->shard_used, header.shard_used, sizeof(ht->shard_used));
+	unmap_file(&file);
+
+	gpm->generation = header.generation;
+	gpm->ring_generation[gpm->display] = header.generation;
+	gpm->rule = header.rule;
+	gm->cm = header.camera;
+	gm->camera_changed = TRUE;
+	mark_cells_edited(gm);
+	return TRUE;
 }
 
 
-static void process_cell(LiveCellNode* cell,  Hashtable* active_table, Hashtable* next_table, MSlice<WorldPos>& new_cells_tested, MArena* temp_arena)
+//NOTE: Doesn't write to the next table directly. Cells for the next generation are appended to the worker's output list. 
+static void process_cell(LiveCellNode* cell, Hashtable* active_table, GridWorker* worker)
 {
-	CellType& type = cell->type;
-	WorldPos& pos = cell->pos;
-	if (type == CellType::EMPTY)
+	CellType type = cell->type;
+	if (type == CellType::EMPTY || type == CellType::SAND)	//sand cells are stepped by the sand world.
 	{
 		return;
 	}
 
-	uint32 table_size = active_table->table.size;
+	if (type == CellType::BRICK)
+	{
+		WorldPos pos = node_pos(active_table, cell);
+		LiveCell ad = { pos, CellType::BRICK };
+		add_output(worker, ad);
+	}
+
+}
 
-	//If the new cell is a conway cell
-	if (type == CellType::CONWAY)
+//A live conway cell, and the dead cells around it that weren't tested yet by this worker.
+//NOTE: A dead cell next to the slices of more than one worker gets tested by each of them. Only the one whose slice has its first live neighbor (by node index) outputs it,
+//so every cell is output once. The slice begins at slice_begin.
+template<typename Rule>
+static void process_conway_cell(LiveCellNode* cell, Hashtable* active_table, GridWorker* worker, Rule rule, uint32 slice_begin)
+{
+	WorldPos pos = node_pos(active_table, cell);
 	{
 		WorldPos lookup_pos[8];
 		lookup_pos[0] = { pos.x    , pos.y - 1 };	//bm
@@ -233,33 +1854,33 @@ static void process_cell(LiveCellNode* cell,  Hashtable* active_table, Hashtable
 		lookup_pos[6] = { pos.x - 1, pos.y };		//ml
 		lookup_pos[7] = { pos.x - 1, pos.y + 1 };	//tl
 
-		uint32 lookup_pos_hash[8];
+		uint64 lookup_pos_hash[8];
 		//TODO: SIMD this.
-		lookup_pos_hash[0] = hash_pos(lookup_pos[0], table_size);
-		lookup_pos_hash[1] = hash_pos(lookup_pos[1], table_size);
-		lookup_pos_hash[2] = hash_pos(lookup_pos[2], table_size);
-		lookup_pos_hash[3] = hash_pos(lookup_pos[3], table_size);
-		lookup_pos_hash[4] = hash_pos(lookup_pos[4], table_size);
-		lookup_pos_hash[5] = hash_pos(lookup_pos[5], table_size);
-		lookup_pos_hash[6] = hash_pos(lookup_pos[6], table_size);
-		lookup_pos_hash[7] = hash_pos(lookup_pos[7], table_size);
+		lookup_pos_hash[0] = hash_pos(lookup_pos[0]);
+		lookup_pos_hash[1] = hash_pos(lookup_pos[1]);
+		lookup_pos_hash[2] = hash_pos(lookup_pos[2]);
+		lookup_pos_hash[3] = hash_pos(lookup_pos[3]);
+		lookup_pos_hash[4] = hash_pos(lookup_pos[4]);
+		lookup_pos_hash[5] = hash_pos(lookup_pos[5]);
+		lookup_pos_hash[6] = hash_pos(lookup_pos[6]);
+		lookup_pos_hash[7] = hash_pos(lookup_pos[7]);
 
 		CellType surround_state[8] = {};
+		uint32 surround_node[8];
 
 		uint32 active_around = 0;
 		for (uint32 i = 0; i < ArrayCount(lookup_pos); i++)
 		{
-			uint32 slot = lookup_pos_hash[i];
-			surround_state[i] = lookup_cell(active_table, slot, lookup_pos[i]);
+			surround_node[i] = lookup_node(active_table, lookup_pos_hash[i], lookup_pos[i]);
+			surround_state[i] = (surround_node[i] != UINT32MAX) ? active_table->node_list[surround_node[i]].type : CellType::EMPTY;
 			active_around += (surround_state[i] == CellType::CONWAY) ? 1 : 0;
 		}
 
-		if (active_around == 2 || active_around == 3)
+		if (life_rule_next(rule, active_around, 1))
 		{
 			//Cell survives! Adding to next hashmap. 
-			uint32 slot = hash_pos(pos, table_size);
-			LiveCellNode ad = { NULL, pos, CellType::CONWAY, NULL };
-			append_new_node(next_table, slot, ad);
+			LiveCell ad = { pos, CellType::CONWAY };
+			add_output(worker, ad);
 		}
 		//else cell doesn't survive to next state. 
 
@@ -271,16 +1892,10 @@ static void process_cell(LiveCellNode* cell,  Hashtable* active_table, Hashtable
 				//appending new cell to be processed. This is to ensure that the same surrounding 'off' cell isn't processed twice. 
 				WorldPos new_cell_pos = lookup_pos[i];
 
-				WorldPos* front = new_cells_tested.front;
-				for (uint32 i = 0; i < new_cells_tested.size; i++)
+				if (!visited_set_add(&worker->visited, new_cell_pos))
 				{
-					if (front->x == new_cell_pos.x && front->y == new_cell_pos.y)
-					{
-						goto SKIP_TEST; //The cell already exists in the list to be processed. no need to add again. 
-					}
-					front++;
+					goto SKIP_TEST; //The cell already exists in the list to be processed. no need to add again. 
 				}
-				new_cells_tested.add(temp_arena, new_cell_pos);
 
 
 				//process new cell.
@@ -294,9 +1909,10 @@ static void process_cell(LiveCellNode* cell,  Hashtable* active_table, Hashtable
 				nc_lookup_pos[6] = { new_cell_pos.x - 1, new_cell_pos.y };		//ml
 				nc_lookup_pos[7] = { new_cell_pos.x - 1, new_cell_pos.y + 1 };	//tl
 
-				CellType nc_surround_state[8] = { (CellType)UINT32MAX, (CellType)UINT32MAX, (CellType)UINT32MAX, 
-												  (CellType)UINT32MAX,						(CellType)UINT32MAX, 
-												   (CellType)UINT32MAX,(CellType)UINT32MAX, (CellType)UINT32MAX };	// UINT32MAX means not pre-assigned
+				CellType nc_surround_state[8] = { (CellType)0xFF, (CellType)0xFF, (CellType)0xFF, 
+												  (CellType)0xFF,					(CellType)0xFF, 
+												   (CellType)0xFF,(CellType)0xFF, (CellType)0xFF };	// 0xFF means not pre-assigned
+				uint32 nc_surround_node[8];
 				//preassigning the surrounding state with the already looked up ones. 
 				for (uint32 j = 0; j < ArrayCount(nc_lookup_pos); j++)
 				{
@@ -305,6 +1921,7 @@ static void process_cell(LiveCellNode* cell,  Hashtable* active_table, Hashtable
 						if (nc_lookup_pos[j].x == lookup_pos[ii].x && nc_lookup_pos[j].y == lookup_pos[ii].y)
 						{
 							nc_surround_state[j] = surround_state[ii];
+							nc_surround_node[j] = surround_node[ii];
 							break;
 						}
 					}
@@ -312,86 +1929,208 @@ static void process_cell(LiveCellNode* cell,  Hashtable* active_table, Hashtable
 				//performing lookups on the neighboring cells that aren't near the nearby live cell. 
 				for (uint32 j = 0; j < ArrayCount(nc_lookup_pos); j++)
 				{
-					if ((uint32)nc_surround_state[j] != UINT32MAX)	//found by the previous lookup 
+					if ((uint8)nc_surround_state[j] != 0xFF)	//found by the previous lookup 
 					{
 						continue;
 					}
 					else   //performing lookup of cell.
 					{
-						uint32 nc_lookup_hash = hash_pos(nc_lookup_pos[j], table_size);
-						uint32 nc_slot = nc_lookup_hash;
-						nc_surround_state[j] = lookup_cell(active_table, nc_slot, nc_lookup_pos[j]);
+						uint64 nc_lookup_hash = hash_pos(nc_lookup_pos[j]);
+						nc_surround_node[j] = lookup_node(active_table, nc_lookup_hash, nc_lookup_pos[j]);
+						nc_surround_state[j] = (nc_surround_node[j] != UINT32MAX) ? active_table->node_list[nc_surround_node[j]].type : CellType::EMPTY;
 					}
 				}
 
 				//now with the completed nc_surrounding_state table, we can judge whether the cell is turned alive or not. 
 				uint32 nc_active_count = 0;
+				b32 tested_earlier = FALSE;	//by the worker of an earlier slice.
 				for (uint32 j = 0; j < ArrayCount(nc_surround_state); j++)
 				{
-					nc_active_count += (nc_surround_state[j] == CellType::CONWAY) ? 1 : 0;
-					//ASSERT(nc_surround_state[j] == 0 || nc_surround_state[j] == 1);
+					if (nc_surround_state[j] == CellType::CONWAY)
+					{
+						nc_active_count++;
+						tested_earlier |= (nc_surround_node[j] < slice_begin);
+					}
 				}
 
-				if (nc_active_count == 3)	//cell becomes alive!
+				if (!tested_earlier && life_rule_next(rule, nc_active_count, 0))	//cell becomes alive!
 				{
 					//adding cell to next hashmap
-					uint32 nc_new_cell_hash = hash_pos(new_cell_pos, table_size);
-					uint32 nc_new_cell_index = nc_new_cell_hash;
-					LiveCellNode ad = { NULL, new_cell_pos, CellType::CONWAY, NULL };
-					append_new_node(next_table, nc_new_cell_index, ad);
+					LiveCell ad = { new_cell_pos, CellType::CONWAY };
+					add_output(worker, ad);
 				}
 			}
 		SKIP_TEST:;
 
 		}
 	}
-	
-	//Sand cell
-	if (type == CellType::SAND)
+}
+
+template<typename Rule>
+static void process_node_slice(Hashtable* active_table, GridWorker* worker, uint32 slice_begin, uint32 slice_end, LifeRule life_rule)
+{
+	Rule rule(life_rule);
+	LiveCellNode* it = active_table->node_list.front + slice_begin;
+	for (uint32 i = slice_begin; i < slice_end; i++)
 	{
-		WorldPos lookup_pos = { pos.x, pos.y - 1 };
-		uint32 slot = hash_pos(lookup_pos, table_size);
-		CellType under = lookup_cell(active_table, slot, lookup_pos);
-		
-		//Moving sand down one cell
-		if (under == CellType::EMPTY)
+		if (it->type == CellType::CONWAY)
 		{
-			LiveCellNode ad = { NULL, lookup_pos, CellType::SAND, NULL };
-			append_new_node(next_table, slot, ad);
-			return;
+			process_conway_cell(it, active_table, worker, rule, slice_begin);
 		}
-		
-		lookup_pos = { pos.x - 1, pos.y - 1 };
-		slot = hash_pos(lookup_pos, table_size);
-		//Moving sand to left if empty
-		if (lookup_cell(active_table, slot, lookup_pos) == CellType::EMPTY)
+		else
 		{
-			LiveCellNode ad = { NULL, lookup_pos, CellType::SAND, NULL };
-			append_new_node(next_table, slot, ad);
-			return;
+			process_cell(it, active_table, worker);
 		}
-		
-		lookup_pos = { pos.x + 1, pos.y - 1 };
-		slot = hash_pos(lookup_pos, table_size);
-		//moving sand to right if empty
-		if (lookup_cell(active_table, slot, lookup_pos) == CellType::EMPTY)
+		it++;
+	}
+}
+
+//-----------------------------------------
+//Scatter engine: instead of looking up the 8 neighbors of every live cell and of every dead cell next to it, 
+//every live conway cell adds 1 to the count of its 8 neighbors in a count map. Births and survivals are then decided in one pass over the map.
+//NOTE: Counts have to be complete before deciding, so the workers can't just split the node list. 
+//Instead, every worker owns the cells of every (active_workers)th band of rows and only counts (and decides) the cells it owns.
+//Each worker goes through the whole node list, picking the live cells next to its bands.
+#define SCATTER_BAND_BITS 6
+
+static FORCEDINLINE uint32 band_owner(int64 y, uint32 worker_count)
+{
+	return (uint32)((uint64)(y >> SCATTER_BAND_BITS) % worker_count);
+}
+
+//TRUE if the worker owns any of the rows y - 1 to y + 1.
+static FORCEDINLINE b32 touches_owned_rows(int64 y, uint32 worker_index, uint32 worker_count)
+{
+	return band_owner(y - 1, worker_count) == worker_index || band_owner(y, worker_count) == worker_index || band_owner(y + 1, worker_count) == worker_index;
+}
+
+//Fallback when the count map doesn't fit: tests a single cell the old way. (cells can get tested more than once, the duplicates are resolved when linking)
+template<typename Rule>
+static void gather_conway_cell(WorldPos pos, Hashtable* active_table, GridWorker* worker, Rule rule)
+{
+	uint32 active_around = 0;
+	for (int64 dy = -1; dy <= 1; dy++)
+	{
+		for (int64 dx = -1; dx <= 1; dx++)
 		{
-			LiveCellNode ad = { NULL, lookup_pos, CellType::SAND, NULL };
-			append_new_node(next_table, slot, ad);
-			return;
+			if (dx == 0 && dy == 0)
+			{
+				continue;
+			}
+			WorldPos lookup_pos = { pos.x + dx, pos.y + dy };
+			active_around += (lookup_cell(active_table, hash_pos(lookup_pos), lookup_pos) == CellType::CONWAY) ? 1 : 0;
 		}
+	}
+	//the cell itself only needs a lookup when birth and survival disagree on this count.
+	b32 next_alive = life_rule_next(rule, active_around, FALSE);
+	if (next_alive != life_rule_next(rule, active_around, TRUE) && lookup_cell(active_table, hash_pos(pos), pos) == CellType::CONWAY)
+	{
+		next_alive = !next_alive;
+	}
+	if (next_alive)
+	{
+		LiveCell ad = { pos, CellType::CONWAY };
+		add_output(worker, ad);
+	}
+}
+
+template<typename Rule>
+static void scatter_conway_cells(Hashtable* active_table, GridWorker* worker, LifeRule life_rule)
+{
+	Rule rule(life_rule);
+	uint32 worker_index = worker->index;
+	uint32 worker_count = worker->gpm->active_workers;
+	LiveCellNode* nodes = active_table->node_list.front;
+	uint32 node_count = active_table->node_list.size;
 
-		//keeping sand as is
-		slot = hash_pos(pos, table_size);
-		LiveCellNode ad = { NULL, pos, CellType::SAND, NULL };
-		append_new_node(next_table, slot, ad);
+	uint32 picked = 0;
+	for (uint32 i = 0; i < node_count; i++)
+	{
+		if (nodes[i].type == CellType::CONWAY && (worker_count == 1 || touches_owned_rows(node_pos(active_table, nodes + i).y, worker_index, worker_count)))
+		{
+			picked++;
+		}
 	}
 
-	if (type == CellType::BRICK)
+	if (!count_map_begin(&worker->visited, (uint64)picked * 9))
+	{
+		for (uint32 i = 0; i < node_count; i++)
+		{
+			if (nodes[i].type != CellType::CONWAY)
+			{
+				continue;
+			}
+			WorldPos node = node_pos(active_table, nodes + i);
+			if (!touches_owned_rows(node.y, worker_index, worker_count))
+			{
+				continue;
+			}
+			for (int64 dy = -1; dy <= 1; dy++)
+			{
+				if (band_owner(node.y + dy, worker_count) != worker_index)
+				{
+					continue;
+				}
+				for (int64 dx = -1; dx <= 1; dx++)
+				{
+					WorldPos pos = { node.x + dx, node.y + dy };
+					gather_conway_cell(pos, active_table, worker, rule);
+				}
+			}
+		}
+		return;
+	}
+
+	VisitedSet* map = &worker->visited;
+	for (uint32 i = 0; i < node_count; i++)
 	{
-		uint32 slot = hash_pos(pos, table_size);
-		LiveCellNode ad = { NULL, pos, CellType::BRICK, NULL };
-		append_new_node(next_table, slot, ad);
+		if (nodes[i].type != CellType::CONWAY)
+		{
+			continue;
+		}
+		WorldPos pos = node_pos(active_table, nodes + i);
+		if (worker_count == 1)
+		{
+			count_map_get(map, pos)->alive = 1;
+			count_map_get(map, { pos.x - 1, pos.y - 1 })->live_neighbors++;
+			count_map_get(map, { pos.x    , pos.y - 1 })->live_neighbors++;
+			count_map_get(map, { pos.x + 1, pos.y - 1 })->live_neighbors++;
+			count_map_get(map, { pos.x - 1, pos.y     })->live_neighbors++;
+			count_map_get(map, { pos.x + 1, pos.y     })->live_neighbors++;
+			count_map_get(map, { pos.x - 1, pos.y + 1 })->live_neighbors++;
+			count_map_get(map, { pos.x    , pos.y + 1 })->live_neighbors++;
+			count_map_get(map, { pos.x + 1, pos.y + 1 })->live_neighbors++;
+			continue;
+		}
+
+		for (int64 dy = -1; dy <= 1; dy++)
+		{
+			if (band_owner(pos.y + dy, worker_count) != worker_index)
+			{
+				continue;
+			}
+			for (int64 dx = -1; dx <= 1; dx++)
+			{
+				VisitedSlot* slot = count_map_get(map, { pos.x + dx, pos.y + dy });
+				if (dx == 0 && dy == 0)
+				{
+					slot->alive = 1;
+				}
+				else
+				{
+					slot->live_neighbors++;
+				}
+			}
+		}
 	}
 
+	for (uint32 i = 0; i <= map->mask; i++)
+	{
+		VisitedSlot* slot = &map->slots[i];
+		if (slot->stamp == map->stamp && life_rule_next(rule, slot->live_neighbors, slot->alive))
+		{
+			LiveCell ad = { slot->pos, CellType::CONWAY };
+			add_output(worker, ad);
+		}
+	}
 }
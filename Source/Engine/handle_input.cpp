@@ -7,16 +7,35 @@ inline bool operator==(CameraState& lhs, CameraState& rhs)
 }
 
 
+//L loads this pattern centered on the camera, E saves the whole grid to the other one (in the format of its extension). Only while paused.
+#define PATTERN_LOAD_PATH "pattern.rle"
+#define PATTERN_SAVE_PATH "saved_pattern.rle"
+
+//S writes a snapshot of the grid and camera, R restores it. Only while paused.
+#define SNAPSHOT_PATH "world.snapshot"
+
+//N switches the conway cells to the next of these rules. Only while paused.
+static const char* cycled_rules[] = { "B3/S23", "B36/S23", "B3678/S34678", "B2/S", "B3/S012345678", "B3/S12345", "B1357/S1357" };
+
+//O and P go down and up these speeds (steps per second). T toggles fast forward, which runs as fast as the grid processor can and shows the newest generation every frame.
+static const uint32 tick_speeds[] = { 1, 2, 5, 10, 20, 30, 60, 120, 240, 500 };
+#define DEFAULT_TICK_SPEED 3	//10 steps per second.
+//Speeds above this can take more steps in a frame than the grid processor computes ahead, so they run in LIMITED fast forward. (only the newest generation is shown every frame)
+#define FAST_FORWARD_MIN_SPEED 60
+
 struct IHM
 {
 	//input handling memory
-	uint64 prev_update_tick;
-	uint64 update_tick_time;
+	f64 prev_update_time;	//seconds.
+	f64 due_steps;			//fraction of a step that came due, but isn't added to the grid processor's pending steps yet.
+	uint32 tick_speed;		//index into tick_speeds.
+	b32 unlimited_fast_forward;
 	b32 paused;
 	b32 trigger_pause;
 	vec2i prev_mouse_pos;
 	b32 in_panning_mode;
 	CellType paint_mode;
+	uint32 cycled_rule;
 
 	MArena arena;
 	//------------------------
@@ -36,9 +55,12 @@ void init_input_handler(PL* pl, AppMemory* gm)
 	
 	ihm->trigger_pause = FALSE;
 	ihm->paused = TRUE;
-	ihm->prev_update_tick = pl->time.current_millis;
-	ihm->update_tick_time = 100;
+	ihm->prev_update_time = pl->time.fcurrent_seconds;
+	ihm->due_steps = 0;
+	ihm->tick_speed = DEFAULT_TICK_SPEED;
+	ihm->unlimited_fast_forward = FALSE;
 	ihm->prev_mouse_pos = { 0,0 };
+	ihm->cycled_rule = 0;	//B3/S23, the grid processor's starting rule.
 }
 
 
@@ -83,6 +105,21 @@ static MSlice<WorldPos> traverse_grid(WorldPos from, WorldPos to, MArena* arena)
 
 }
 
+//Picks how the grid processor runs ahead for the speed.
+static void apply_tick_speed(IHM* ihm, AppMemory* gm)
+{
+	FastForward fast_forward = FastForward::OFF;
+	if (ihm->unlimited_fast_forward)
+	{
+		fast_forward = FastForward::UNLIMITED;
+	}
+	else if (tick_speeds[ihm->tick_speed] > FAST_FORWARD_MIN_SPEED)
+	{
+		fast_forward = FastForward::LIMITED;
+	}
+	set_cellgrid_fast_forward(gm, fast_forward);
+}
+
 static void update_input_handler(PL* pl, AppMemory* gm)
 {
 	IHM* ihm = (IHM*)gm->input_handling_memory;
@@ -93,6 +130,7 @@ static void update_input_handler(PL* pl, AppMemory* gm)
 		if (gm->cellgrid_status == CellGridStatus::FINISHED_PROCESSING)
 		{
 			ihm->paused = !ihm->paused;
+			set_cellgrid_paused(gm, ihm->paused);
 		}
 		else
 		{
@@ -108,6 +146,7 @@ static void update_input_handler(PL* pl, AppMemory* gm)
 		{
 			ihm->paused = TRUE;
 			ihm->trigger_pause = FALSE;	//releasing trigger
+			set_cellgrid_paused(gm, TRUE);
 		}
 	}
 
@@ -180,14 +219,18 @@ static void update_input_handler(PL* pl, AppMemory* gm)
 		{
 			zoom_factor *= (gm->cm.scale - 0.05);	//closer it is, less the zoom factor becomes.
 		}
-		else
+		else if (gm->cm.scale < 0.5)
 		{
 			zoom_factor *= (1.0 - gm->cm.scale);
 		}
+		else
+		{
+			zoom_factor *= gm->cm.scale;	//further out, it zooms out by the same ratio every time.
+		}
 		f64 scroll_delta = -pl->input.mouse.scroll_delta;
 		scroll_delta *= pl->time.fdelta_seconds * zoom_factor;
 		gm->cm.scale += scroll_delta;
-		gm->cm.scale = clamp(gm->cm.scale, 0.05, 1.0);
+		gm->cm.scale = clamp(gm->cm.scale, 0.05, CAMERA_MAX_SCALE);
 
 	}
 
@@ -216,6 +259,37 @@ static void update_input_handler(PL* pl, AppMemory* gm)
 	{
 		pl_debug_print("Active paint brush: %i\n", (int32)ihm->paint_mode);
 
+		if (pl->input.keys[PL_KEY::L].pressed)
+		{
+			PatternResult result = load_pattern(gm, PATTERN_LOAD_PATH, PatternFormat::AUTO, gm->cm.world_center, &pl->memory.temp_arena);
+			pl_debug_print("Loading %s: %i\n", PATTERN_LOAD_PATH, (int32)result);
+		}
+		if (pl->input.keys[PL_KEY::E].pressed)
+		{
+			PatternResult result = save_pattern(gm, PATTERN_SAVE_PATH, PatternFormat::AUTO, &pl->memory.temp_arena);
+			pl_debug_print("Saving %s: %i\n", PATTERN_SAVE_PATH, (int32)result);
+		}
+		if (pl->input.keys[PL_KEY::S].pressed)
+		{
+			b32 saved = save_snapshot(gm, SNAPSHOT_PATH);
+			pl_debug_print("Saving snapshot %s: %i\n", SNAPSHOT_PATH, saved);
+		}
+		if (pl->input.keys[PL_KEY::R].pressed)
+		{
+			b32 loaded = load_snapshot(gm, SNAPSHOT_PATH);
+			pl_debug_print("Restoring snapshot %s: %i\n", SNAPSHOT_PATH, loaded);
+		}
+		if (pl->input.keys[PL_KEY::N].pressed)
+		{
+			ihm->cycled_rule = (ihm->cycled_rule + 1) % ArrayCount(cycled_rules);
+			LifeRule rule;
+			if (parse_life_rule(cycled_rules[ihm->cycled_rule], &rule))
+			{
+				set_cellgrid_rule(gm, rule);
+				pl_debug_print("Rule: %s\n", cycled_rules[ihm->cycled_rule]);
+			}
+		}
+
 		if (pl->input.keys[PL_KEY::LEFT_SHIFT].down)
 		{
 			static WorldPos prev_coords = { INT64MAX, INT64MAX };
@@ -232,11 +306,12 @@ static void update_input_handler(PL* pl, AppMemory* gm)
 						MSlice<WorldPos> cell_list = traverse_grid(prev_coords, screen_coords, &ihm->arena);
 						for (uint32 i = 0; i < cell_list.size; i++)
 						{
-							uint32 slot = hash_pos(cell_list[i], gm->active_table->table.size);
-							LiveCellNode ad = { NULL, cell_list[i], ihm->paint_mode, NULL };
-							append_new_node(gm->active_table, slot, ad);
+							uint64 hash = hash_pos(cell_list[i]);
+							LiveCell ad = { cell_list[i], ihm->paint_mode };
+							append_new_node(gm->active_table, hash, ad);
 						}
 						cell_list.clear(&ihm->arena);
+						mark_cells_edited(gm);
 
 					}
 				}
@@ -246,10 +321,11 @@ static void update_input_handler(PL* pl, AppMemory* gm)
 					MSlice<WorldPos> cell_list = traverse_grid(prev_coords, screen_coords, &ihm->arena);
 					for (uint32 i = 0; i < cell_list.size; i++)
 					{
-						uint32 slot = hash_pos(cell_list[i], gm->active_table->table.size);
-						purge_cell(gm->active_table, slot, cell_list[i]);
+						uint64 hash = hash_pos(cell_list[i]);
+						purge_cell(gm->active_table, hash, cell_list[i]);
 					}
 					cell_list.clear(&ihm->arena);
+					mark_cells_edited(gm);
 				}
 
 				prev_coords = screen_coords;
@@ -265,8 +341,8 @@ static void update_input_handler(PL* pl, AppMemory* gm)
 				WorldPos screen_coords = { (int64)pl->input.mouse.position_x - (pl->window.width / 2),(int64)pl->input.mouse.position_y - (pl->window.height / 2) };
 				screen_coords = screen_to_world(screen_coords, gm->cm);
 
-				uint32 slot = hash_pos(screen_coords, gm->active_table->table.size);
-				LiveCellNode* cell = get_cell(gm->active_table, slot, screen_coords);
+				uint64 hash = hash_pos(screen_coords);
+				LiveCellNode* cell = get_cell(gm->active_table, hash, screen_coords);
 				//add only if state is false (doesn't exist in table). 
 				if (cell == NULL)
 				{
@@ -275,20 +351,22 @@ static void update_input_handler(PL* pl, AppMemory* gm)
 						if (ihm->paint_mode == CellType::SAND)
 						{
 
-							LiveCellNode ad = { NULL, screen_coords, ihm->paint_mode, NULL };
-							append_new_node(gm->active_table, slot, ad);
+							LiveCell ad = { screen_coords, ihm->paint_mode };
+							append_new_node(gm->active_table, hash, ad);
 						}
 						else
 						{
-							LiveCellNode ad = { NULL, screen_coords, ihm->paint_mode, NULL };
-							append_new_node(gm->active_table, slot, ad);
+							LiveCell ad = { screen_coords, ihm->paint_mode };
+							append_new_node(gm->active_table, hash, ad);
 						}
+						mark_cells_edited(gm);
 						//pl_debug_print("Added: [%i, %i]\n", screen_coords.x, screen_coords.y);
 					}
 				}
 				else if (cell->type != ihm->paint_mode)
 				{
-					cell->type = ihm->paint_mode;
+					set_node_type(gm->active_table, cell, ihm->paint_mode);
+					mark_cells_edited(gm);
 				}
 			}
 			else if (pl->input.mouse.right.pressed)	//removing cell
@@ -296,20 +374,55 @@ static void update_input_handler(PL* pl, AppMemory* gm)
 				WorldPos screen_coords = { (int64)pl->input.mouse.position_x - (pl->window.width / 2),(int64)pl->input.mouse.position_y - (pl->window.height / 2) };
 				screen_coords = screen_to_world(screen_coords, gm->cm);
 
-				uint32 slot = hash_pos(screen_coords, gm->active_table->table.size);
+				uint64 hash = hash_pos(screen_coords);
 
-				purge_cell(gm->active_table, slot, screen_coords);
+				purge_cell(gm->active_table, hash, screen_coords);
+				mark_cells_edited(gm);
 			}
 		}
 
 	}
 
 
-	if (!ihm->paused && (pl->time.current_millis >= ihm->prev_update_tick + ihm->update_tick_time) &&(gm->cellgrid_status == CellGridStatus::FINISHED_PROCESSING))
+	if (pl->input.keys[PL_KEY::T].pressed)
+	{
+		ihm->unlimited_fast_forward = !ihm->unlimited_fast_forward;
+		apply_tick_speed(ihm, gm);
+		pl_debug_print("Fast forward: %i\n", ihm->unlimited_fast_forward);
+	}
+	if (pl->input.keys[PL_KEY::O].pressed && ihm->tick_speed > 0)
+	{
+		ihm->tick_speed--;
+		apply_tick_speed(ihm, gm);
+		pl_debug_print("Speed: %u steps/sec\n", tick_speeds[ihm->tick_speed]);
+	}
+	if (pl->input.keys[PL_KEY::P].pressed && ihm->tick_speed + 1 < ArrayCount(tick_speeds))
+	{
+		ihm->tick_speed++;
+		apply_tick_speed(ihm, gm);
+		pl_debug_print("Speed: %u steps/sec\n", tick_speeds[ihm->tick_speed]);
+	}
+
+	if (ihm->paused)
 	{
-		//update grid
-		ihm->prev_update_tick = pl->time.current_millis;
-		gm->cellgrid_status = CellGridStatus::TRIGGER_PROCESSING;
+		ihm->prev_update_time = pl->time.fcurrent_seconds;	//so unpausing doesn't catch up on the time spent paused.
+		ihm->due_steps = 0;
+	}
+	else
+	{
+		//Steps come due at the speed (timed in seconds, so speeds that don't divide a millisecond keep their rate). What a tick can't show yet carries over, up to a second's worth.
+		uint32 speed = tick_speeds[ihm->tick_speed];
+		ihm->due_steps += (pl->time.fcurrent_seconds - ihm->prev_update_time) * speed;
+		ihm->prev_update_time = pl->time.fcurrent_seconds;
+		int32 due = (int32)ihm->due_steps;
+		ihm->due_steps -= due;
+		int32 pending = add_cellgrid_steps(gm, due, (int32)speed);
+
+		//update grid. In fast forward, every frame shows the newest generation.
+		if (gm->cellgrid_status == CellGridStatus::FINISHED_PROCESSING && (pending > 0 || gm->fast_forward != FastForward::OFF))
+		{
+			gm->cellgrid_status = CellGridStatus::TRIGGER_PROCESSING;
+		}
 	}
 
 
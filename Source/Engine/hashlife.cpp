@@ -0,0 +1,638 @@
+#include "grid_engines.h"
+
+//Virtual memory reserved for the node pool and the node map, pages get committed as the pool grows.
+#define HASHLIFE_NODE_RESERVE Gigabytes(8)
+#define HASHLIFE_MAP_RESERVE Gigabytes(2)
+
+//Garbage is collected when the pool doubles since the last collection, but never below this many nodes.
+#define HASHLIFE_MIN_GC_THRESHOLD (Megabytes(24) / sizeof(HLNode))
+
+//NOTE: Quadrants are named by compass direction. North is +y, so the nw child covers the low x, high y quarter of a node.
+//A node of level k covers 2^k x 2^k cells. Leaves are level 3 (8x8 cells packed in a uint64).
+//The root is always centered on the origin, covering [-2^(level-1), 2^(level-1)) on both axes.
+
+static FORCEDINLINE uint64 hash_node(uint64 a, uint64 b, uint32 level)
+{
+	WorldPos key = { (int64)(a ^ ((uint64)level << 58)), (int64)b };
+	return hash_pos(key);
+}
+
+static FORCEDINLINE uint64 hash_node(HLNode* node)
+{
+	if (node->level == HASHLIFE_LEAF_LEVEL)
+	{
+		return hash_node(node->bits, 0, node->level);
+	}
+	return hash_node((uint64)node->nw | ((uint64)node->ne << 32), (uint64)node->sw | ((uint64)node->se << 32), node->level);
+}
+
+static void rebuild_node_map(HashLife* hl, uint32 map_size)
+{
+	if (hl->map.size != 0)
+	{
+		hl->map.clear(&hl->map_arena);
+	}
+	if ((uint64)map_size * sizeof(uint32) > hl->map_arena.capacity)
+	{
+		ERRORBOX("HashLife node map arena is too small!");
+	}
+	commit_arena(&hl->map_arena, (uint64)map_size * sizeof(uint32));
+	hl->map.init_and_allocate(&hl->map_arena, map_size, "HashLife -> node map");
+	pl_buffer_set(hl->map.front, 0, map_size * sizeof(uint32));	//0 is never a valid node.
+
+	uint32 mask = map_size - 1;
+	for (uint32 i = 1; i < hl->nodes.size; i++)
+	{
+		uint32 slot = (uint32)hash_node(&hl->nodes[i]) & mask;
+		while (hl->map[slot] != 0)
+		{
+			slot = (slot + 1) & mask;
+		}
+		hl->map[slot] = i;
+	}
+}
+
+//Returns the canonical node for the given contents, creating it if it doesn't exist yet.
+static uint32 find_or_create_node(HashLife* hl, HLNode* key)
+{
+	uint64 hash = hash_node(key);
+	uint32 mask = hl->map.size - 1;
+	uint32 slot = (uint32)hash & mask;
+	while (hl->map[slot] != 0)
+	{
+		HLNode* node = &hl->nodes[hl->map[slot]];
+		if (node->level == key->level && node->nw == key->nw && node->ne == key->ne && node->sw == key->sw && node->se == key->se)
+		{
+			return hl->map[slot];
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	if ((uint64)(hl->nodes.size + 1) * sizeof(HLNode) > hl->arena.capacity)
+	{
+		ERRORBOX("HashLife node pool is full! The pattern is too big for a single step.");
+	}
+	commit_arena(&hl->arena, sizeof(HLNode));
+	hl->nodes.add(&hl->arena, *key);
+	uint32 index = hl->nodes.size - 1;
+
+	if ((uint64)hl->nodes.size * 2 > hl->map.size)	//keeping the load factor under 0.5
+	{
+		rebuild_node_map(hl, hl->map.size * 2);
+	}
+	else
+	{
+		hl->map[slot] = index;
+	}
+	return index;
+}
+
+static uint32 make_leaf(HashLife* hl, uint64 bits)
+{
+	HLNode key = {};
+	key.bits = bits;
+	key.level = HASHLIFE_LEAF_LEVEL;
+	key.population = popcount_64(bits);
+	return find_or_create_node(hl, &key);
+}
+
+static uint32 make_node(HashLife* hl, uint32 nw, uint32 ne, uint32 sw, uint32 se)
+{
+	HLNode key = {};
+	key.nw = nw;
+	key.ne = ne;
+	key.sw = sw;
+	key.se = se;
+	key.level = hl->nodes[nw].level + 1;
+	key.population = hl->nodes[nw].population + hl->nodes[ne].population + hl->nodes[sw].population + hl->nodes[se].population;
+	return find_or_create_node(hl, &key);
+}
+
+static void create_empty_nodes(HashLife* hl)
+{
+	hl->empty[HASHLIFE_LEAF_LEVEL] = make_leaf(hl, 0);
+	for (uint32 level = HASHLIFE_LEAF_LEVEL + 1; level <= HASHLIFE_MAX_LEVEL; level++)
+	{
+		uint32 e = hl->empty[level - 1];
+		hl->empty[level] = make_node(hl, e, e, e, e);
+	}
+}
+
+//-----------------------------------------
+//Level 4 nodes (16x16 cells) are handled directly at the bit level.
+//Rows are uint32s with bit c being column c (west to east), row 0 being the north most row.
+
+static void node16_to_rows(HashLife* hl, HLNode* node, uint32 rows[16])
+{
+	uint64 nw = hl->nodes[node->nw].bits;
+	uint64 ne = hl->nodes[node->ne].bits;
+	uint64 sw = hl->nodes[node->sw].bits;
+	uint64 se = hl->nodes[node->se].bits;
+	for (uint32 r = 0; r < 8; r++)
+	{
+		rows[r] = (uint32)((nw >> (r * 8)) & 0xFF) | ((uint32)((ne >> (r * 8)) & 0xFF) << 8);
+		rows[r + 8] = (uint32)((sw >> (r * 8)) & 0xFF) | ((uint32)((se >> (r * 8)) & 0xFF) << 8);
+	}
+}
+
+static uint64 center_of_rows(uint32 rows[16])
+{
+	uint64 bits = 0;
+	for (uint32 r = 0; r < 8; r++)
+	{
+		bits |= (uint64)((rows[r + 4] >> 4) & 0xFF) << (r * 8);
+	}
+	return bits;
+}
+
+static FORCEDINLINE void full_add(uint32 a, uint32 b, uint32 c, uint32& sum, uint32& carry)
+{
+	uint32 t = a ^ b;
+	sum = t ^ c;
+	carry = (a & b) | (t & c);
+}
+
+//One generation of a 16x16 grid. Everything outside is treated as dead, so the outer ring of cells goes wrong by one more cell every generation.
+template<typename Rule>
+static void step_rows16(uint32 rows[16], LifeRule life_rule)
+{
+	Rule rule(life_rule);
+	uint32 next[16];
+	for (uint32 r = 0; r < 16; r++)
+	{
+		uint32 up = (r > 0) ? rows[r - 1] : 0;
+		uint32 mid = rows[r];
+		uint32 down = (r < 15) ? rows[r + 1] : 0;
+
+		uint32 up_sum, up_carry;
+		full_add((up << 1) & 0xFFFF, up, up >> 1, up_sum, up_carry);
+		uint32 down_sum, down_carry;
+		full_add((down << 1) & 0xFFFF, down, down >> 1, down_sum, down_carry);
+		uint32 mid_sum = ((mid << 1) & 0xFFFF) ^ (mid >> 1);
+		uint32 mid_carry = ((mid << 1) & 0xFFFF) & (mid >> 1);
+
+		uint32 ones, twos_a;
+		full_add(up_sum, down_sum, mid_sum, ones, twos_a);
+		uint32 twos_b, fours;
+		full_add(up_carry, down_carry, mid_carry, twos_b, fours);
+		uint32 twos = twos_a ^ twos_b;
+		uint32 fours_carry = twos_a & twos_b;
+		uint32 eights = fours & fours_carry;
+		fours ^= fours_carry;
+
+		next[r] = life_rule_next_word(rule, ones, twos, fours, eights, mid) & 0xFFFF;
+	}
+	for (uint32 r = 0; r < 16; r++)
+	{
+		rows[r] = next[r];
+	}
+}
+
+typedef void StepRowsKernel(uint32 rows[16], LifeRule life_rule);
+#define STEP_ROWS_KERNEL(RULE) step_rows16<RULE>,
+static StepRowsKernel* step_rows_kernels[] = { LIFE_RULE_KERNELS(STEP_ROWS_KERNEL) step_rows16<DynamicLifeRule> };
+
+//-----------------------------------------
+
+//The level k-1 node at the center of a level k node.
+static uint32 center_node(HashLife* hl, uint32 index)
+{
+	HLNode* node = &hl->nodes[index];
+	if (node->level == HASHLIFE_LEAF_LEVEL + 1)
+	{
+		uint32 rows[16];
+		node16_to_rows(hl, node, rows);
+		return make_leaf(hl, center_of_rows(rows));
+	}
+	uint32 nw = hl->nodes[node->nw].se;
+	uint32 ne = hl->nodes[node->ne].sw;
+	uint32 sw = hl->nodes[node->sw].ne;
+	uint32 se = hl->nodes[node->se].nw;
+	return make_node(hl, nw, ne, sw, se);
+}
+
+//The RESULT of a level k node: its center level k-1 node, advanced by 2^min(step_log2, k - 2) generations.
+static uint32 node_result(HashLife* hl, uint32 index)
+{
+	HLNode* node = &hl->nodes[index];
+	if (node->result != 0)
+	{
+		return node->result;
+	}
+
+	uint32 level = node->level;
+	uint32 result;
+	if (node->population == 0)
+	{
+		result = hl->empty[level - 1];
+	}
+	else if (level == HASHLIFE_LEAF_LEVEL + 1)
+	{
+		uint32 rows[16];
+		node16_to_rows(hl, node, rows);
+		uint32 generations = (hl->step_log2 < 2) ? (1 << hl->step_log2) : 4;	//at most 4, so the center 8x8 is still exact.
+		StepRowsKernel* step_rows = step_rows_kernels[life_rule_kernel(hl->rule)];
+		for (uint32 i = 0; i < generations; i++)
+		{
+			step_rows(rows, hl->rule);
+		}
+		result = make_leaf(hl, center_of_rows(rows));
+	}
+	else
+	{
+		//the 4x4 grandchildren, row 0 being north.
+		HLNode nw = hl->nodes[node->nw];
+		HLNode ne = hl->nodes[node->ne];
+		HLNode sw = hl->nodes[node->sw];
+		HLNode se = hl->nodes[node->se];
+		uint32 g[4][4] =
+		{
+			{ nw.nw, nw.ne, ne.nw, ne.ne },
+			{ nw.sw, nw.se, ne.sw, ne.se },
+			{ sw.nw, sw.ne, se.nw, se.ne },
+			{ sw.sw, sw.se, se.sw, se.se }
+		};
+
+		//the 9 overlapping level k-1 nodes, either advanced by a quarter of the node (full speed) or just their centers.
+		b32 full_speed = (hl->step_log2 >= level - 2);
+		uint32 m[3][3];
+		for (uint32 r = 0; r < 3; r++)
+		{
+			for (uint32 c = 0; c < 3; c++)
+			{
+				uint32 sub = make_node(hl, g[r][c], g[r][c + 1], g[r + 1][c], g[r + 1][c + 1]);
+				m[r][c] = full_speed ? node_result(hl, sub) : center_node(hl, sub);
+			}
+		}
+
+		uint32 q[2][2];
+		for (uint32 r = 0; r < 2; r++)
+		{
+			for (uint32 c = 0; c < 2; c++)
+			{
+				uint32 sub = make_node(hl, m[r][c], m[r][c + 1], m[r + 1][c], m[r + 1][c + 1]);
+				q[r][c] = node_result(hl, sub);
+			}
+		}
+		result = make_node(hl, q[0][0], q[0][1], q[1][0], q[1][1]);
+	}
+
+	hl->nodes[index].result = result;
+	return result;
+}
+
+//Doubles the root, keeping it centered on the origin.
+static void expand_root(HashLife* hl)
+{
+	HLNode root = hl->nodes[hl->root];
+	if (root.level >= HASHLIFE_MAX_LEVEL)
+	{
+		ERRORBOX("HashLife universe can't grow any further!");
+	}
+	uint32 e = hl->empty[root.level - 1];
+	uint32 nw = make_node(hl, e, e, e, root.nw);
+	uint32 ne = make_node(hl, e, e, root.ne, e);
+	uint32 sw = make_node(hl, e, root.sw, e, e);
+	uint32 se = make_node(hl, root.se, e, e, e);
+	hl->root = make_node(hl, nw, ne, sw, se);
+}
+
+//TRUE if every live cell is in the center 4 of the root's 16 grandchildren.
+static b32 root_is_centered(HashLife* hl)
+{
+	HLNode* root = &hl->nodes[hl->root];
+	uint64 inner = hl->nodes[hl->nodes[root->nw].se].population + hl->nodes[hl->nodes[root->ne].sw].population +
+				   hl->nodes[hl->nodes[root->sw].ne].population + hl->nodes[hl->nodes[root->se].nw].population;
+	return inner == root->population;
+}
+
+//Returns the node with the leaf at (leaf_x, leaf_y) (in leaf units) OR'd with bits. (ox, oy) is the min corner of the node.
+static uint32 set_leaf(HashLife* hl, uint32 index, int64 ox, int64 oy, int64 leaf_x, int64 leaf_y, uint64 bits)
+{
+	HLNode node = hl->nodes[index];
+	if (node.level == HASHLIFE_LEAF_LEVEL)
+	{
+		return make_leaf(hl, node.bits | bits);
+	}
+	int64 half = 1LL << (node.level - 1);
+	int64 x = leaf_x * HASHLIFE_LEAF_SIZE;
+	int64 y = leaf_y * HASHLIFE_LEAF_SIZE;
+	b32 east = (x >= ox + half);
+	b32 north = (y >= oy + half);
+	int64 cx = east ? ox + half : ox;
+	int64 cy = north ? oy + half : oy;
+	if (north)
+	{
+		if (east)	node.ne = set_leaf(hl, node.ne, cx, cy, leaf_x, leaf_y, bits);
+		else		node.nw = set_leaf(hl, node.nw, cx, cy, leaf_x, leaf_y, bits);
+	}
+	else
+	{
+		if (east)	node.se = set_leaf(hl, node.se, cx, cy, leaf_x, leaf_y, bits);
+		else		node.sw = set_leaf(hl, node.sw, cx, cy, leaf_x, leaf_y, bits);
+	}
+	return make_node(hl, node.nw, node.ne, node.sw, node.se);
+}
+
+static void add_leaf(HashLife* hl, int64 leaf_x, int64 leaf_y, uint64 bits)
+{
+	int64 x = leaf_x * HASHLIFE_LEAF_SIZE;
+	int64 y = leaf_y * HASHLIFE_LEAF_SIZE;
+	for (;;)
+	{
+		int64 half = 1LL << (hl->nodes[hl->root].level - 1);
+		if (x >= -half && x < half && y >= -half && y < half)
+		{
+			break;
+		}
+		expand_root(hl);
+	}
+	int64 half = 1LL << (hl->nodes[hl->root].level - 1);
+	hl->root = set_leaf(hl, hl->root, -half, -half, leaf_x, leaf_y, bits);
+}
+
+//-----------------------------------------
+//Garbage collection: keeps every node reachable from the root (through children and memoized results) and the empty nodes, and compacts the pool.
+#define HL_MARK_BIT 0x80000000
+
+static void mark_node(HashLife* hl, uint32 index)
+{
+	if (index == 0)
+	{
+		return;
+	}
+	HLNode* node = &hl->nodes[index];
+	if (node->level & HL_MARK_BIT)
+	{
+		return;
+	}
+	node->level |= HL_MARK_BIT;
+	if ((node->level & ~HL_MARK_BIT) > HASHLIFE_LEAF_LEVEL)
+	{
+		mark_node(hl, node->nw);
+		mark_node(hl, node->ne);
+		mark_node(hl, node->sw);
+		mark_node(hl, node->se);
+	}
+	mark_node(hl, node->result);
+}
+
+static void collect_garbage(HashLife* hl)
+{
+	mark_node(hl, hl->root);
+	for (uint32 level = HASHLIFE_LEAF_LEVEL; level <= HASHLIFE_MAX_LEVEL; level++)
+	{
+		mark_node(hl, hl->empty[level]);
+	}
+
+	//NOTE: The map is rebuilt at the end anyway, so its memory holds the new index of every node in the meantime.
+	ASSERT(hl->map.size >= hl->nodes.size);
+	uint32* new_index = hl->map.front;
+	uint32 kept = 1;
+	new_index[0] = 0;
+	for (uint32 i = 1; i < hl->nodes.size; i++)
+	{
+		new_index[i] = (hl->nodes[i].level & HL_MARK_BIT) ? kept++ : 0;
+	}
+
+	//Children are always created before their parents, so nodes only ever move down and nothing gets overwritten before it's moved.
+	for (uint32 i = 1; i < hl->nodes.size; i++)
+	{
+		HLNode node = hl->nodes[i];
+		if (!(node.level & HL_MARK_BIT))
+		{
+			continue;
+		}
+		node.level &= ~HL_MARK_BIT;
+		if (node.level > HASHLIFE_LEAF_LEVEL)
+		{
+			node.nw = new_index[node.nw];
+			node.ne = new_index[node.ne];
+			node.sw = new_index[node.sw];
+			node.se = new_index[node.se];
+		}
+		node.result = new_index[node.result];
+		hl->nodes[new_index[i]] = node;
+	}
+
+	hl->root = new_index[hl->root];
+	for (uint32 level = HASHLIFE_LEAF_LEVEL; level <= HASHLIFE_MAX_LEVEL; level++)
+	{
+		hl->empty[level] = new_index[hl->empty[level]];
+	}
+
+	MARENA_POP(&hl->arena, (hl->nodes.size - kept) * sizeof(HLNode), "HashLife -> nodes");
+	hl->nodes.size = kept;
+	hl->gc_threshold = (kept * 2 > HASHLIFE_MIN_GC_THRESHOLD) ? kept * 2 : (uint32)HASHLIFE_MIN_GC_THRESHOLD;
+	rebuild_node_map(hl, hl->map.size);
+}
+
+//-----------------------------------------
+
+void init_hashlife(HashLife* hl)
+{
+	reserve_arena(&hl->arena, HASHLIFE_NODE_RESERVE);
+	add_monitoring(&hl->arena);
+
+	reserve_arena(&hl->map_arena, HASHLIFE_MAP_RESERVE);
+	add_monitoring(&hl->map_arena);
+
+	hl->nodes.init(&hl->arena, "HashLife -> nodes");
+	HLNode unused = {};
+	commit_arena(&hl->arena, sizeof(HLNode));
+	hl->nodes.add(&hl->arena, unused);	//index 0 means 'no node'.
+	hl->map.size = 0;
+	rebuild_node_map(hl, 1 << 16);
+
+	hl->step_log2 = 0;
+	hl->results_step_log2 = 0;
+	hl->gc_threshold = (uint32)HASHLIFE_MIN_GC_THRESHOLD;
+	hl->rule = { CONWAY_BIRTH_MASK, CONWAY_SURVIVE_MASK };
+	hl->results_rule = hl->rule;
+	hl->subtree_count = 0;
+	create_empty_nodes(hl);
+	hl->root = hl->empty[HASHLIFE_MIN_ROOT_LEVEL];
+}
+
+void shutdown_hashlife(HashLife* hl)
+{
+	hl->map.clear(&hl->map_arena);
+	hl->nodes.clear(&hl->arena);
+
+	remove_monitoring(&hl->map_arena);
+	release_arena(&hl->map_arena);
+	remove_monitoring(&hl->arena);
+	release_arena(&hl->arena);
+}
+
+void load_hashlife(HashLife* hl, Hashtable* table)
+{
+	hl->root = hl->empty[HASHLIFE_MIN_ROOT_LEVEL];
+
+	//Gathering cells into 8x8 leaves before adding them to the tree. Cells next to each other usually land in the same leaf.
+	b32 has_leaf = FALSE;
+	int64 leaf_x = 0;
+	int64 leaf_y = 0;
+	uint64 bits = 0;
+	LiveCellNode* node = table->node_list.front;
+	for (uint32 i = 0; i < table->node_list.size; i++)
+	{
+		if (node->type == CellType::CONWAY)
+		{
+			WorldPos pos = node_pos(table, node);
+			int64 lx = pos.x >> HASHLIFE_LEAF_LEVEL;
+			int64 ly = pos.y >> HASHLIFE_LEAF_LEVEL;
+			if (!has_leaf || lx != leaf_x || ly != leaf_y)
+			{
+				if (has_leaf)
+				{
+					add_leaf(hl, leaf_x, leaf_y, bits);
+				}
+				has_leaf = TRUE;
+				leaf_x = lx;
+				leaf_y = ly;
+				bits = 0;
+			}
+			uint32 c = (uint32)(pos.x & 7);
+			uint32 r = 7 - (uint32)(pos.y & 7);
+			bits |= 1ULL << (r * 8 + c);
+		}
+		node++;
+	}
+	if (has_leaf)
+	{
+		add_leaf(hl, leaf_x, leaf_y, bits);
+	}
+	collect_garbage(hl);	//throws away all the partial trees built while adding leaves.
+}
+
+void set_hashlife_step_size(HashLife* hl, uint32 step_log2)
+{
+	hl->step_log2 = (step_log2 > HASHLIFE_MAX_STEP_LOG2) ? HASHLIFE_MAX_STEP_LOG2 : step_log2;
+}
+
+void set_hashlife_rule(HashLife* hl, LifeRule rule)
+{
+	hl->rule = rule;
+}
+
+uint64 hashlife_step(HashLife* hl)
+{
+	//memoized results are only valid for the step size and rule they were computed with.
+	if (hl->results_step_log2 != hl->step_log2 || hl->results_rule.birth != hl->rule.birth || hl->results_rule.survive != hl->rule.survive)
+	{
+		for (uint32 i = 1; i < hl->nodes.size; i++)
+		{
+			hl->nodes[i].result = 0;
+		}
+		hl->results_step_log2 = hl->step_log2;
+		hl->results_rule = hl->rule;
+	}
+
+	//The pattern has to be in the center quarter of the root, and the root big enough that the result can hold everything the pattern can grow into.
+	while (hl->nodes[hl->root].level < hl->step_log2 + 3 || !root_is_centered(hl))
+	{
+		expand_root(hl);
+	}
+	expand_root(hl);
+	hl->root = node_result(hl, hl->root);
+
+	if (hl->nodes.size > hl->gc_threshold)
+	{
+		collect_garbage(hl);
+	}
+	return 1ULL << hl->step_log2;
+}
+
+uint64 hashlife_population(HashLife* hl)
+{
+	return hl->nodes[hl->root].population;
+}
+
+//-----------------------------------------
+//Export
+
+void hashlife_prepare_export(HashLife* hl, uint32 wanted_subtrees)
+{
+	if (wanted_subtrees > HASHLIFE_MAX_SUBTREES / 4)
+	{
+		wanted_subtrees = HASHLIFE_MAX_SUBTREES / 4;
+	}
+	int64 half = 1LL << (hl->nodes[hl->root].level - 1);
+	hl->subtrees[0] = { hl->root, -half, -half };
+	hl->subtree_count = (hl->nodes[hl->root].population != 0) ? 1 : 0;
+
+	//splitting the biggest non empty subtrees until there are enough to go around.
+	while (hl->subtree_count != 0 && hl->subtree_count < wanted_subtrees)
+	{
+		HLSubtree split = hl->subtrees[0];
+		HLNode* node = &hl->nodes[split.node];
+		if (node->level == HASHLIFE_LEAF_LEVEL + 1)
+		{
+			break;	//the rest are small enough.
+		}
+		hl->subtrees[0] = hl->subtrees[--hl->subtree_count];
+
+		int64 h = 1LL << (node->level - 1);
+		HLSubtree children[4] =
+		{
+			{ node->nw, split.x, split.y + h },
+			{ node->ne, split.x + h, split.y + h },
+			{ node->sw, split.x, split.y },
+			{ node->se, split.x + h, split.y }
+		};
+		for (uint32 i = 0; i < 4; i++)
+		{
+			if (hl->nodes[children[i].node].population != 0)
+			{
+				hl->subtrees[hl->subtree_count++] = children[i];
+			}
+		}
+
+		//keeping the biggest subtree at the front.
+		for (uint32 i = 1; i < hl->subtree_count; i++)
+		{
+			if (hl->nodes[hl->subtrees[i].node].level > hl->nodes[hl->subtrees[0].node].level)
+			{
+				HLSubtree temp = hl->subtrees[0];
+				hl->subtrees[0] = hl->subtrees[i];
+				hl->subtrees[i] = temp;
+			}
+		}
+	}
+}
+
+static void export_node(HashLife* hl, uint32 index, int64 ox, int64 oy, MSlice<LiveCell>* out, MArena* out_arena)
+{
+	HLNode* node = &hl->nodes[index];
+	if (node->population == 0)
+	{
+		return;
+	}
+	if (node->level == HASHLIFE_LEAF_LEVEL)
+	{
+		commit_arena(out_arena, 64 * sizeof(LiveCell));	//enough for a full leaf.
+		uint64 bits = node->bits;
+		while (bits)
+		{
+			uint32 b = bit_scan_forward_64(bits);
+			LiveCell ad = { { ox + (b & 7), oy + 7 - (b >> 3) }, CellType::CONWAY };
+			out->add(out_arena, ad);
+			bits &= bits - 1;
+		}
+		return;
+	}
+	int64 h = 1LL << (node->level - 1);
+	export_node(hl, node->nw, ox, oy + h, out, out_arena);
+	export_node(hl, node->ne, ox + h, oy + h, out, out_arena);
+	export_node(hl, node->sw, ox, oy, out, out_arena);
+	export_node(hl, node->se, ox + h, oy, out, out_arena);
+}
+
+void hashlife_export_range(HashLife* hl, uint32 begin, uint32 end, MSlice<LiveCell>* out, MArena* out_arena)
+{
+	for (uint32 i = begin; i < end; i++)
+	{
+		export_node(hl, hl->subtrees[i].node, hl->subtrees[i].x, hl->subtrees[i].y, out, out_arena);
+	}
+}
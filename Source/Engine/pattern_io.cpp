@@ -0,0 +1,1394 @@
+#include "app_common.h"
+#include <stdio.h>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//Pattern file import and export (RLE, Life 1.06, plaintext and macrocell).
+//NOTE: Files are read through a read only mapping and parsed in a single pass. The cells go straight into the node list of the active table and are put into the hash table all at once at the end (insert_new_nodes),
+//so the table is sized once and cells aren't looked up one by one while loading.
+//Rows of a pattern file go down the screen, which is +y in the world.
+
+#define PATTERN_NODE_BLOCK 4096				//nodes reserved in the node arena at a time while loading.
+#define PATTERN_WRITE_BUFFER_SIZE Megabytes(1)
+#define PATTERN_RLE_LINE_LENGTH 70
+#define PATTERN_PLAINTEXT_MAX_SIZE 65536	//biggest width or height written as plaintext.
+#define PATTERN_MACROCELL_MAX_LEVEL 62		//keeps the root inside int64 coordinates.
+#define PATTERN_MAX_PATH 1024
+
+//-----------------------------------------
+//File mapping
+
+b32 map_file(const char* path, MappedFile* file)
+{
+	file->data = NULL;
+	file->size = 0;
+	file->file_handle = NULL;
+	file->mapping_handle = NULL;
+
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		return FALSE;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size))
+	{
+		CloseHandle(handle);
+		return FALSE;
+	}
+	if (size.QuadPart != 0)	//empty files can't be mapped.
+	{
+		HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+		void* data = (mapping != NULL) ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		if (data == NULL)
+		{
+			if (mapping != NULL)
+			{
+				CloseHandle(mapping);
+			}
+			CloseHandle(handle);
+			return FALSE;
+		}
+		file->data = (uint8*)data;
+		file->mapping_handle = mapping;
+	}
+	file->size = (uint64)size.QuadPart;
+	file->file_handle = handle;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return FALSE;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0)
+	{
+		close(fd);
+		return FALSE;
+	}
+	if (info.st_size != 0)	//empty files can't be mapped.
+	{
+		void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			close(fd);
+			return FALSE;
+		}
+		madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+		file->data = (uint8*)data;
+	}
+	file->size = (uint64)info.st_size;
+	file->file_handle = (void*)(intptr_t)fd;
+#endif
+	return TRUE;
+}
+
+void unmap_file(MappedFile* file)
+{
+#ifdef _WIN32
+	if (file->data)
+	{
+		UnmapViewOfFile(file->data);
+		CloseHandle((HANDLE)file->mapping_handle);
+	}
+	CloseHandle((HANDLE)file->file_handle);
+#else
+	if (file->data)
+	{
+		munmap(file->data, (size_t)file->size);
+	}
+	close((int)(intptr_t)file->file_handle);
+#endif
+	file->data = NULL;
+	file->size = 0;
+}
+
+//-----------------------------------------
+//Loading
+
+struct PatternReader
+{
+	const uint8* at;
+	const uint8* end;
+};
+
+//Where the cells of a pattern go: appended right after the node list of the table, PATTERN_NODE_BLOCK nodes at a time.
+struct CellSink
+{
+	Hashtable* ht;
+	WorldPos origin;
+	LiveCellNode* cursor;
+	LiveCellNode* reserved_end;
+	WorldPos last_corner;	//table chunk of the last cell.
+	uint32 last_chunk;
+	b32 too_large;
+};
+
+//Two state files have 8x8 leaves (level 3), the cell at row r, column c is bit (r * 8 + c).
+//Multi state files go all the way down to level 1 nodes, which hold the states of their 4 cells instead of children.
+struct MacrocellNode
+{
+	union
+	{
+		uint32 children[4];	//nw, ne, sw, se. 0 is the empty node.
+		uint64 bits;
+	};
+	uint32 level;
+	b32 leaf;
+};
+
+static FORCEDINLINE b32 is_space(uint8 c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static void skip_spaces(PatternReader* r)
+{
+	while (r->at < r->end && is_space(*r->at))
+	{
+		r->at++;
+	}
+}
+
+static void skip_line(PatternReader* r)
+{
+	while (r->at < r->end && *r->at != '\n')
+	{
+		r->at++;
+	}
+	if (r->at < r->end)
+	{
+		r->at++;
+	}
+}
+
+static b32 starts_with(PatternReader* r, const char* text)
+{
+	const uint8* at = r->at;
+	for (; *text; text++, at++)
+	{
+		if (at >= r->end || *at != (uint8)*text)
+		{
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+//Reads an optionally signed decimal number. FALSE if there isn't one or it doesn't fit.
+static b32 read_int64(PatternReader* r, int64* value)
+{
+	b32 negative = FALSE;
+	if (r->at < r->end && (*r->at == '-' || *r->at == '+'))
+	{
+		negative = (*r->at == '-');
+		r->at++;
+	}
+	if (r->at >= r->end || *r->at < '0' || *r->at > '9')
+	{
+		return FALSE;
+	}
+	int64 result = 0;
+	while (r->at < r->end && *r->at >= '0' && *r->at <= '9')
+	{
+		if (result > (INT64MAX - 9) / 10)
+		{
+			return FALSE;
+		}
+		result = result * 10 + (*r->at - '0');
+		r->at++;
+	}
+	*value = negative ? -result : result;
+	return TRUE;
+}
+
+static void begin_sink(CellSink* sink, Hashtable* ht, WorldPos origin)
+{
+	sink->ht = ht;
+	sink->origin = origin;
+	sink->cursor = ht->node_list.front + ht->node_list.size;
+	ASSERT((void*)sink->cursor == MARENA_TOP(&ht->arena));	//the node list is the only thing in its arena.
+	sink->reserved_end = sink->cursor;
+	sink->last_chunk = TABLE_CHUNK_NONE;
+	sink->too_large = FALSE;
+}
+
+static b32 reserve_nodes(CellSink* sink)
+{
+	MArena* arena = &sink->ht->arena;
+	uint64 free_nodes = (arena->capacity - arena->top) / sizeof(LiveCellNode);
+	uint64 count = (free_nodes < PATTERN_NODE_BLOCK) ? free_nodes : PATTERN_NODE_BLOCK;
+	if (count == 0)
+	{
+		sink->too_large = TRUE;
+		return FALSE;
+	}
+	commit_arena(arena, count * sizeof(LiveCellNode));
+	MARENA_PUSH(arena, count * sizeof(LiveCellNode), "HashTable -> live node list");
+	sink->reserved_end += count;
+	return TRUE;
+}
+
+//Nodes the sink can still take before the node arena runs out.
+static uint64 sink_free_nodes(CellSink* sink)
+{
+	MArena* arena = &sink->ht->arena;
+	return (uint64)(sink->reserved_end - sink->cursor) + (arena->capacity - arena->top) / sizeof(LiveCellNode);
+}
+
+static FORCEDINLINE void emit_cell(CellSink* sink, int64 x, int64 y, CellType type)
+{
+	if (sink->cursor == sink->reserved_end && !reserve_nodes(sink))
+	{
+		return;
+	}
+	LiveCell cell = { { sink->origin.x + x, sink->origin.y + y }, type };
+	if (!pack_table_node(sink->ht, cell, &sink->last_corner, &sink->last_chunk, sink->cursor))
+	{
+		sink->too_large = TRUE;	//spread over more chunks than the table can take.
+		return;
+	}
+	sink->cursor++;
+}
+
+//Gives back the reserved nodes that weren't used, and the new ones too if they aren't kept.
+static void end_sink(CellSink* sink, b32 keep)
+{
+	Hashtable* ht = sink->ht;
+	LiveCellNode* kept_end = keep ? sink->cursor : ht->node_list.front + ht->node_list.size;
+	MARENA_POP(&ht->arena, (uint64)(sink->reserved_end - kept_end) * sizeof(LiveCellNode), "HashTable -> live node list");
+	ht->node_list.size = (uint32)(kept_end - ht->node_list.front);
+}
+
+static PatternFormat detect_format(PatternReader* r)
+{
+	PatternReader peek = *r;
+	while (peek.at < peek.end && (is_space(*peek.at) || *peek.at == '\n'))
+	{
+		peek.at++;
+	}
+	if (starts_with(&peek, "[M2]"))
+	{
+		return PatternFormat::MACROCELL;
+	}
+	if (starts_with(&peek, "#Life 1.06"))
+	{
+		return PatternFormat::LIFE_106;
+	}
+	if (peek.at < peek.end && (*peek.at == '!' || *peek.at == '.' || *peek.at == 'O'))
+	{
+		return PatternFormat::PLAINTEXT;
+	}
+	return PatternFormat::RLE;
+}
+
+static PatternResult parse_rle(PatternReader* r, CellSink* sink)
+{
+	//Golly puts the top left corner at (-width / 2, -height / 2) unless the file has a position.
+	int64 x0 = 0;
+	int64 y0 = 0;
+	b32 has_position = FALSE;
+	while (r->at < r->end)
+	{
+		uint8 c = *r->at;
+		if (c == '#')
+		{
+			int64 px;
+			int64 py;
+			if (starts_with(r, "#CXRLE"))
+			{
+				//#CXRLE Pos=x,y
+				while (r->at < r->end && *r->at != '\n' && !starts_with(r, "Pos="))
+				{
+					r->at++;
+				}
+				if (starts_with(r, "Pos="))
+				{
+					r->at += 4;
+					if (read_int64(r, &px) && r->at < r->end && *r->at == ',')
+					{
+						r->at++;
+						if (read_int64(r, &py))
+						{
+							x0 = px;
+							y0 = py;
+							has_position = TRUE;
+						}
+					}
+				}
+			}
+			else if (starts_with(r, "#P") || starts_with(r, "#R"))
+			{
+				//#P x y (top left corner)
+				r->at += 2;
+				skip_spaces(r);
+				if (read_int64(r, &px))
+				{
+					skip_spaces(r);
+					if (read_int64(r, &py))
+					{
+						x0 = px;
+						y0 = py;
+						has_position = TRUE;
+					}
+				}
+			}
+			skip_line(r);
+		}
+		else if (c == 'x')
+		{
+			//x = width, y = height, rule = ... (the rule isn't applied, the grid keeps the one set with set_cellgrid_rule)
+			int64 width = 0;
+			int64 height = 0;
+			r->at++;
+			skip_spaces(r);
+			if (r->at >= r->end || *r->at != '=')
+			{
+				return PatternResult::PARSE_ERROR;
+			}
+			r->at++;
+			skip_spaces(r);
+			if (!read_int64(r, &width))
+			{
+				return PatternResult::PARSE_ERROR;
+			}
+			skip_spaces(r);
+			if (r->at < r->end && *r->at == ',')
+			{
+				r->at++;
+				skip_spaces(r);
+				if (r->at < r->end && *r->at == 'y')
+				{
+					r->at++;
+					skip_spaces(r);
+					if (r->at < r->end && *r->at == '=')
+					{
+						r->at++;
+						skip_spaces(r);
+						read_int64(r, &height);
+					}
+				}
+			}
+			if (!has_position)
+			{
+				x0 = -(width / 2);
+				y0 = -(height / 2);
+			}
+			skip_line(r);
+			break;
+		}
+		else if (is_space(c) || c == '\n')
+		{
+			r->at++;
+		}
+		else
+		{
+			break;	//no header.
+		}
+	}
+
+	int64 x = 0;
+	int64 y = 0;
+	while (r->at < r->end)
+	{
+		uint8 c = *r->at;
+		int64 run = 1;
+		if (c >= '0' && c <= '9')
+		{
+			if (!read_int64(r, &run))
+			{
+				return PatternResult::PARSE_ERROR;
+			}
+			while (r->at < r->end && (is_space(*r->at) || *r->at == '\n'))
+			{
+				r->at++;
+			}
+			if (r->at >= r->end)
+			{
+				return PatternResult::PARSE_ERROR;
+			}
+			c = *r->at;
+		}
+		r->at++;
+
+		if (c == 'b' || c == '.')
+		{
+			x += run;
+		}
+		else if (c == 'o' || (c >= 'A' && c <= 'X'))
+		{
+			//multi state files use A, B, C... for the states after 0. They are the same as the CellType values.
+			uint32 state = (c == 'o') ? (uint32)CellType::CONWAY : (uint32)(c - 'A' + 1);
+			if (state > (uint32)CellType::BRICK)
+			{
+				return PatternResult::PARSE_ERROR;
+			}
+			//NOTE: A run longer than the table can take is refused up front, instead of committing the whole node reserve first.
+			if ((uint64)run > sink_free_nodes(sink))
+			{
+				return PatternResult::TOO_LARGE;
+			}
+			for (int64 i = 0; i < run && !sink->too_large; i++)
+			{
+				emit_cell(sink, x0 + x + i, y0 + y, (CellType)state);
+			}
+			if (sink->too_large)
+			{
+				return PatternResult::TOO_LARGE;
+			}
+			x += run;
+		}
+		else if (c == '$')
+		{
+			y += run;
+			x = 0;
+		}
+		else if (c == '!')
+		{
+			break;
+		}
+		else if (!is_space(c) && c != '\n')
+		{
+			return PatternResult::PARSE_ERROR;
+		}
+	}
+	return PatternResult::OK;
+}
+
+static PatternResult parse_life_106(PatternReader* r, CellSink* sink)
+{
+	while (r->at < r->end)
+	{
+		skip_spaces(r);
+		if (r->at >= r->end)
+		{
+			break;
+		}
+		if (*r->at == '#' || *r->at == '\n')
+		{
+			skip_line(r);
+			continue;
+		}
+
+		int64 x;
+		int64 y;
+		if (!read_int64(r, &x))
+		{
+			return PatternResult::PARSE_ERROR;
+		}
+		skip_spaces(r);
+		if (!read_int64(r, &y))
+		{
+			return PatternResult::PARSE_ERROR;
+		}
+		emit_cell(sink, x, y, CellType::CONWAY);
+		if (sink->too_large)
+		{
+			return PatternResult::TOO_LARGE;
+		}
+		skip_line(r);
+	}
+	return PatternResult::OK;
+}
+
+static PatternResult parse_plaintext(PatternReader* r, CellSink* sink)
+{
+	int64 x = 0;
+	int64 y = 0;
+	while (r->at < r->end)
+	{
+		if (x == 0 && *r->at == '!')
+		{
+			skip_line(r);
+			continue;
+		}
+
+		uint8 c = *r->at;
+		r->at++;
+		if (c == 'O' || c == '*')
+		{
+			emit_cell(sink, x, y, CellType::CONWAY);
+			if (sink->too_large)
+			{
+				return PatternResult::TOO_LARGE;
+			}
+			x++;
+		}
+		else if (c == '.')
+		{
+			x++;
+		}
+		else if (c == '\n')
+		{
+			x = 0;
+			y++;
+		}
+		else if (!is_space(c))
+		{
+			return PatternResult::PARSE_ERROR;
+		}
+	}
+	return PatternResult::OK;
+}
+
+static void expand_macrocell_node(MacrocellNode* nodes, uint32 index, int64 x, int64 y, CellSink* sink)
+{
+	if (index == 0 || sink->too_large)
+	{
+		return;
+	}
+	MacrocellNode* node = &nodes[index];
+	if (node->leaf)
+	{
+		uint64 bits = node->bits;
+		while (bits)
+		{
+			uint32 b = bit_scan_forward_64(bits);
+			emit_cell(sink, x + (b & 7), y + (b >> 3), CellType::CONWAY);
+			bits &= bits - 1;
+		}
+		return;
+	}
+	if (node->level == 1)
+	{
+		for (uint32 i = 0; i < 4; i++)
+		{
+			if (node->children[i] != 0)
+			{
+				emit_cell(sink, x + (i & 1), y + (i >> 1), (CellType)node->children[i]);
+			}
+		}
+		return;
+	}
+	int64 h = 1LL << (node->level - 1);
+	expand_macrocell_node(nodes, node->children[0], x, y, sink);
+	expand_macrocell_node(nodes, node->children[1], x + h, y, sink);
+	expand_macrocell_node(nodes, node->children[2], x, y + h, sink);
+	expand_macrocell_node(nodes, node->children[3], x + h, y + h, sink);
+}
+
+static PatternResult parse_macrocell_nodes(PatternReader* r, MSlice<MacrocellNode>* nodes, MArena* scratch)
+{
+	while (r->at < r->end)
+	{
+		skip_spaces(r);
+		if (r->at >= r->end)
+		{
+			break;
+		}
+		uint8 c = *r->at;
+		if (c == '#' || c == '\n')
+		{
+			skip_line(r);
+			continue;
+		}
+		if (scratch->top + sizeof(MacrocellNode) > scratch->capacity)
+		{
+			return PatternResult::TOO_LARGE;
+		}
+
+		MacrocellNode node = {};
+		if (c == '.' || c == '*' || c == '$')
+		{
+			//8x8 leaf: '.' is dead, '*' is alive, '$' ends a row.
+			node.level = 3;
+			node.leaf = TRUE;
+			uint32 row = 0;
+			uint32 column = 0;
+			while (r->at < r->end && (*r->at == '.' || *r->at == '*' || *r->at == '$'))
+			{
+				c = *r->at;
+				r->at++;
+				if (c == '$')
+				{
+					row++;
+					column = 0;
+					continue;
+				}
+				if (row >= 8 || column >= 8)
+				{
+					return PatternResult::PARSE_ERROR;
+				}
+				if (c == '*')
+				{
+					node.bits |= 1ULL << (row * 8 + column);
+				}
+				column++;
+			}
+		}
+		else
+		{
+			//level nw ne sw se
+			int64 values[5];
+			for (uint32 i = 0; i < 5; i++)
+			{
+				skip_spaces(r);
+				if (!read_int64(r, &values[i]) || values[i] < 0)
+				{
+					return PatternResult::PARSE_ERROR;
+				}
+			}
+			if (values[0] < 1 || values[0] > PATTERN_MACROCELL_MAX_LEVEL)
+			{
+				return PatternResult::PARSE_ERROR;
+			}
+			node.level = (uint32)values[0];
+			for (uint32 i = 0; i < 4; i++)
+			{
+				int64 child = values[i + 1];
+				if (node.level == 1)
+				{
+					if (child > (int64)CellType::BRICK)
+					{
+						return PatternResult::PARSE_ERROR;	//state that isn't a cell type.
+					}
+				}
+				else if (child >= nodes->size || (child != 0 && nodes->front[child].level != node.level - 1))
+				{
+					return PatternResult::PARSE_ERROR;	//children have to be listed before their parents, one level down.
+				}
+				node.children[i] = (uint32)child;
+			}
+		}
+		nodes->add(scratch, node);
+		skip_line(r);
+	}
+	return PatternResult::OK;
+}
+
+static PatternResult parse_macrocell(PatternReader* r, CellSink* sink, MArena* scratch)
+{
+	if (!starts_with(r, "[M2]"))
+	{
+		return PatternResult::PARSE_ERROR;
+	}
+	skip_line(r);
+
+	MSlice<MacrocellNode> nodes;
+	nodes.init(scratch, "Macrocell nodes");
+	if (scratch->top + sizeof(MacrocellNode) > scratch->capacity)
+	{
+		return PatternResult::TOO_LARGE;
+	}
+	MacrocellNode empty = {};
+	nodes.add(scratch, empty);	//index 0 is the empty node.
+
+	PatternResult result = parse_macrocell_nodes(r, &nodes, scratch);
+	if (result == PatternResult::OK && nodes.size > 1)
+	{
+		//The last node is the root, centered on the origin.
+		uint32 root = nodes.size - 1;
+		int64 half = (nodes[root].level > 0) ? (1LL << (nodes[root].level - 1)) : 0;
+		expand_macrocell_node(nodes.front, root, -half, -half, sink);
+		if (sink->too_large)
+		{
+			result = PatternResult::TOO_LARGE;
+		}
+	}
+	nodes.clear(scratch);
+	return result;
+}
+
+PatternResult load_pattern(AppMemory* gm, const char* path, PatternFormat format, WorldPos origin, MArena* scratch)
+{
+	MappedFile file;
+	if (!map_file(path, &file))
+	{
+		return PatternResult::FILE_ERROR;
+	}
+	PatternReader reader = { file.data, file.data + file.size };
+	if (format == PatternFormat::AUTO)
+	{
+		format = detect_format(&reader);
+	}
+
+	Hashtable* ht = gm->active_table;
+	uint32 first_new_node = ht->node_list.size;
+	CellSink sink;
+	begin_sink(&sink, ht, origin);
+
+	PatternResult result = PatternResult::PARSE_ERROR;
+	switch (format)
+	{
+	case PatternFormat::RLE:
+		result = parse_rle(&reader, &sink);
+		break;
+	case PatternFormat::LIFE_106:
+		result = parse_life_106(&reader, &sink);
+		break;
+	case PatternFormat::PLAINTEXT:
+		result = parse_plaintext(&reader, &sink);
+		break;
+	case PatternFormat::MACROCELL:
+		result = parse_macrocell(&reader, &sink, scratch);
+		break;
+	default:
+		break;
+	}
+	end_sink(&sink, result == PatternResult::OK);
+	unmap_file(&file);
+
+	if (result == PatternResult::OK)
+	{
+		//Life 1.06 files can list a cell more than once, and anything loaded next to other cells can land on them.
+		b32 check_duplicates = (format == PatternFormat::LIFE_106) || (first_new_node != 0);
+		insert_new_nodes(ht, first_new_node, check_duplicates);
+		mark_cells_edited(gm);
+	}
+	return result;
+}
+
+//-----------------------------------------
+//Saving
+
+struct PatternCell
+{
+	WorldPos pos;
+	CellType type;
+};
+
+//Buffers the output and writes it to the file in big blocks.
+struct PatternWriter
+{
+	FILE* file;
+	uint8* buffer;
+	uint32 used;
+	uint32 line_length;	//since the last '\n' written with write_char. rle lines are wrapped.
+	b32 failed;
+	char rule[32];		//rulestring of the grid, for the two state formats that carry one.
+};
+
+//Hash consing table of the macrocell writer. A node is written out the first time it's seen, so its index is its line number.
+struct MacrocellWriter
+{
+	PatternWriter* writer;
+	MSlice<MacrocellNode> nodes;	//allocated up front, node_count of them are used.
+	MSlice<uint32> map;		//open addressing (linear probing) from node contents to index in nodes. 0 is empty.
+	uint32 node_count;
+	uint32 leaf_level;		//3 (8x8 leaves) for two state patterns, 1 for multi state ones.
+	b32 too_large;
+};
+
+static void flush_writer(PatternWriter* w)
+{
+	if (w->used != 0 && fwrite(w->buffer, 1, w->used, w->file) != w->used)
+	{
+		w->failed = TRUE;
+	}
+	w->used = 0;
+}
+
+static void write_bytes(PatternWriter* w, const char* bytes, uint32 count)
+{
+	if (w->used + count > PATTERN_WRITE_BUFFER_SIZE)
+	{
+		flush_writer(w);
+	}
+	pl_buffer_copy(w->buffer + w->used, (void*)bytes, count);
+	w->used += count;
+	w->line_length += count;
+}
+
+static FORCEDINLINE void write_char(PatternWriter* w, char c)
+{
+	if (w->used == PATTERN_WRITE_BUFFER_SIZE)
+	{
+		flush_writer(w);
+	}
+	w->buffer[w->used++] = (uint8)c;
+	w->line_length = (c == '\n') ? 0 : w->line_length + 1;
+}
+
+static void write_string(PatternWriter* w, const char* text)
+{
+	uint32 length = 0;
+	while (text[length])
+	{
+		length++;
+	}
+	write_bytes(w, text, length);
+}
+
+//Formats the number into text, returns its length.
+static uint32 format_int64(char* text, int64 value)
+{
+	char digits[24];
+	uint32 count = 0;
+	uint64 magnitude = (value < 0) ? (uint64)0 - (uint64)value : (uint64)value;
+	do
+	{
+		digits[count++] = (char)('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude);
+
+	uint32 length = 0;
+	if (value < 0)
+	{
+		text[length++] = '-';
+	}
+	while (count)
+	{
+		text[length++] = digits[--count];
+	}
+	return length;
+}
+
+static void write_int64(PatternWriter* w, int64 value)
+{
+	char text[24];
+	write_bytes(w, text, format_int64(text, value));
+}
+
+static FORCEDINLINE b32 cell_before(PatternCell* a, PatternCell* b)
+{
+	return (a->pos.y < b->pos.y) || (a->pos.y == b->pos.y && a->pos.x < b->pos.x);
+}
+
+//In place quick sort by row, then column. Recursing into the smaller side keeps the stack depth at log(n).
+static void sort_cells(PatternCell* cells, uint32 count)
+{
+	while (count > 16)
+	{
+		//median of three as the pivot.
+		PatternCell* a = &cells[0];
+		PatternCell* b = &cells[count / 2];
+		PatternCell* c = &cells[count - 1];
+		PatternCell* median = cell_before(a, b) ? (cell_before(b, c) ? b : (cell_before(a, c) ? c : a)) : (cell_before(a, c) ? a : (cell_before(b, c) ? c : b));
+		PatternCell pivot = *median;
+
+		int64 i = -1;
+		int64 j = count;
+		for (;;)
+		{
+			do { i++; } while (cell_before(&cells[i], &pivot));
+			do { j--; } while (cell_before(&pivot, &cells[j]));
+			if (i >= j)
+			{
+				break;
+			}
+			PatternCell temp = cells[i];
+			cells[i] = cells[j];
+			cells[j] = temp;
+		}
+
+		uint32 left = (uint32)(j + 1);
+		if (left < count - left)
+		{
+			sort_cells(cells, left);
+			cells += left;
+			count -= left;
+		}
+		else
+		{
+			sort_cells(cells + left, count - left);
+			count = left;
+		}
+	}
+
+	for (uint32 i = 1; i < count; i++)
+	{
+		PatternCell cell = cells[i];
+		uint32 j = i;
+		while (j > 0 && cell_before(&cell, &cells[j - 1]))
+		{
+			cells[j] = cells[j - 1];
+			j--;
+		}
+		cells[j] = cell;
+	}
+}
+
+//Copies the live cells of the table into the scratch arena. FALSE if they don't fit.
+static b32 gather_cells(Hashtable* ht, MSlice<PatternCell>* cells, MArena* scratch, b32* multistate)
+{
+	uint32 live = 0;
+	for (uint32 i = 0; i < ht->node_list.size; i++)
+	{
+		live += (ht->node_list[i].type != CellType::EMPTY);
+	}
+	if (scratch->top + (uint64)live * sizeof(PatternCell) > scratch->capacity)
+	{
+		return FALSE;
+	}
+
+	cells->init_and_allocate(scratch, live, "Pattern export cells");
+	PatternCell* out = cells->front;
+	*multistate = FALSE;
+	LiveCellNode* node = ht->node_list.front;
+	for (uint32 i = 0; i < ht->node_list.size; i++)
+	{
+		if (node->type != CellType::EMPTY)
+		{
+			*out = { node_pos(ht, node), node->type };
+			*multistate |= (node->type != CellType::CONWAY);
+			out++;
+		}
+		node++;
+	}
+	return TRUE;
+}
+
+//Leftmost and rightmost column of the cells. (max < min if there are none)
+static void column_range(PatternCell* cells, uint32 count, int64* min_x, int64* max_x)
+{
+	*min_x = count ? cells[0].pos.x : 0;
+	*max_x = count ? cells[0].pos.x : -1;
+	for (uint32 i = 1; i < count; i++)
+	{
+		*min_x = (cells[i].pos.x < *min_x) ? cells[i].pos.x : *min_x;
+		*max_x = (cells[i].pos.x > *max_x) ? cells[i].pos.x : *max_x;
+	}
+}
+
+static void write_rle_run(PatternWriter* w, int64 run, char tag)
+{
+	char text[24];
+	uint32 length = (run > 1) ? format_int64(text, run) : 0;
+	text[length++] = tag;
+	if (w->line_length != 0 && w->line_length + length > PATTERN_RLE_LINE_LENGTH)
+	{
+		write_char(w, '\n');
+	}
+	write_bytes(w, text, length);
+}
+
+static void write_rle(PatternWriter* w, PatternCell* cells, uint32 count, b32 multistate)
+{
+	int64 min_x;
+	int64 max_x;
+	column_range(cells, count, &min_x, &max_x);
+	int64 min_y = count ? cells[0].pos.y : 0;
+	int64 max_y = count ? cells[count - 1].pos.y : -1;
+
+	//golly's extended RLE keeps the position of the top left corner.
+	write_string(w, "#CXRLE Pos=");
+	write_int64(w, min_x);
+	write_char(w, ',');
+	write_int64(w, min_y);
+	write_string(w, "\nx = ");
+	write_int64(w, max_x - min_x + 1);
+	write_string(w, ", y = ");
+	write_int64(w, max_y - min_y + 1);
+	if (!multistate)
+	{
+		write_string(w, ", rule = ");
+		write_string(w, w->rule);
+	}
+	write_char(w, '\n');
+
+	int64 row = min_y;
+	int64 column = min_x;
+	uint32 i = 0;
+	while (i < count)
+	{
+		PatternCell* cell = &cells[i];
+		if (cell->pos.y != row)
+		{
+			write_rle_run(w, cell->pos.y - row, '$');
+			row = cell->pos.y;
+			column = min_x;
+		}
+		if (cell->pos.x != column)
+		{
+			write_rle_run(w, cell->pos.x - column, multistate ? '.' : 'b');
+		}
+
+		//run of touching cells of the same type.
+		uint32 run = 1;
+		while (i + run < count && cells[i + run].pos.y == row && cells[i + run].pos.x == cell->pos.x + run && cells[i + run].type == cell->type)
+		{
+			run++;
+		}
+		write_rle_run(w, run, multistate ? (char)('A' + (uint32)cell->type - 1) : 'o');
+		column = cell->pos.x + run;
+		i += run;
+	}
+	write_string(w, "!\n");
+}
+
+static PatternResult write_life_106(PatternWriter* w, Hashtable* ht)
+{
+	write_string(w, "#Life 1.06\n");
+	LiveCellNode* node = ht->node_list.front;
+	for (uint32 i = 0; i < ht->node_list.size; i++)
+	{
+		if (node->type != CellType::EMPTY && node->type != CellType::CONWAY)
+		{
+			return PatternResult::NOT_TWO_STATE;
+		}
+		if (node->type != CellType::EMPTY)
+		{
+			WorldPos pos = node_pos(ht, node);
+			write_int64(w, pos.x);
+			write_char(w, ' ');
+			write_int64(w, pos.y);
+			write_char(w, '\n');
+		}
+		node++;
+	}
+	return PatternResult::OK;
+}
+
+static PatternResult write_plaintext(PatternWriter* w, PatternCell* cells, uint32 count)
+{
+	int64 min_x;
+	int64 max_x;
+	column_range(cells, count, &min_x, &max_x);
+	if (count && ((uint64)(max_x - min_x) >= PATTERN_PLAINTEXT_MAX_SIZE || (uint64)(cells[count - 1].pos.y - cells[0].pos.y) >= PATTERN_PLAINTEXT_MAX_SIZE))
+	{
+		return PatternResult::TOO_LARGE;
+	}
+
+	//NOTE: Plaintext has no position, it loads back with its top left corner at the origin.
+	write_string(w, "!Name: Infinity Automata export\n");
+	int64 row = count ? cells[0].pos.y : 0;
+	int64 column = min_x;
+	for (uint32 i = 0; i < count; i++)
+	{
+		while (row < cells[i].pos.y)
+		{
+			write_char(w, '\n');
+			row++;
+			column = min_x;
+		}
+		for (; column < cells[i].pos.x; column++)
+		{
+			write_char(w, '.');
+		}
+		write_char(w, 'O');
+		column++;
+	}
+	if (count)
+	{
+		write_char(w, '\n');
+	}
+	return PatternResult::OK;
+}
+
+static FORCEDINLINE uint64 hash_macrocell_node(MacrocellNode* node)
+{
+	WorldPos key = { (int64)((uint64)node->children[0] | ((uint64)node->children[1] << 32)), (int64)(((uint64)node->children[2] | ((uint64)node->children[3] << 32)) ^ node->level) };
+	return hash_pos(key);
+}
+
+//Returns the index of the node, writing it out if it's new.
+static uint32 find_or_write_node(MacrocellWriter* mw, MacrocellNode* key)
+{
+	uint32 mask = mw->map.size - 1;
+	uint32 slot = (uint32)hash_macrocell_node(key) & mask;
+	while (mw->map[slot] != 0)
+	{
+		MacrocellNode* node = &mw->nodes[mw->map[slot]];
+		if (node->level == key->level && node->children[0] == key->children[0] && node->children[1] == key->children[1] && node->children[2] == key->children[2] && node->children[3] == key->children[3])
+		{
+			return mw->map[slot];
+		}
+		slot = (slot + 1) & mask;
+	}
+	if (mw->node_count == mw->nodes.size)
+	{
+		mw->too_large = TRUE;
+		return 0;
+	}
+	uint32 index = mw->node_count++;
+	mw->nodes[index] = *key;
+	mw->map[slot] = index;
+
+	PatternWriter* w = mw->writer;
+	if (key->leaf)
+	{
+		//rows up to the last one with a live cell, each ending in '$'.
+		for (uint32 r = 0; r < 8 && (key->bits >> (r * 8)) != 0; r++)
+		{
+			uint32 row = (uint32)(key->bits >> (r * 8)) & 0xFF;
+			for (uint32 c = 0; row >> c; c++)
+			{
+				write_char(w, ((row >> c) & 1) ? '*' : '.');
+			}
+			write_char(w, '$');
+		}
+		write_char(w, '\n');
+	}
+	else
+	{
+		write_int64(w, key->level);
+		for (uint32 i = 0; i < 4; i++)
+		{
+			write_char(w, ' ');
+			write_int64(w, key->children[i]);
+		}
+		write_char(w, '\n');
+	}
+	return index;
+}
+
+//Moves the cells for which below_limit is true to the front. Returns how many there are.
+static uint32 partition_cells(PatternCell* cells, uint32 count, b32 by_x, int64 limit)
+{
+	uint32 front = 0;
+	for (uint32 i = 0; i < count; i++)
+	{
+		int64 value = by_x ? cells[i].pos.x : cells[i].pos.y;
+		if (value < limit)
+		{
+			PatternCell temp = cells[front];
+			cells[front] = cells[i];
+			cells[i] = temp;
+			front++;
+		}
+	}
+	return front;
+}
+
+//Builds the node covering [x, x + 2^level) x [y, y + 2^level) from the cells in it. Children are written before their parents.
+static uint32 write_macrocell_node(MacrocellWriter* mw, PatternCell* cells, uint32 count, int64 x, int64 y, uint32 level)
+{
+	if (count == 0 || mw->too_large)
+	{
+		return 0;
+	}
+
+	MacrocellNode key = {};
+	key.level = level;
+	if (level == mw->leaf_level && level == 3)
+	{
+		key.leaf = TRUE;
+		for (uint32 i = 0; i < count; i++)
+		{
+			key.bits |= 1ULL << ((cells[i].pos.y - y) * 8 + (cells[i].pos.x - x));
+		}
+	}
+	else if (level == 1)
+	{
+		for (uint32 i = 0; i < count; i++)
+		{
+			key.children[(cells[i].pos.y - y) * 2 + (cells[i].pos.x - x)] = (uint32)cells[i].type;
+		}
+	}
+	else
+	{
+		int64 h = 1LL << (level - 1);
+		uint32 top = partition_cells(cells, count, FALSE, y + h);
+		uint32 top_west = partition_cells(cells, top, TRUE, x + h);
+		uint32 bottom_west = partition_cells(cells + top, count - top, TRUE, x + h);
+		key.children[0] = write_macrocell_node(mw, cells, top_west, x, y, level - 1);
+		key.children[1] = write_macrocell_node(mw, cells + top_west, top - top_west, x + h, y, level - 1);
+		key.children[2] = write_macrocell_node(mw, cells + top, bottom_west, x, y + h, level - 1);
+		key.children[3] = write_macrocell_node(mw, cells + top + bottom_west, count - top - bottom_west, x + h, y + h, level - 1);
+	}
+	return find_or_write_node(mw, &key);
+}
+
+static PatternResult write_macrocell(PatternWriter* w, PatternCell* cells, uint32 count, b32 multistate, MArena* scratch)
+{
+	MacrocellWriter mw;
+	mw.writer = w;
+	mw.leaf_level = multistate ? 1 : 3;
+	mw.too_large = FALSE;
+
+	//The root is centered on the origin, so it has to be big enough to reach the cell furthest from it.
+	uint32 root_level = mw.leaf_level;
+	for (uint32 i = 0; i < count; i++)
+	{
+		WorldPos pos = cells[i].pos;
+		while (root_level <= PATTERN_MACROCELL_MAX_LEVEL)
+		{
+			int64 half = 1LL << (root_level - 1);
+			if (pos.x >= -half && pos.x < half && pos.y >= -half && pos.y < half)
+			{
+				break;
+			}
+			root_level++;
+		}
+		if (root_level > PATTERN_MACROCELL_MAX_LEVEL)
+		{
+			return PatternResult::TOO_LARGE;
+		}
+	}
+
+	//A sparse pattern needs a node per cell on every level from the leaves up to the root, a dense one far fewer. Sized for the worst case, as far as the scratch arena goes,
+	//with the map at a load factor of 0.5. The rest of the scratch arena can't be used once the map is after the nodes.
+	uint64 wanted_nodes = (uint64)count * (root_level - mw.leaf_level + 1) + 256;
+	uint64 map_size = 1024;
+	while (map_size < wanted_nodes * 2 && map_size < (1ULL << 31))
+	{
+		map_size <<= 1;
+	}
+	while (map_size > 1024 && scratch->top + (map_size / 2) * sizeof(MacrocellNode) + map_size * sizeof(uint32) > scratch->capacity)
+	{
+		map_size >>= 1;
+	}
+	uint64 bytes = (map_size / 2) * sizeof(MacrocellNode) + map_size * sizeof(uint32);
+	if (scratch->top + bytes > scratch->capacity)
+	{
+		return PatternResult::TOO_LARGE;
+	}
+	mw.nodes.init_and_allocate(scratch, (uint32)(map_size / 2), "Macrocell export nodes");
+	mw.map.init_and_allocate(scratch, (uint32)map_size, "Macrocell export node map");
+	pl_buffer_set(mw.map.front, 0, map_size * sizeof(uint32));
+	mw.node_count = 1;	//index 0 is the empty node.
+
+	write_string(w, "[M2] (Infinity Automata)\n");
+	if (!multistate)
+	{
+		write_string(w, "#R ");
+		write_string(w, w->rule);
+		write_char(w, '\n');
+	}
+	int64 half = 1LL << (root_level - 1);
+	write_macrocell_node(&mw, cells, count, -half, -half, root_level);
+
+	mw.map.clear(scratch);
+	mw.nodes.clear(scratch);
+	return mw.too_large ? PatternResult::TOO_LARGE : PatternResult::OK;
+}
+
+static PatternFormat format_from_extension(const char* path)
+{
+	const char* extension = NULL;
+	for (const char* c = path; *c; c++)
+	{
+		if (*c == '.')
+		{
+			extension = c + 1;
+		}
+	}
+	if (extension)
+	{
+		PatternReader r = { (const uint8*)extension, (const uint8*)extension + 8 };
+		if (starts_with(&r, "mc"))
+		{
+			return PatternFormat::MACROCELL;
+		}
+		if (starts_with(&r, "lif"))
+		{
+			return PatternFormat::LIFE_106;
+		}
+		if (starts_with(&r, "cells"))
+		{
+			return PatternFormat::PLAINTEXT;
+		}
+	}
+	return PatternFormat::RLE;
+}
+
+//Moves the file at from over the one at to (if any).
+static b32 replace_file(const char* from, const char* to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+PatternResult save_pattern(AppMemory* gm, const char* path, PatternFormat format, MArena* scratch)
+{
+	if (format == PatternFormat::AUTO)
+	{
+		format = format_from_extension(path);
+	}
+	if (scratch->top + PATTERN_WRITE_BUFFER_SIZE > scratch->capacity)
+	{
+		return PatternResult::TOO_LARGE;
+	}
+
+	//NOTE: Written next to path first, and only moved over it once everything is written, so a failed save leaves the old file alone.
+	char temp_path[PATTERN_MAX_PATH];
+	int32 temp_length = snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+	if (temp_length < 0 || temp_length >= (int32)sizeof(temp_path))
+	{
+		return PatternResult::FILE_ERROR;
+	}
+
+	PatternWriter writer;
+#ifdef _MSC_VER
+	if (fopen_s(&writer.file, temp_path, "wb") != 0)
+	{
+		writer.file = NULL;
+	}
+#else
+	writer.file = fopen(temp_path, "wb");
+#endif
+	if (writer.file == NULL)
+	{
+		return PatternResult::FILE_ERROR;
+	}
+	writer.buffer = (uint8*)MARENA_PUSH(scratch, PATTERN_WRITE_BUFFER_SIZE, "Pattern write buffer");
+	writer.used = 0;
+	writer.line_length = 0;
+	writer.failed = FALSE;
+	format_life_rule(get_cellgrid_rule(gm), writer.rule, sizeof(writer.rule));
+
+	Hashtable* ht = gm->active_table;
+	PatternResult result = PatternResult::OK;
+	if (format == PatternFormat::LIFE_106)
+	{
+		result = write_life_106(&writer, ht);	//no particular order needed.
+	}
+	else
+	{
+		MSlice<PatternCell> cells;
+		b32 multistate;
+		if (!gather_cells(ht, &cells, scratch, &multistate))
+		{
+			result = PatternResult::TOO_LARGE;
+		}
+		else if (format == PatternFormat::PLAINTEXT && multistate)
+		{
+			result = PatternResult::NOT_TWO_STATE;
+			cells.clear(scratch);
+		}
+		else
+		{
+			if (format == PatternFormat::MACROCELL)
+			{
+				result = write_macrocell(&writer, cells.front, cells.size, multistate, scratch);
+			}
+			else
+			{
+				sort_cells(cells.front, cells.size);
+				if (format == PatternFormat::PLAINTEXT)
+				{
+					result = write_plaintext(&writer, cells.front, cells.size);
+				}
+				else
+				{
+					write_rle(&writer, cells.front, cells.size, multistate);
+				}
+			}
+			cells.clear(scratch);
+		}
+	}
+
+	flush_writer(&writer);
+	if (fclose(writer.file) != 0)
+	{
+		writer.failed = TRUE;
+	}
+	MARENA_POP(scratch, PATTERN_WRITE_BUFFER_SIZE, "Pattern write buffer");
+	if (result == PatternResult::OK && writer.failed)
+	{
+		result = PatternResult::FILE_ERROR;
+	}
+	if (result == PatternResult::OK && !replace_file(temp_path, path))
+	{
+		result = PatternResult::FILE_ERROR;
+	}
+	if (result != PatternResult::OK)
+	{
+		remove(temp_path);	//not leaving a partial file behind.
+	}
+	return result;
+}
@@ -0,0 +1,284 @@
+#include "render_kernels.h"
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+//NOTE: MSVC lets any function use any instruction set. GCC and Clang need the wider ones enabled per function.
+#ifdef _MSC_VER
+#define SIMD_TARGET(isa)
+#else
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#ifndef RENDER_SIMD_LEVEL
+#define RENDER_SIMD_LEVEL 2
+#endif
+
+RenderKernels render_kernels;
+
+static FORCEDINLINE void worldpos_tail(int64* out, uint32 count, f32 x, f32 scale, f32 sub_world_x, int64 world_center_x)
+{
+	for (uint32 i = 0; i < count; i++)
+	{
+		out[i] = f32_to_int64(x * scale + sub_world_x) + world_center_x;
+		x++;
+	}
+}
+
+//-----------------------------------------
+//SSE2 (4 wide)
+
+static void worldpos_row_sse2(int64* out, uint32 count, f32 x_start, f32 scale, f32 sub_world_x, int64 world_center_x)
+{
+	__m128 sequential_4x = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	__m128 scale_4x = _mm_set1_ps(scale);
+	__m128 sub_world_4x = _mm_set1_ps(sub_world_x);
+	__m128i center_2x = _mm_set1_epi64x(world_center_x);
+
+	uint32 rounded_count = count & ~3u;
+	f32 x = x_start;
+	for (uint32 i = 0; i < rounded_count; i += 4)
+	{
+		__m128 x_4x = _mm_add_ps(_mm_set1_ps(x), sequential_4x);
+		x_4x = _mm_add_ps(_mm_mul_ps(x_4x, scale_4x), sub_world_4x);
+		__m128i int_4x = _mm_cvtps_epi32(x_4x);	//rounds to nearest.
+
+		//sign extending the 4 int32s into 2 + 2 int64s.
+		__m128i sign_4x = _mm_srai_epi32(int_4x, 31);
+		__m128i low_2x = _mm_add_epi64(_mm_unpacklo_epi32(int_4x, sign_4x), center_2x);
+		__m128i high_2x = _mm_add_epi64(_mm_unpackhi_epi32(int_4x, sign_4x), center_2x);
+		_mm_storeu_si128((__m128i*)(out + i), low_2x);
+		_mm_storeu_si128((__m128i*)(out + i + 2), high_2x);
+		x += 4.0f;
+	}
+	worldpos_tail(out + rounded_count, count - rounded_count, x, scale, sub_world_x, world_center_x);
+}
+
+static void fill_u32_sse2(uint32* dest, uint32 value, uint32 count)
+{
+	__m128i value_4x = _mm_set1_epi32((int32)value);
+	uint32 rounded_count = count & ~3u;
+	for (uint32 i = 0; i < rounded_count; i += 4)
+	{
+		_mm_storeu_si128((__m128i*)(dest + i), value_4x);
+	}
+	for (uint32 i = rounded_count; i < count; i++)
+	{
+		dest[i] = value;
+	}
+}
+
+static void copy_u32_sse2(uint32* dest, uint32* source, uint32 count)
+{
+	uint32 rounded_count = count & ~3u;
+	for (uint32 i = 0; i < rounded_count; i += 4)
+	{
+		_mm_storeu_si128((__m128i*)(dest + i), _mm_loadu_si128((__m128i*)(source + i)));
+	}
+	for (uint32 i = rounded_count; i < count; i++)
+	{
+		dest[i] = source[i];
+	}
+}
+
+//-----------------------------------------
+//AVX2 (8 wide)
+
+SIMD_TARGET("avx2")
+static void worldpos_row_avx2(int64* out, uint32 count, f32 x_start, f32 scale, f32 sub_world_x, int64 world_center_x)
+{
+	__m256 sequential_8x = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+	__m256 scale_8x = _mm256_set1_ps(scale);
+	__m256 sub_world_8x = _mm256_set1_ps(sub_world_x);
+	__m256i center_4x = _mm256_set1_epi64x(world_center_x);
+
+	uint32 rounded_count = count & ~7u;
+	f32 x = x_start;
+	for (uint32 i = 0; i < rounded_count; i += 8)
+	{
+		__m256 x_8x = _mm256_add_ps(_mm256_set1_ps(x), sequential_8x);
+		x_8x = _mm256_add_ps(_mm256_mul_ps(x_8x, scale_8x), sub_world_8x);
+		__m256i int_8x = _mm256_cvtps_epi32(x_8x);
+
+		__m256i low_4x = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(int_8x)), center_4x);
+		__m256i high_4x = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(int_8x, 1)), center_4x);
+		_mm256_storeu_si256((__m256i*)(out + i), low_4x);
+		_mm256_storeu_si256((__m256i*)(out + i + 4), high_4x);
+		x += 8.0f;
+	}
+	worldpos_tail(out + rounded_count, count - rounded_count, x, scale, sub_world_x, world_center_x);
+}
+
+SIMD_TARGET("avx2")
+static void fill_u32_avx2(uint32* dest, uint32 value, uint32 count)
+{
+	__m256i value_8x = _mm256_set1_epi32((int32)value);
+	uint32 rounded_count = count & ~7u;
+	for (uint32 i = 0; i < rounded_count; i += 8)
+	{
+		_mm256_storeu_si256((__m256i*)(dest + i), value_8x);
+	}
+	for (uint32 i = rounded_count; i < count; i++)
+	{
+		dest[i] = value;
+	}
+}
+
+SIMD_TARGET("avx2")
+static void copy_u32_avx2(uint32* dest, uint32* source, uint32 count)
+{
+	uint32 rounded_count = count & ~7u;
+	for (uint32 i = 0; i < rounded_count; i += 8)
+	{
+		_mm256_storeu_si256((__m256i*)(dest + i), _mm256_loadu_si256((__m256i*)(source + i)));
+	}
+	for (uint32 i = rounded_count; i < count; i++)
+	{
+		dest[i] = source[i];
+	}
+}
+
+//-----------------------------------------
+//AVX-512 (16 wide)
+
+SIMD_TARGET("avx512f")
+static void worldpos_row_avx512(int64* out, uint32 count, f32 x_start, f32 scale, f32 sub_world_x, int64 world_center_x)
+{
+	__m512 sequential_16x = _mm512_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f);
+	__m512 scale_16x = _mm512_set1_ps(scale);
+	__m512 sub_world_16x = _mm512_set1_ps(sub_world_x);
+	__m512i center_8x = _mm512_set1_epi64(world_center_x);
+
+	uint32 rounded_count = count & ~15u;
+	f32 x = x_start;
+	for (uint32 i = 0; i < rounded_count; i += 16)
+	{
+		__m512 x_16x = _mm512_add_ps(_mm512_set1_ps(x), sequential_16x);
+		x_16x = _mm512_add_ps(_mm512_mul_ps(x_16x, scale_16x), sub_world_16x);
+		__m512i int_16x = _mm512_cvtps_epi32(x_16x);
+
+		__m512i low_8x = _mm512_add_epi64(_mm512_cvtepi32_epi64(_mm512_castsi512_si256(int_16x)), center_8x);
+		__m512i high_8x = _mm512_add_epi64(_mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(int_16x, 1)), center_8x);
+		_mm512_storeu_si512((void*)(out + i), low_8x);
+		_mm512_storeu_si512((void*)(out + i + 8), high_8x);
+		x += 16.0f;
+	}
+	worldpos_tail(out + rounded_count, count - rounded_count, x, scale, sub_world_x, world_center_x);
+}
+
+SIMD_TARGET("avx512f")
+static void fill_u32_avx512(uint32* dest, uint32 value, uint32 count)
+{
+	__m512i value_16x = _mm512_set1_epi32((int32)value);
+	uint32 rounded_count = count & ~15u;
+	for (uint32 i = 0; i < rounded_count; i += 16)
+	{
+		_mm512_storeu_si512((void*)(dest + i), value_16x);
+	}
+	//the last few pixels in one masked store.
+	__mmask16 tail_mask = (__mmask16)((1u << (count - rounded_count)) - 1);
+	_mm512_mask_storeu_epi32((void*)(dest + rounded_count), tail_mask, value_16x);
+}
+
+SIMD_TARGET("avx512f")
+static void copy_u32_avx512(uint32* dest, uint32* source, uint32 count)
+{
+	uint32 rounded_count = count & ~15u;
+	for (uint32 i = 0; i < rounded_count; i += 16)
+	{
+		_mm512_storeu_si512((void*)(dest + i), _mm512_loadu_si512((void*)(source + i)));
+	}
+	__mmask16 tail_mask = (__mmask16)((1u << (count - rounded_count)) - 1);
+	_mm512_mask_storeu_epi32((void*)(dest + rounded_count), tail_mask, _mm512_maskz_loadu_epi32(tail_mask, (void*)(source + rounded_count)));
+}
+
+//-----------------------------------------
+
+static void cpuid(uint32 leaf, uint32 subleaf, uint32 regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+//The register state the OS saves on context switches. (XCR0)
+static uint64 os_saved_state()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32 low, high;
+	__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+	return ((uint64)high << 32) | low;
+#endif
+}
+
+static SimdLevel detect_simd_level()
+{
+	uint32 regs[4];
+	cpuid(0, 0, regs);
+	uint32 max_leaf = regs[0];
+
+	cpuid(1, 0, regs);
+	b32 osxsave = (regs[2] >> 27) & 1;
+	b32 avx = (regs[2] >> 28) & 1;
+	if (!osxsave || !avx || max_leaf < 7)
+	{
+		return SimdLevel::SSE2;
+	}
+
+	uint64 xcr0 = os_saved_state();
+	cpuid(7, 0, regs);
+	b32 avx2 = (regs[1] >> 5) & 1;
+	b32 avx512f = (regs[1] >> 16) & 1;
+
+	if (avx512f && (xcr0 & 0xE6) == 0xE6)	//xmm, ymm, opmask and both halves of zmm state.
+	{
+		return SimdLevel::AVX512;
+	}
+	if (avx2 && (xcr0 & 0x6) == 0x6)	//xmm and ymm state.
+	{
+		return SimdLevel::AVX2;
+	}
+	return SimdLevel::SSE2;
+}
+
+void init_render_kernels()
+{
+	SimdLevel level = detect_simd_level();
+	if ((uint32)level > RENDER_SIMD_LEVEL)
+	{
+		level = (SimdLevel)RENDER_SIMD_LEVEL;
+	}
+
+	render_kernels.level = level;
+	switch (level)
+	{
+		case SimdLevel::AVX512:
+		{
+			render_kernels.name = "AVX-512";
+			render_kernels.worldpos_row = worldpos_row_avx512;
+			render_kernels.fill_u32 = fill_u32_avx512;
+			render_kernels.copy_u32 = copy_u32_avx512;
+		}break;
+		case SimdLevel::AVX2:
+		{
+			render_kernels.name = "AVX2";
+			render_kernels.worldpos_row = worldpos_row_avx2;
+			render_kernels.fill_u32 = fill_u32_avx2;
+			render_kernels.copy_u32 = copy_u32_avx2;
+		}break;
+		default:
+		{
+			render_kernels.name = "SSE2";
+			render_kernels.worldpos_row = worldpos_row_sse2;
+			render_kernels.fill_u32 = fill_u32_sse2;
+			render_kernels.copy_u32 = copy_u32_sse2;
+		}break;
+	}
+}
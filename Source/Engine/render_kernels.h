@@ -0,0 +1,27 @@
+#pragma once
+#include "app_common.h"
+
+//The inner loops of the renderer, with an SSE2, AVX2 and AVX-512 version of each.
+//The widest one the CPU (and OS) supports is picked at startup by init_render_kernels.
+enum class SimdLevel
+{
+	SSE2 = 0,
+	AVX2,
+	AVX512
+};
+
+struct RenderKernels
+{
+	SimdLevel level;
+	const char* name;
+
+	//out[i] = world_center_x + round((x_start + i) * scale + sub_world_x) for i in [0, count)
+	void (*worldpos_row)(int64* out, uint32 count, f32 x_start, f32 scale, f32 sub_world_x, int64 world_center_x);
+	void (*fill_u32)(uint32* dest, uint32 value, uint32 count);
+	void (*copy_u32)(uint32* dest, uint32* source, uint32 count);
+};
+
+extern RenderKernels render_kernels;
+
+//NOTE: Define RENDER_SIMD_LEVEL (0: SSE2, 1: AVX2, 2: AVX512) to cap the level that gets picked.
+void init_render_kernels();
@@ -1,5 +1,20 @@
 #include "app_common.h"
+#include "render_kernels.h"
 #include "ATProfiler/atp.h"
+#include <thread>
+
+//NOTE: The pixel fill is split across a pool of workers. The main thread acts as worker 0.
+//The screen is cut into bands of RENDER_BAND_HEIGHT rows that the workers take one at a time, each writing straight into its own rows of the bitmap.
+#define MAX_RENDER_WORKERS 32
+#define RENDER_BAND_HEIGHT 16
+#ifndef RENDER_WORKER_COUNT
+#define RENDER_WORKER_COUNT 0	//0 means one worker per core.
+#endif
+
+//When zoomed in to at most this many world cells on screen, the live cells are drawn as rectangles instead of looking up every pixel.
+#ifndef RENDER_CELL_RASTER_MAX_CELLS
+#define RENDER_CELL_RASTER_MAX_CELLS 65536
+#endif
 
 struct Bitmap
 {
@@ -31,14 +46,28 @@ struct Bitmap
 	}
 };
 
-	struct FrameBuffer
-	{
-#ifdef SIMD_128
-		MSlice<int64> buffer;	//NOTE: buffer is organized so that first element of each row is the Y axis coordinate and the rest of the row is just the respective X coordinate.  
-#endif
-		uint32 width;
-		uint32 height;
-	};
+//A run of pixel columns (or rows) that all land on the same world coordinate.
+struct PixelSpan
+{
+	int64 world;
+	uint32 begin;
+	uint32 end;
+};
+
+//The world position under every pixel. World X only depends on the pixel column and world Y only on the pixel row, so they are stored as two tables.
+struct FrameBuffer
+{
+	MSlice<int64> column_x;			//world X of every pixel column.
+	MSlice<int64> row_y;			//world Y of every pixel row.
+	MSlice<PixelSpan> column_spans;	//the columns split into runs of the same world X.
+	MSlice<PixelSpan> row_spans;	//the rows split into runs of the same world Y.
+	uint32 column_span_count;
+	uint32 row_span_count;
+	CameraState camera;				//camera the tables were calculated for.
+	b32 valid;
+	uint32 width;
+	uint32 height;
+};
 
 
 vec3f cell_color[] =
@@ -49,6 +78,61 @@ vec3f cell_color[] =
 	{ .7f, .2f,.2f}		//BRICK
 };
 
+//NOTE: Zoomed out past DENSITY_MIN_SCALE, pixels cover more than one cell, so they are shaded by the density of live cells under them. 
+//The densities come from a pyramid of live cell counts: level k counts the cells of every 2^k x 2^k block (that has any). 
+//Each level is an open addressing map from block to count, and the levels are built up from the one below, so a frame costs one lookup per pixel no matter how many cells it covers.
+//Only the cells in the view (and a margin around it) are counted, starting from the level the view is shown at. Panning out of that area or zooming in past its base level counts it again.
+//Single steps update the counts from their change list. Any other generation is counted from scratch by the density worker into a second pyramid, and frames keep showing the old one until it's done.
+#define DENSITY_MIN_SCALE 2.0
+#define DENSITY_MAX_LEVEL 12					//log2 of CAMERA_MAX_SCALE.
+#define DENSITY_MAX_BLOCKS (1 << 21)			//most blocks a level can take. If the area has more blocks than this at the view's level, the pyramid starts from a coarser one.
+#define DENSITY_MIN_BLOCKS (1 << 16)			//the base level is sized for at least this many blocks (or the ones of the last build), and grows if they don't fit.
+#define DENSITY_MARGIN_SHIFT 2					//the counted area reaches past every edge of the view by 1/4 of its size.
+
+struct DensitySlot
+{
+	WorldPos block;	//cell position >> level.
+	uint32 count;	//live cells in the block.
+	uint32 stamp;	//slot is only occupied if this matches the pyramid's current stamp.
+};
+
+struct DensityLevel
+{
+	MArena arena;	//holds the slots. (virtual memory arena, only the pages of the largest map so far are committed)
+	DensitySlot* slots;
+	uint32 mask;	//slots in the map - 1, sized for the blocks of every build.
+	uint32 count;	//occupied slots.
+};
+
+struct DensityPyramid
+{
+	DensityLevel levels[DENSITY_MAX_LEVEL + 1];	//level 0 (single cells) is never built, lookups go straight to the table at that scale.
+	uint32 base_level;	//finest level of the last build. Everything below it is empty.
+	uint32 view_level;	//level the last build was for. The base level is only coarser if the blocks around the view didn't fit.
+	WorldPos area_min;	//cells counted in the last build, aligned to blocks of the base level. (inclusive)
+	WorldPos area_max;
+	uint32 stamp;		//never 0, so fresh pages (which read as zero) are empty slots.
+	b32 stale;			//the active table changed since the last build.
+};
+
+//Cells on screen (under the corner pixels) and the level they're shown at.
+struct DensityView
+{
+	WorldPos min;
+	WorldPos max;
+	uint32 level;
+};
+
+static DensitySlot empty_density_slot = {};	//stamp 0 never matches a pyramid's.
+
+struct RM;
+struct RenderWorker
+{
+	RM* rm;
+	uint32 index;
+	ThreadHandle thread;
+};
+
 //Renderer memory.
 struct RM	
 {
@@ -58,38 +142,86 @@ struct RM
 	Bitmap main_window;
 	
 	uint32 cell_color_c[ArrayCount(cell_color)];
+	uint32 density_color_c[256];	//from empty to all conway cells.
+
+	DensityPyramid density[2];
+	uint32 density_front;
+
+	//density worker
+	ThreadHandle density_thread;
+	int32 density_job;			//incremented by the main thread to have the back pyramid built from density_table.
+	int32 density_job_done;		//set to density_job by the worker once the back pyramid is built and the table is released.
+	b32 density_building;		//a job was handed out and the back pyramid isn't swapped in yet.
+	b32 density_outdated;		//the display moved on since density_table was held.
+	Hashtable* density_table;
+	DensityView density_view;	//what the back pyramid gets counted for.
+	AppMemory* gm;
+
+	//worker pool
+	RenderWorker workers[MAX_RENDER_WORKERS];
+	uint32 worker_count;	//including the main thread (worker 0).
+	int32 job_id;			//incremented by the main thread to wake the workers up for the next frame.
+	int32 jobs_done;
+	int32 next_band;		//next band of rows to be handed out.
+	AppMemory* job_gm;
+	Bitmap* job_bitmap;
+	uint32 job_density_level;	//level of the pyramid sampled when zoomed out.
+	b32* running;
 };
 
+//The pyramid that's shown. The other one is for the density worker to build.
+static FORCEDINLINE DensityPyramid* front_density(RM* rm)
+{
+	return &rm->density[rm->density_front];
+}
+
+static FORCEDINLINE DensityPyramid* back_density(RM* rm)
+{
+	return &rm->density[rm->density_front ^ 1];
+}
+
 
 void draw_rectangle(Bitmap* dest, vec2ui bottom_left, vec2ui top_right, vec3f color);
+void draw_rectangle(Bitmap* dest, vec2ui bottom_left, vec2ui top_right, uint32 casted_color);
 void draw_bitmap(Bitmap* dest, vec2ui bottom_left, Bitmap* bitmap);
 void fill_bitmap(Bitmap* dest, vec3f color);
 
 void calculate_worldpos(AppMemory* gm, FrameBuffer& fb);
+static void render_worker_thread(void* worker_memory);
+static void density_worker_thread(void* render_memory);
 
 ATP_REGISTER(Render);
 ATP_REGISTER(Draw_Every_Pixel);
+ATP_REGISTER(Draw_Live_Cells);
+ATP_REGISTER(Density_Pyramid_Build);
+ATP_REGISTER(Draw_Changed_Cells);
 ATP_REGISTER(Frame_Buffer_Fill);
-ATP_REGISTER(Draw_Bitmap);
 
 //Gives the main_window bitmap memory and and worldpos framebuffer memory. 
 static void create_window_buffers(RM* rm)
 {
 	rm->main_window.init_mem(&rm->rm_arena, "Main Window Bitmap Buffer");
 
-	rm->worldpos_fb.width = (int32)rm->main_window.width;
-	rm->worldpos_fb.height = (int32)rm->main_window.height;
-#ifdef SIMD_128
-	//NOTE: Size to store is the total number of X coordinates = height * width and total number of distinct Y coordinates = height. ( the first element of each row is the y coordinate for the entire row.)
-	rm->worldpos_fb.buffer.init_and_allocate(&rm->rm_arena, (rm->worldpos_fb.height * rm->worldpos_fb.width) + rm->worldpos_fb.height, "Frame Buffer with WorldPos");
-#endif
-
+	FrameBuffer& fb = rm->worldpos_fb;
+	fb.width = rm->main_window.width;
+	fb.height = rm->main_window.height;
+	fb.column_x.init_and_allocate(&rm->rm_arena, fb.width, "WorldPos Column X Table");
+	fb.row_y.init_and_allocate(&rm->rm_arena, fb.height, "WorldPos Row Y Table");
+	fb.column_spans.init_and_allocate(&rm->rm_arena, fb.width, "WorldPos Column Spans");
+	fb.row_spans.init_and_allocate(&rm->rm_arena, fb.height, "WorldPos Row Spans");
+	fb.column_span_count = 0;
+	fb.row_span_count = 0;
+	fb.valid = FALSE;
 }
 
 static void destory_window_buffers(RM* rm)
 {
 	//clearing stuff in the permanent render memory arena.
-	rm->worldpos_fb.buffer.clear(&rm->rm_arena);
+	FrameBuffer& fb = rm->worldpos_fb;
+	fb.row_spans.clear(&rm->rm_arena);
+	fb.column_spans.clear(&rm->rm_arena);
+	fb.row_y.clear(&rm->rm_arena);
+	fb.column_x.clear(&rm->rm_arena);
 	rm->main_window.clear_mem(&rm->rm_arena);
 }
 
@@ -99,13 +231,13 @@ void init_renderer(PL* pl, AppMemory* gm)
 		gm->render_memory = MARENA_PUSH(&pl->memory.main_arena, sizeof(RM), "Render Memory Struct");
 		RM* rm = (RM*)gm->render_memory;
 
-		rm->rm_arena.capacity = Megabytes(100);
+		rm->rm_arena.capacity = Megabytes(48);	//enough for a 4K window bitmap.
 		rm->rm_arena.overflow_addon_size = 0;
 		rm->rm_arena.top = 0;
 		rm->rm_arena.base = MARENA_PUSH(&pl->memory.main_arena, rm->rm_arena.capacity, "Render Memory Arena");
 		add_monitoring(&rm->rm_arena);
 		
-		rm->rm_temp_arena.capacity = Megabytes(50);
+		rm->rm_temp_arena.capacity = Megabytes(2);	//only holds the pixel spans now that frames are drawn straight into the window bitmap.
 		rm->rm_temp_arena.overflow_addon_size = 0;
 		rm->rm_temp_arena.top = 0;
 		rm->rm_temp_arena.base = MARENA_PUSH(&pl->memory.temp_arena, rm->rm_temp_arena.capacity, "Render Temp Arena");
@@ -129,168 +261,732 @@ void init_renderer(PL* pl, AppMemory* gm)
 		pl->window.user_resizable = TRUE;
 
 		pl->window.window_bitmap.bytes_per_pixel = 4;
+
+		//worker pool stuff
+		uint32 core_count = std::thread::hardware_concurrency();
+		rm->worker_count = (core_count > 0) ? core_count : 1;
+		if (RENDER_WORKER_COUNT != 0)
+		{
+			rm->worker_count = RENDER_WORKER_COUNT;
+		}
+		rm->worker_count = clamp(rm->worker_count, (uint32)1, (uint32)MAX_RENDER_WORKERS);
+		rm->job_id = 0;
+		rm->jobs_done = 0;
+		rm->next_band = 0;
+		rm->running = &pl->running;
+		for (uint32 i = 0; i < rm->worker_count; i++)
+		{
+			rm->workers[i].rm = rm;
+			rm->workers[i].index = i;
+		}
+
 		create_window_buffers(rm);
 		pl->window.window_bitmap.buffer = rm->main_window.mem_buffer;
 
 		PL_initialize_window(pl->window, &pl->memory.main_arena);
 
 
+		gm->track_grid_changes = TRUE;	//for repainting only the cells that changed.
+
+		init_render_kernels();
+		pl_debug_print("Render kernels: %s\n", render_kernels.name);
+
 		for (int i = 0; i < ArrayCount(cell_color); i++)
 		{
 			rm->cell_color_c[i] = (uint32)(cell_color[i].r * 255.0f) << 16 | (uint32)(cell_color[i].g * 255.0f) << 8 | (uint32)(cell_color[i].b * 255.0f) << 0;
 		}
-}
-
 
+		//NOTE: Eased out so sparse blocks still stand out from the background.
+		vec3f empty = cell_color[(uint32)CellType::EMPTY];
+		vec3f full = cell_color[(uint32)CellType::CONWAY];
+		for (uint32 i = 0; i < ArrayCount(rm->density_color_c); i++)
+		{
+			f32 t = (f32)i / 255.0f;
+			t = 1.0f - (1.0f - t) * (1.0f - t);
+			vec3f color = { empty.r + (full.r - empty.r) * t, empty.g + (full.g - empty.g) * t, empty.b + (full.b - empty.b) * t };
+			rm->density_color_c[i] = (uint32)(color.r * 255.0f) << 16 | (uint32)(color.g * 255.0f) << 8 | (uint32)(color.b * 255.0f) << 0;
+		}
 
-void update_renderer(PL* pl, AppMemory* gm)
-{
-	ATP_BLOCK(Render);
-	RM* rm = (RM*)gm->render_memory;
-
-	Bitmap& main_window = rm->main_window;
-	FrameBuffer& fb = rm->worldpos_fb;
+		//NOTE: Nothing is committed until a build needs it (see size_density_level).
+		for (uint32 d = 0; d < ArrayCount(rm->density); d++)
+		{
+			DensityPyramid* density = &rm->density[d];
+			density->levels[0] = {};
+			for (uint32 k = 1; k <= DENSITY_MAX_LEVEL; k++)
+			{
+				DensityLevel* level = &density->levels[k];
+				reserve_arena(&level->arena, (uint64)DENSITY_MAX_BLOCKS * 2 * sizeof(DensitySlot));
+				add_monitoring(&level->arena);
+				level->slots = &empty_density_slot;	//until the first build, nothing is looked up past it.
+				level->mask = 0;
+				level->count = 0;
+			}
+			density->base_level = DENSITY_MAX_LEVEL;
+			density->view_level = DENSITY_MAX_LEVEL;
+			density->area_min = { 0, 0 };
+			density->area_max = { -1, -1 };	//nothing counted yet.
+			density->stamp = 1;
+			density->stale = TRUE;
+		}
+		rm->density_front = 0;
+		rm->density_job = 0;
+		rm->density_job_done = 0;
+		rm->density_building = FALSE;
+		rm->density_outdated = FALSE;
+		rm->density_table = NULL;
+		rm->gm = gm;
+
+		for (uint32 i = 1; i < rm->worker_count; i++)	//worker 0 is the main thread itself.
+		{
+			rm->workers[i].thread = pl_create_thread(render_worker_thread, (void*)&rm->workers[i]);
+		}
+		rm->density_thread = pl_create_thread(density_worker_thread, (void*)rm);
+}
 
 
 
-	pl_debug_print("Resolution: [%i, %i]\n", rm->main_window.width, rm->main_window.height);
+static FORCEDINLINE WorldPos block_of(WorldPos pos, uint32 level)
+{
+	return { pos.x >> level, pos.y >> level };	//arithmetic shift, so negative positions round down too.
+}
 
-	ATP_START(Frame_Buffer_Fill);
-	if (gm->camera_changed)	//recalculating buffer that holds the hash of each world position for every respective pixel
+//Adds count cells to the block. Returns FALSE if the block is new and the level is full.
+static b32 density_add(DensityLevel* level, uint32 stamp, WorldPos block, uint32 count)
+{
+	uint32 index = (uint32)hash_pos(block) & level->mask;
+	for (;;)
 	{
-		calculate_worldpos(gm, fb);
+		DensitySlot* slot = level->slots + index;
+		if (slot->stamp != stamp)
+		{
+			if (level->count >= (level->mask + 1) / 2)	//keeping the load factor at most 0.5
+			{
+				return FALSE;
+			}
+			slot->block = block;
+			slot->count = count;
+			slot->stamp = stamp;
+			level->count++;
+			return TRUE;
+		}
+		if (slot->block == block)
+		{
+			slot->count += count;
+			return TRUE;
+		}
+		index = (index + 1) & level->mask;
+	}
+}
 
-		gm->camera_changed = FALSE;
+static FORCEDINLINE uint32 density_lookup(DensityLevel* level, uint32 stamp, WorldPos block)
+{
+	uint32 index = (uint32)hash_pos(block) & level->mask;
+	for (;;)
+	{
+		DensitySlot* slot = level->slots + index;
+		if (slot->stamp != stamp)
+		{
+			return 0;
+		}
+		if (slot->block == block)
+		{
+			return slot->count;
+		}
+		index = (index + 1) & level->mask;
 	}
-	ATP_END(Frame_Buffer_Fill);
+}
+
+static FORCEDINLINE uint32 density_color(RM* rm, uint32 level, uint32 count)
+{
+	uint32 shade = (uint32)(((uint64)count << 8) >> (2 * level));	//256 * the fraction of the block that's alive.
+	shade = (count && !shade) ? 1 : ((shade > 255) ? 255 : shade);
+	return rm->density_color_c[shade];
+}
+
+static FORCEDINLINE b32 in_density_area(DensityPyramid* pyramid, WorldPos pos)
+{
+	return pos.x >= pyramid->area_min.x && pos.x <= pyramid->area_max.x && pos.y >= pyramid->area_min.y && pos.y <= pyramid->area_max.y;
+}
 
-	Bitmap world_bitmap;
+//Blocks of the level that overlap the area [min, max].
+static FORCEDINLINE uint64 density_blocks_in(WorldPos min, WorldPos max, uint32 level)
+{
+	return (uint64)((max.x >> level) - (min.x >> level) + 1) * (uint64)((max.y >> level) - (min.y >> level) + 1);
+}
 
+//TRUE if the last build of the pyramid covers the whole view, at its level or a finer one.
+static b32 density_covers_view(DensityPyramid* pyramid, DensityView view)
+{
+	return pyramid->view_level <= view.level && in_density_area(pyramid, view.min) && in_density_area(pyramid, view.max);
+}
 
-	world_bitmap.dim = { fb.width , fb.height };
-	world_bitmap.init_mem(&rm->rm_temp_arena, "World Bitmap");
+//Sizes the map of the level so these many blocks can double before it's half full (up to DENSITY_MAX_BLOCKS), committing its pages the first time they're needed.
+static void size_density_level(DensityLevel* level, uint64 blocks)
+{
+	uint32 slot_count = 64;
+	while (slot_count < blocks * 4 && slot_count < DENSITY_MAX_BLOCKS * 2)
+	{
+		slot_count <<= 1;
+	}
+	uint64 size = (uint64)slot_count * sizeof(DensitySlot);
+	if (size > level->arena.top)
+	{
+		commit_arena(&level->arena, size - level->arena.top);
+		MARENA_PUSH(&level->arena, size - level->arena.top, "Density Pyramid Level");
+	}
+	level->slots = (DensitySlot*)level->arena.base;
+	level->mask = slot_count - 1;
+	level->count = 0;
+}
 
-	fill_bitmap(&world_bitmap, { 0.1f,0.1f,0.1f });
+//Counts the live cells of the table around the view (the view with a margin) into every level of the pyramid, from the view's level up. The ones below it are left empty.
+//Starts from a coarser level only if the blocks don't fit in DENSITY_MAX_BLOCKS.
+static void build_density_pyramid(DensityPyramid* pyramid, Hashtable* table, DensityView view)
+{
+	int64 margin_x = (view.max.x - view.min.x + 1) >> DENSITY_MARGIN_SHIFT;
+	int64 margin_y = (view.max.y - view.min.y + 1) >> DENSITY_MARGIN_SHIFT;
+	WorldPos min = { view.min.x - margin_x, view.min.y - margin_y };
+	WorldPos max = { view.max.x + margin_x, view.max.y + margin_y };
+	uint32 live_cells = table_live_cells(table);
+
+	uint32 base = view.level;
+	uint64 blocks = (pyramid->levels[base].count > DENSITY_MIN_BLOCKS) ? pyramid->levels[base].count : DENSITY_MIN_BLOCKS;
+	for (;;)
+	{
+		//NOTE: A level never has more blocks than the area, or than there are live cells.
+		uint64 most_blocks = density_blocks_in(min, max, base);
+		most_blocks = (most_blocks < live_cells) ? most_blocks : live_cells;
+		most_blocks = (most_blocks < DENSITY_MAX_BLOCKS) ? most_blocks : DENSITY_MAX_BLOCKS;
+		blocks = (blocks < most_blocks) ? blocks : most_blocks;
+
+		pyramid->stamp = (pyramid->stamp == UINT32MAX) ? 1 : pyramid->stamp + 1;	//empties every level.
+		//NOTE: Masked instead of shifted back, the corners can be negative. Blocks of the coarser levels on the border are only counted in part, they are shown until the next build at most.
+		int64 block_mask = ((int64)1 << base) - 1;
+		pyramid->area_min = { min.x & ~block_mask, min.y & ~block_mask };
+		pyramid->area_max = { max.x | block_mask, max.y | block_mask };
+		size_density_level(&pyramid->levels[base], blocks);
+
+		b32 fits = TRUE;
+		LiveCellNode* node = table->node_list.front;
+		for (uint32 i = 0; i < table->node_list.size && fits; i++, node++)
+		{
+			if (node->type != CellType::EMPTY)	//NOTE: purged cells are left in the node list as EMPTY.
+			{
+				WorldPos pos = node_pos(table, node);
+				fits = !in_density_area(pyramid, pos) || density_add(&pyramid->levels[base], pyramid->stamp, block_of(pos, base), 1);
+			}
+		}
+		if (fits || (blocks == DENSITY_MAX_BLOCKS && base == DENSITY_MAX_LEVEL))
+		{
+			break;	//NOTE: At the coarsest level, with a window too big for it, what's counted so far is shown.
+		}
+		if (blocks < most_blocks)
+		{
+			blocks *= 4;	//more blocks than expected, counting again with a bigger map.
+		}
+		else
+		{
+			base++;
+		}
+	}
+	pyramid->base_level = base;
+	pyramid->view_level = view.level;
 
-	//for first pixel.
-	ATP_START(Draw_Every_Pixel);
+	//every level is sized for the blocks of the one below it, which it never has more of.
+	for (uint32 k = base + 1; k <= DENSITY_MAX_LEVEL; k++)
+	{
+		DensityLevel* below = &pyramid->levels[k - 1];
+		size_density_level(&pyramid->levels[k], below->count);
+		DensitySlot* slot = below->slots;
+		for (uint32 i = 0; i <= below->mask; i++, slot++)
+		{
+			if (slot->stamp == pyramid->stamp)
+			{
+				b32 added = density_add(&pyramid->levels[k], pyramid->stamp, block_of(slot->block, 1), slot->count);
+				ASSERT(added);
+			}
+		}
+	}
+	pyramid->stale = FALSE;
+}
 
-	uint32* ptr = (uint32*)world_bitmap.mem_buffer;
-	 
-	
+//Adds one generation of changes to the counts instead of rebuilding the pyramid. Without a change list, it's left for the next build.
+static void update_density_pyramid(DensityPyramid* pyramid, MSlice<CellChange>* changes)
+{
+	if (pyramid->stale)
+	{
+		return;
+	}
+	if (!changes)
+	{
+		pyramid->stale = TRUE;
+		return;
+	}
 
-	if (gm->cm.scale < 0.9)
+	CellChange* change = changes->front;
+	for (uint32 i = 0; i < changes->size; i++, change++)
 	{
-#ifdef SIMD_128
+		b32 alive = (change->type != CellType::EMPTY);
+		if (alive == (change->prev_type != CellType::EMPTY))
+		{
+			continue;	//only changed type.
+		}
+		if (!in_density_area(pyramid, change->pos))
+		{
+			continue;
+		}
+		for (uint32 k = pyramid->base_level; k <= DENSITY_MAX_LEVEL; k++)
+		{
+			if (!density_add(&pyramid->levels[k], pyramid->stamp, block_of(change->pos, k), alive ? 1 : (uint32)-1))
+			{
+				pyramid->stale = TRUE;	//a level ran out of room for a new block.
+				return;
+			}
+		}
+	}
+}
 
-		//NOTE: Using a Y row cache buffer to refer to. This is much slower in debug mode than doing a simple previous pixel check, but WAY faster in O2 mode. 
-		//NOTE: Whats going on here:
-		//If two rows have the same Y coords, they are both exactly the same. So, keeping a 'cached' state buffer to refer to. 
-		MSlice<CellType> row_state_cache;
-		row_state_cache.init_and_allocate(&rm->rm_temp_arena, fb.width, "render pixel fill row state cache buffer");
+//Fills the pixel rows [row_begin, row_end) of the bitmap with the color of the cell under each pixel.
+static void fill_pixel_rows(RM* rm, AppMemory* gm, Bitmap* bitmap, uint32 row_begin, uint32 row_end)
+{
+	FrameBuffer& fb = rm->worldpos_fb;
+	uint32* ptr = (uint32*)bitmap->mem_buffer + (uint64)row_begin * fb.width;
 
-		int64 prev_y_coord = -MAXINT64;	//Set to -MAXINT64 so that the first cache check will fail and will trigger to fill the cache with first row state. 
-		int64* it = fb.buffer.front;
+	if (gm->cm.scale >= DENSITY_MIN_SCALE)
+	{
+		DensityPyramid* pyramid = front_density(rm);
+		uint32 level = rm->job_density_level;
+		DensityLevel* density = &pyramid->levels[level];
 
-		for (uint32 y = 0; y < fb.height; y++)
+		for (uint32 y = row_begin; y < row_end; y++)
 		{
-			int64 y_coord = *it;
-			it++;	//to get to the x coordinates, it has to jump across the Y coord. 
-			if (y_coord == prev_y_coord)	//Refer the previous row cache.
+			int64 block_y = fb.row_y[y] >> level;
+			WorldPos prev_block = { MAXINT64, block_y };
+			uint32 color = rm->density_color_c[0];
+			for (uint32 x = 0; x < fb.width; x++)
 			{
-				for (uint32 x = 0; x < fb.width; x++)
+				WorldPos block = { fb.column_x[x] >> level, block_y };
+				if (block.x != prev_block.x)
 				{
-					CellType state = row_state_cache[x];
-					
-					*ptr = rm->cell_color_c[(uint32)state];
-
-					ptr++;
-					it++;
+					color = density_color(rm, level, density_lookup(density, pyramid->stamp, block));
+					prev_block = block;
 				}
+				*ptr = color;
+				ptr++;
+			}
+		}
+	}
+	else
+	{
+		//NOTE: Every run of columns with the same world X is one lookup. A row with the same world Y as the one above it is just a copy of it.
+		PixelSpan* spans = fb.column_spans.front;
+		for (uint32 y = row_begin; y < row_end; y++)
+		{
+			int64 y_coord = fb.row_y[y];
+			if (y > row_begin && y_coord == fb.row_y[y - 1])
+			{
+				render_kernels.copy_u32(ptr, ptr - fb.width, fb.width);
 			}
-			else  //Process new row and fill cache.
+			else
 			{
-				int64 prev_x_coord = MAXINT64;	//set to maxint64 so first check will fail. 
-				CellType prev_state = CellType::EMPTY;
-				for (uint32 x = 0; x < fb.width; x++)
+				for (uint32 i = 0; i < fb.column_span_count; i++)
 				{
-					CellType state;
-					if (*it == prev_x_coord)
+					WorldPos pos = { spans[i].world, y_coord };
+					CellType state = lookup_cell(gm->active_table, hash_pos(pos), pos);
+					uint32 color = rm->cell_color_c[(uint32)state];
+
+					uint32 width = spans[i].end - spans[i].begin;
+					if (width == 1)
 					{
-						state = prev_state;
+						ptr[spans[i].begin] = color;
 					}
 					else
 					{
-						WorldPos pos = { *it, y_coord };
-
-						uint32 slot = hash_pos(pos, gm->active_table->table.size);
-						state = lookup_cell(gm->active_table, slot, pos);
-
-						prev_x_coord = *it;
-						prev_state = state;
+						render_kernels.fill_u32(ptr + spans[i].begin, color, width);
 					}
-					row_state_cache[x] = state;
-
-					*ptr = rm->cell_color_c[(uint32)state];
-					ptr++;
-					it++;
 				}
-				prev_y_coord = y_coord;
 			}
+			ptr += fb.width;
 		}
+	}
+}
 
-		row_state_cache.clear(&rm->rm_temp_arena);
-#endif
+//Takes bands of rows until there are none left.
+static void fill_pixel_bands(RenderWorker* worker)
+{
+	RM* rm = worker->rm;
+	uint32 height = rm->worldpos_fb.height;
+	for (;;)
+	{
+		uint32 row_begin = (uint32)(interlocked_increment(&rm->next_band) - 1) * RENDER_BAND_HEIGHT;
+		if (row_begin >= height)
+		{
+			break;
+		}
+		uint32 row_end = (row_begin + RENDER_BAND_HEIGHT < height) ? row_begin + RENDER_BAND_HEIGHT : height;
+		fill_pixel_rows(rm, rm->job_gm, rm->job_bitmap, row_begin, row_end);
 	}
-	else   //Zoomed out so not worth doing the caching of state (since each x and y pixel coordinate maps to a distinctive world coordinate. 
+}
+
+static void render_worker_thread(void* worker_memory)
+{
+	RenderWorker* worker = (RenderWorker*)worker_memory;
+	RM* rm = worker->rm;
+	int32 seen_job_id = 0;
+	while (TRUE)
 	{
-#ifdef SIMD_128
-		//NOTE: probably not worth doing a SIMD Version. 
-		//Would only be able to fit 2 int64s at a time and the vector loads and unloads would probably take more time than doing the multiple multiplications from the same cache line. 
+		wait_while_equal(&rm->job_id, seen_job_id);
+		seen_job_id = rm->job_id;
+		//NOTE: Frames are only published while running, by the thread that clears it (and it waits for every worker first). So this is shutdown_renderer waking the workers up.
+		if (!*rm->running)
+		{
+			break;
+		}
 
-		//Basically scalar code but appropriate to the different data format used in SIMD. 
-		int64* it = fb.buffer.front;
+		fill_pixel_bands(worker);
+		interlocked_increment(&rm->jobs_done);
+		wake_value_waiters(&rm->jobs_done);
+	}
+}
 
-		for (uint32 y = 0; y < fb.height; y++)
+//Counts the held table into the back pyramid whenever the main thread hands it a job (see update_renderer).
+static void density_worker_thread(void* render_memory)
+{
+	RM* rm = (RM*)render_memory;
+	int32 seen_job_id = 0;
+	while (TRUE)
+	{
+		wait_while_equal(&rm->density_job, seen_job_id);
+		seen_job_id = rm->density_job;
+		if (!*rm->running)
 		{
-			int64 y_coord = *it;
-			it++;	//to get to the x coordinates, it has to jump across the Y coord. 
-			for (uint32 x = 0; x < fb.width; x++)
-			{
-				WorldPos pos = { *it, y_coord };
+			break;
+		}
+
+		build_density_pyramid(back_density(rm), rm->density_table, rm->density_view);
+		release_held_table(rm->gm);
+		interlocked_exchange_i32(&rm->density_job_done, seen_job_id);
+	}
+}
 
-				CellType state;
-				uint32 slot = hash_pos(pos, gm->active_table->table.size);
-				state = lookup_cell(gm->active_table, slot, pos);
+//Fills every pixel of the bitmap on all the workers and waits for them to finish.
+static void fill_pixels(RM* rm, AppMemory* gm, Bitmap* bitmap)
+{
+	rm->job_gm = gm;
+	rm->job_bitmap = bitmap;
+	rm->next_band = 0;
 
-				*ptr = rm->cell_color_c[(uint32)state];
-				ptr++;
-				it++;
+	//NOTE: Once running is cleared the workers leave their loop instead of taking a job (see render_worker_thread), so the last frame is filled on this thread alone. 
+	b32 parallel = rm->worker_count > 1 && *rm->running;
+	if (parallel)
+	{
+		rm->jobs_done = 0;
+		interlocked_exchange_i32(&rm->job_id, rm->job_id + 1);	//publishes the job to the workers.
+		wake_value_waiters(&rm->job_id);
+	}
+
+	fill_pixel_bands(&rm->workers[0]);
+
+	if (parallel)
+	{
+		int32 done;
+		while ((done = rm->jobs_done) != (int32)rm->worker_count - 1)
+		{
+			wait_while_equal(&rm->jobs_done, done);
+		}
+	}
+}
+
+//Splits the world coordinates of the pixel columns (or rows) into runs of the same coordinate (>> shift, to get runs of the same density block). Returns the number of runs.
+static uint32 build_spans(int64* coords, uint32 count, PixelSpan* spans, uint32 shift)
+{
+	uint32 span_count = 0;
+	for (uint32 i = 0; i < count; i++)
+	{
+		int64 world = coords[i] >> shift;
+		if (span_count == 0 || spans[span_count - 1].world != world)
+		{
+			spans[span_count] = { world, i, i + 1 };
+			span_count++;
+		}
+		else
+		{
+			spans[span_count - 1].end = i + 1;
+		}
+	}
+	return span_count;
+}
+
+//Draws every live cell on screen as a rectangle over the (already cleared) bitmap. The render cost only depends on the number of cells on screen.
+//NOTE: The spans have to cover consecutive world coordinates (scale below 1), so a world coordinate maps straight to its span.
+//The live cells on screen are found either by looking up every world cell on screen, or by going over the whole node list if that's shorter. 
+static void draw_live_cells(RM* rm, AppMemory* gm, Bitmap* bitmap, PixelSpan* columns, uint32 column_count, PixelSpan* rows, uint32 row_count)
+{
+	Hashtable* table = gm->active_table;
+	int64 min_x = columns[0].world;
+	int64 min_y = rows[0].world;
 
+	if ((uint64)column_count * row_count <= table_live_cells(table))
+	{
+		for (uint32 y = 0; y < row_count; y++)
+		{
+			for (uint32 x = 0; x < column_count; x++)
+			{
+				WorldPos pos = { columns[x].world, rows[y].world };
+				CellType state = lookup_cell(table, hash_pos(pos), pos);
+				if (state != CellType::EMPTY)
+				{
+					draw_rectangle(bitmap, { columns[x].begin, rows[y].begin }, { columns[x].end, rows[y].end }, rm->cell_color_c[(uint32)state]);
+				}
 			}
 		}
-#endif
 	}
+	else
+	{
+		LiveCellNode* node = table->node_list.front;
+		for (uint32 i = 0; i < table->node_list.size; i++, node++)
+		{
+			WorldPos pos = node_pos(table, node);
+			uint64 x = (uint64)(pos.x - min_x);
+			uint64 y = (uint64)(pos.y - min_y);
+			if (x < column_count && y < row_count && node->type != CellType::EMPTY)	//NOTE: purged cells are left in the node list as EMPTY.
+			{
+				draw_rectangle(bitmap, { columns[x].begin, rows[y].begin }, { columns[x].end, rows[y].end }, rm->cell_color_c[(uint32)node->type]);
+			}
+		}
+	}
+}
+
+//Returns the span landing on the world coordinate, or NULL if no pixel does. (the spans are sorted by world coordinate)
+static PixelSpan* find_span(PixelSpan* spans, uint32 count, int64 world)
+{
+	uint32 low = 0;
+	uint32 high = count;
+	while (low < high)
+	{
+		uint32 mid = (low + high) / 2;
+		if (spans[mid].world < world)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	return (low < count && spans[low].world == world) ? spans + low : NULL;
+}
+
+//Repaints only the pixels on top of the cells that changed since the last frame. (Or their density blocks, when zoomed out.)
+static void draw_changed_cells(RM* rm, AppMemory* gm, Bitmap* bitmap, MSlice<CellChange>* changes)
+{
+	FrameBuffer& fb = rm->worldpos_fb;
+	b32 density_mode = (gm->cm.scale >= DENSITY_MIN_SCALE);
+	uint32 shift = density_mode ? rm->job_density_level : 0;
+	DensityPyramid* pyramid = front_density(rm);
+
+	//NOTE: The spans of single cells are kept in the framebuffer, the ones of density blocks are only needed here.
+	MSlice<PixelSpan> columns;
+	MSlice<PixelSpan> rows;
+	uint32 column_count = fb.column_span_count;
+	uint32 row_count = fb.row_span_count;
+	if (shift == 0)
+	{
+		columns.front = fb.column_spans.front;
+		rows.front = fb.row_spans.front;
+	}
+	else
+	{
+		columns.init_and_allocate(&rm->rm_temp_arena, fb.width, "Render Column Spans");
+		rows.init_and_allocate(&rm->rm_temp_arena, fb.height, "Render Row Spans");
+		column_count = build_spans(fb.column_x.front, fb.width, columns.front, shift);
+		row_count = build_spans(fb.row_y.front, fb.height, rows.front, shift);
+	}
+
+	CellChange* change = changes->front;
+	for (uint32 i = 0; i < changes->size; i++, change++)
+	{
+		WorldPos pos = block_of(change->pos, shift);
+		PixelSpan* column = find_span(columns.front, column_count, pos.x);
+		PixelSpan* row = column ? find_span(rows.front, row_count, pos.y) : NULL;
+		if (row)
+		{
+			uint32 color = density_mode ? density_color(rm, shift, density_lookup(&pyramid->levels[shift], pyramid->stamp, pos)) : rm->cell_color_c[(uint32)change->type];
+			draw_rectangle(bitmap, { column->begin, row->begin }, { column->end, row->end }, color);
+		}
+	}
+
+	if (shift != 0)
+	{
+		rows.clear(&rm->rm_temp_arena);
+		columns.clear(&rm->rm_temp_arena);
+	}
+}
+
+//Draws every pixel from scratch, straight into the window bitmap. Anything drawn on top of the cells (overlays) goes into the same bitmap afterwards.
+static void draw_full_frame(RM* rm, AppMemory* gm)
+{
+	FrameBuffer& fb = rm->worldpos_fb;
+	Bitmap* main_window = &rm->main_window;
+	ASSERT(main_window->width == fb.width && main_window->height == fb.height);
+
+	b32 cells_drawn = FALSE;
+	if (gm->cm.scale < 1.0)
+	{
+		ATP_START(Draw_Live_Cells);
+		if ((uint64)fb.column_span_count * fb.row_span_count <= RENDER_CELL_RASTER_MAX_CELLS)
+		{
+			fill_bitmap(main_window, cell_color[(uint32)CellType::EMPTY]);
+			draw_live_cells(rm, gm, main_window, fb.column_spans.front, fb.column_span_count, fb.row_spans.front, fb.row_span_count);
+			cells_drawn = TRUE;
+		}
+		ATP_END(Draw_Live_Cells);
+	}
+
+	if (!cells_drawn)
+	{
+		//NOTE: Every pixel gets written, so there's no need to clear the bitmap first.
+		ATP_START(Draw_Every_Pixel);
+		fill_pixels(rm, gm, main_window);
+		ATP_END(Draw_Every_Pixel);
+	}
+}
+
+void update_renderer(PL* pl, AppMemory* gm)
+{
+	ATP_BLOCK(Render);
+	RM* rm = (RM*)gm->render_memory;
+
+	Bitmap& main_window = rm->main_window;
+	FrameBuffer& fb = rm->worldpos_fb;
+
+
+
+	pl_debug_print("Resolution: [%i, %i]\n", rm->main_window.width, rm->main_window.height);
+
+	b32 redraw = gm->camera_changed;
+
+	ATP_START(Frame_Buffer_Fill);
+	if (gm->camera_changed)	//recalculating buffer that holds the hash of each world position for every respective pixel
+	{
+		calculate_worldpos(gm, fb);
+
+		gm->camera_changed = FALSE;
+	}
+	ATP_END(Frame_Buffer_Fill);
+
+	MSlice<CellChange>* changes = NULL;
+	if (gm->grid_changed)
+	{
+		changes = gm->grid_changes;
+		redraw |= (changes == NULL);
+		update_density_pyramid(front_density(rm), changes);
+		rm->density_outdated = TRUE;
+		gm->grid_changed = FALSE;
+		gm->grid_changes = NULL;
+	}
+	if (gm->cm.scale >= DENSITY_MIN_SCALE)
+	{
+		//the largest blocks that still fit in a pixel.
+		uint32 level = 1;
+		while (level < DENSITY_MAX_LEVEL && (f64)(2ULL << level) <= gm->cm.scale)
+		{
+			level++;
+		}
 
-	ATP_END(Draw_Every_Pixel);
+		//the cells under the corner pixels.
+		int64 first_x = fb.column_x[0], last_x = fb.column_x[fb.width - 1];
+		int64 first_y = fb.row_y[0], last_y = fb.row_y[fb.height - 1];
+		DensityView view;
+		view.min = { (first_x < last_x) ? first_x : last_x, (first_y < last_y) ? first_y : last_y };
+		view.max = { (first_x < last_x) ? last_x : first_x, (first_y < last_y) ? last_y : first_y };
+		view.level = level;
 
-	ATP_START(Draw_Bitmap);
-	draw_bitmap(&main_window, { 0,0 }, &world_bitmap);
-	ATP_END(Draw_Bitmap);
+		ATP_START(Density_Pyramid_Build);
+		if (rm->density_building && rm->density_job_done == rm->density_job)
+		{
+			rm->density_front ^= 1;
+			front_density(rm)->stale = rm->density_outdated;	//counted from an older generation, it's only shown until the next build.
+			rm->density_building = FALSE;
+			redraw = TRUE;
+		}
+		if ((front_density(rm)->stale || !density_covers_view(front_density(rm), view)) && !rm->density_building)
+		{
+			Hashtable* table = hold_displayed_table(gm);
+			if (table)
+			{
+				rm->density_table = table;
+				rm->density_view = view;
+				rm->density_outdated = FALSE;
+				rm->density_building = TRUE;
+				interlocked_exchange_i32(&rm->density_job, rm->density_job + 1);	//publishes the job to the density worker.
+				wake_value_waiters(&rm->density_job);
+			}
+			else
+			{
+				//paused, the table is only edited on this thread.
+				build_density_pyramid(front_density(rm), gm->active_table, view);
+				redraw = TRUE;	//the base level might have moved.
+			}
+		}
+		ATP_END(Density_Pyramid_Build);
 
-	world_bitmap.clear_mem(&rm->rm_temp_arena);
+		uint32 base_level = front_density(rm)->base_level;
+		rm->job_density_level = (level > base_level) ? level : base_level;
+	}
 
+	if (redraw)
+	{
+		draw_full_frame(rm, gm);
+	}
+	else if (changes)
+	{
+		ATP_START(Draw_Changed_Cells);
+		draw_changed_cells(rm, gm, &main_window, changes);
+		ATP_END(Draw_Changed_Cells);
+	}
+	//NOTE: Otherwise nothing on screen changed, and the window bitmap still holds the last frame.
 }
 
 void shutdown_renderer(PL* pl, AppMemory* gm)
 {
 	//cleanup render memory 
 	RM* rm = (RM*)gm->render_memory;
+
+	//NOTE: pl->running is already cleared here, so the workers leave their loops as soon as they wake up.
+	interlocked_exchange_i32(&rm->job_id, rm->job_id + 1);
+	wake_value_waiters(&rm->job_id);
+	for (uint32 i = 1; i < rm->worker_count; i++)
+	{
+		b32 thread_is_not_done = pl_wait_for_thread(rm->workers[i].thread, 30000);
+		if (thread_is_not_done)
+		{
+			ERRORBOX("Render worker thread is running for too long after shutdown initiated! Force kill the app...");
+		}
+		pl_close_thread(&rm->workers[i].thread);
+	}
+	interlocked_exchange_i32(&rm->density_job, rm->density_job + 1);
+	wake_value_waiters(&rm->density_job);
+	if (pl_wait_for_thread(rm->density_thread, 30000))
+	{
+		ERRORBOX("Density worker thread is running for too long after shutdown initiated! Force kill the app...");
+	}
+	pl_close_thread(&rm->density_thread);
 	MARENA_POP(&pl->memory.temp_arena, rm->rm_temp_arena.capacity, "Render Temp Arena");
 	remove_monitoring(&rm->rm_temp_arena);
 
 	destory_window_buffers(rm);
 
+	for (int32 d = ArrayCount(rm->density) - 1; d >= 0; d--)
+	{
+		for (int32 k = DENSITY_MAX_LEVEL; k >= 1; k--)
+		{
+			DensityLevel* level = &rm->density[d].levels[k];
+			remove_monitoring(&level->arena);
+			release_arena(&level->arena);
+		}
+	}
+
 	remove_monitoring(&rm->rm_arena);
 	MARENA_POP(&pl->memory.main_arena, rm->rm_arena.capacity, "Render Memory Arena");
 	MARENA_POP(&pl->memory.main_arena, sizeof(RM), "Render Memory Struct");
@@ -320,211 +1016,94 @@ void render(PL* pl, AppMemory* gm)
 
 void calculate_worldpos(AppMemory* gm, FrameBuffer& fb)
 {
-	//TODO: Optimize the crap out of the SIMD version so that it out-performs the O2 scalar code...When in release, the compiler is able to optimize the scalar code so much that it's better than the SIMD code
-
-#ifdef SIMD_128	//SIMD flat version
-	f32 x_start = (f32)(-(int32)(fb.width / 2));
-	f32 x_end = (fb.width % 2 == 0) ? ((-x_start) - 1.0f) : -x_start;
-
-	f32 y_start = (f32)(-(int32)(fb.height / 2));
-	f32 y_end = (fb.height % 2 == 0) ? ((-y_start) - 1.0f) : -y_start;
-
-	x_end++;
-	y_end++;
-
-	__m128 adding_sequential = { 0.0f,1.0f,2.0f,3.0f };
-	f32 fscale = (f32)gm->cm.scale;
-	__m128 scale_4x = _mm_load1_ps(&fscale);
-
-	__m128 x_sub_world_4x = _mm_load1_ps(&gm->cm.sub_world_center.x);
-
-	__m128i cm_center_x_pos_4x;
-	cm_center_x_pos_4x.m128i_i64[0] = { gm->cm.world_center.x };
-	cm_center_x_pos_4x.m128i_i64[1] = { gm->cm.world_center.x };
-
-
-	f32 zero = 0.0f;
-	__m128 zero_4x = _mm_load1_ps(&zero);
-
-	f32 half = 0.5f;
-	__m128 half_4x = _mm_load1_ps(&half);
-
-	//NOTE: To make for better use of space, the first element of each row is the y coordinate for that entire row. Everything else is the respective x coordinate
-
-	uint32 extra_width = (uint32(x_end - x_start) % 4);
-	f32 x_end_rounded_down = x_end - extra_width;
-
-	__m128i* iterator = (__m128i*)fb.buffer.front;
-	for (f32 y = y_start; y < y_end; y++)
+	if (fb.valid && fb.camera.scale == gm->cm.scale && fb.camera.sub_world_center == gm->cm.sub_world_center)
 	{
-
-		f32 y_coord = y * fscale;
-		y_coord += gm->cm.sub_world_center.y;
-		int64 y_coord_fin = f32_to_int64(y_coord);
-		y_coord_fin += gm->cm.world_center.y;
-
-		int64* it_64 = (int64*)iterator;
-		*it_64 = y_coord_fin;
-		
-		it_64++;
-		iterator = (__m128i*)it_64;
-		f32 x;
-		for ( x = x_start; x < x_end_rounded_down; x += 4)
+		//Only moved by whole cells, so every pixel moves by the same amount. (world_center is added after rounding)
+		int64 delta_x = gm->cm.world_center.x - fb.camera.world_center.x;
+		int64 delta_y = gm->cm.world_center.y - fb.camera.world_center.y;
+		for (uint32 x = 0; x < fb.width; x++)
 		{
-			__m128 x_screen_coord_4x = _mm_load1_ps(&x);
-
-			//Setting the x values to {x,x+1,x+2,x+3}
-			x_screen_coord_4x = _mm_add_ps(x_screen_coord_4x, adding_sequential);
-
-			//Multiplying x values with scale
-			x_screen_coord_4x = _mm_mul_ps(x_screen_coord_4x, scale_4x);
-
-			//adding the sub world center for x 
-			x_screen_coord_4x = _mm_add_ps(x_screen_coord_4x, x_sub_world_4x);
-
-			/*
-			// proper casting x vector into 4 int32s with rounding
-			__m128 compare_mask = _mm_cmpge_ps(x_screen_coord_4x, zero_4x);
-
-			__m128 x_half_added_4x = _mm_add_ps(x_screen_coord_4x, half_4x);
-			__m128 x_half_subtracted_4x = _mm_sub_ps(x_screen_coord_4x, half_4x);
-
-			__m128 x_above_zero_4x = _mm_and_ps(compare_mask, x_half_added_4x);
-			__m128 x_below_zero_4x = _mm_andnot_ps(compare_mask, x_half_subtracted_4x);
-
-			__m128 orred_result_4x = _mm_or_ps(x_below_zero_4x, x_above_zero_4x);
-			__m128i int_result = _mm_cvttps_epi32(orred_result_4x);
-			*/
-			//NOTE: This is ridiculous. Below is one instruction that rounds to nearest before cast to int....instead of the above.
-			__m128i int_result = _mm_cvtps_epi32(x_screen_coord_4x);
-			//turning those 4 int32s into 2 int64s. 
-			__m128i first_two_results = _mm_cvtepi32_epi64(int_result);
-
-			__m128i second_two_results = _mm_cvtepi32_epi64(_mm_bsrli_si128(int_result, 8));
-
-			//adding the camera's world center values.
-			first_two_results = _mm_add_epi64(cm_center_x_pos_4x, first_two_results);
-			second_two_results = _mm_add_epi64(cm_center_x_pos_4x, second_two_results);
-
-			//----------------------------------------
-
-			*iterator = first_two_results;	
-			iterator++;
-			*iterator = second_two_results; 
-			iterator++;
+			fb.column_x[x] += delta_x;
 		}
-		if (extra_width != 0)
+		for (uint32 y = 0; y < fb.height; y++)
 		{
-			int64* it_single = (int64*)iterator;
-			for (; x < x_end; x++)
-			{
-				f32 x_coord = x * fscale;
-				x_coord += gm->cm.sub_world_center.x;
-				int64 x_coord_fin = f32_to_int64(x_coord);
-				x_coord_fin += gm->cm.world_center.x;
-				*it_single = x_coord_fin;
-				it_single++;
-			}
-			iterator = (__m128i*) it_single;
+			fb.row_y[y] += delta_y;
+		}
+		for (uint32 i = 0; i < fb.column_span_count; i++)
+		{
+			fb.column_spans[i].world += delta_x;
+		}
+		for (uint32 i = 0; i < fb.row_span_count; i++)
+		{
+			fb.row_spans[i].world += delta_y;
 		}
-		
 	}
-	ASSERT((int64*)iterator == (fb.buffer.front + fb.buffer.size));
+	else
+	{
+		f32 x_start = (f32)(-(int32)(fb.width / 2));
+		f32 y_start = (f32)(-(int32)(fb.height / 2));
+		f32 fscale = (f32)gm->cm.scale;
 
-#endif
+		render_kernels.worldpos_row(fb.column_x.front, fb.width, x_start, fscale, gm->cm.sub_world_center.x, gm->cm.world_center.x);
+
+		f32 y = y_start;
+		for (uint32 i = 0; i < fb.height; i++)
+		{
+			f32 y_coord = y * fscale;
+			y_coord += gm->cm.sub_world_center.y;
+			fb.row_y[i] = f32_to_int64(y_coord) + gm->cm.world_center.y;
+			y++;
+		}
+
+		fb.column_span_count = build_spans(fb.column_x.front, fb.width, fb.column_spans.front, 0);
+		fb.row_span_count = build_spans(fb.row_y.front, fb.height, fb.row_spans.front, 0);
+	}
+	fb.camera = gm->cm;
+	fb.valid = TRUE;
 }
 
 void fill_bitmap(Bitmap* dest, vec3f color)
 {
-#ifdef SIMD_128	//SIMD Version
-	uint32 size = dest->height * dest->width;
-	__m128i* ptr = (__m128i*)dest->mem_buffer;
 	uint32 casted_color = (uint32)(color.r * 255.0f) << 16 | (uint32)(color.g * 255.0f) << 8 | (uint32)(color.b * 255.0f) << 0;
-	__m128i casted_color_wide;
-	casted_color_wide.m128i_u32[0] = { casted_color };
-	casted_color_wide.m128i_u32[1] = { casted_color };
-	casted_color_wide.m128i_u32[2] = { casted_color };
-	casted_color_wide.m128i_u32[3] = { casted_color };
-
-	uint32 extra = size % 4;
-
-	size = size - extra;	//making it the nearest multiple of 4. 
-
-	for (uint32 x = 0; x < size; x+= 4)
-	{
-		*ptr = casted_color_wide;
-		ptr++;
-	}
-	uint32* ptr_single = (uint32*)ptr;
-	for (uint32 x = 0; x < extra; x++)
-	{
-		*ptr_single = casted_color;
-		ptr_single++;
-	}
-	ASSERT(ptr_single == ((uint32*)dest->mem_buffer + dest->height * dest->width));
-
-
-#endif
+	render_kernels.fill_u32((uint32*)dest->mem_buffer, casted_color, dest->height * dest->width);
 }
 
 void draw_rectangle(Bitmap* dest, vec2ui bottom_left, vec2ui top_right, vec3f color)
 {
-	int32 width = top_right.x - bottom_left.x;
-	int32 height = top_right.y - bottom_left.y;
 	uint32 casted_color = (uint32)(color.r * 255.0f) << 16 | (uint32)(color.g * 255.0f) << 8 | (uint32)(color.b * 255.0f) << 0;
+	draw_rectangle(dest, bottom_left, top_right, casted_color);
+}
+
+void draw_rectangle(Bitmap* dest, vec2ui bottom_left, vec2ui top_right, uint32 casted_color)
+{
+	uint32 width = top_right.x - bottom_left.x;
+	uint32 height = top_right.y - bottom_left.y;
 	uint32* ptr = (uint32*)dest->mem_buffer + (bottom_left.y * dest->width) + bottom_left.x;
-	ASSERT((width * height) + bottom_left.x + bottom_left.y * dest->width <= dest->width * dest->height);
+	ASSERT(top_right.x <= dest->width && top_right.y <= dest->height);
 
-	uint32 end_shift = dest->width - width;
-	for (int y = 0; y < height; y++)
+	for (uint32 y = 0; y < height; y++)
 	{
-		for (int x = 0; x < width; x++)
-		{
-			*ptr = casted_color;
-			ptr++;
-		}
-		ptr += end_shift;
+		render_kernels.fill_u32(ptr, casted_color, width);
+		ptr += dest->width;
 	}
 }
 
 void draw_bitmap(Bitmap* dest, vec2ui bottom_left, Bitmap* bitmap)
 {
-#ifdef SIMD_128	//SIMD Version
-	__m128i* dest_ptr = (__m128i*)((uint32*)dest->mem_buffer + (bottom_left.y * dest->width) + bottom_left.x);
-	__m128i* source_ptr = (__m128i*)bitmap->mem_buffer;
+	uint32* dest_ptr = (uint32*)dest->mem_buffer + (bottom_left.y * dest->width) + bottom_left.x;
+	uint32* source_ptr = (uint32*)bitmap->mem_buffer;
 
 	uint32 width = bitmap->dim.x;
 	uint32 height = bitmap->dim.y;
 
 	ASSERT(((width * height) + bottom_left.x + bottom_left.y * dest->width) <= (dest->width * dest->height));
 
-	uint32 width_extra = width % 4;
-
-	uint32 rounded_down_width = width - width_extra;	//making it the nearest multiple of 4. 
-
-
-	uint32 end_shift = dest->width - width;
 	for (uint32 y = 0; y < height; y++)
 	{
-		for (uint32 x = 0; x < rounded_down_width; x+= 4)
-		{
-			*dest_ptr = *source_ptr;
-			dest_ptr++;
-			source_ptr++;
-		}
-		uint32* dest_ptr_single = (uint32*)dest_ptr;
-		uint32* source_ptr_single = (uint32*)source_ptr;
-
-		for (uint32 x = 0; x < width_extra; x++)
-		{
-			*dest_ptr_single = *source_ptr_single;
-			dest_ptr_single++;
-			source_ptr_single++;
-		}
-		dest_ptr += end_shift;
+		render_kernels.copy_u32(dest_ptr, source_ptr, width);
+		dest_ptr += dest->width;
+		source_ptr += width;
 	}
-
-#endif
 }
 
 void draw_verticle_line(Bitmap* dest, uint32 x, uint32 from_y, uint32 to_y, vec3f color)
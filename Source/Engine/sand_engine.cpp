@@ -0,0 +1,413 @@
+#include "grid_engines.h"
+
+//Virtual memory reserved for the chunks and their map, pages get committed as the world grows.
+#define SAND_WORLD_RESERVE Gigabytes(4)
+#define SAND_WORLD_MAP_RESERVE Megabytes(256)
+
+static FORCEDINLINE uint64 hash_chunk(int64 cx, int64 cy)
+{
+	WorldPos pos = { cx, cy };
+	return hash_pos(pos);
+}
+
+static SandChunk* find_chunk(SandWorld* sw, int64 cx, int64 cy)
+{
+	uint32 mask = sw->map.size - 1;
+	uint32 index = (uint32)hash_chunk(cx, cy) & mask;
+	while (sw->map[index] != UINT32MAX)
+	{
+		SandChunk* chunk = sw->chunks.front + sw->map[index];
+		if (chunk->cx == cx && chunk->cy == cy)
+		{
+			return chunk;
+		}
+		index = (index + 1) & mask;
+	}
+	return NULL;
+}
+
+static void map_insert(SandWorld* sw, uint32 chunk_index)
+{
+	SandChunk* chunk = sw->chunks.front + chunk_index;
+	uint32 mask = sw->map.size - 1;
+	uint32 index = (uint32)hash_chunk(chunk->cx, chunk->cy) & mask;
+	while (sw->map[index] != UINT32MAX)
+	{
+		index = (index + 1) & mask;
+	}
+	sw->map[index] = chunk_index;
+}
+
+//Rebuilds the map for the current chunks, sized for a load factor of at most 0.5 (with room to add as many chunks again).
+static void rebuild_chunk_map(SandWorld* sw)
+{
+	if (sw->map.size != 0)
+	{
+		sw->map.clear(&sw->map_arena);
+	}
+	uint32 map_size = 64;
+	while (map_size < sw->chunks.size * 4)
+	{
+		map_size <<= 1;
+	}
+	if ((uint64)map_size * sizeof(uint32) > sw->map_arena.capacity)
+	{
+		ERRORBOX("Sand chunk map arena is too small to fit the sand world!");
+	}
+	commit_arena(&sw->map_arena, (uint64)map_size * sizeof(uint32));
+	sw->map.init_and_allocate(&sw->map_arena, map_size, "Sand World -> map");
+	pl_buffer_set(sw->map.front, 0xFF, map_size * sizeof(uint32));
+	for (uint32 i = 0; i < sw->chunks.size; i++)
+	{
+		map_insert(sw, i);
+	}
+}
+
+static SandChunk* add_chunk(SandWorld* sw, int64 cx, int64 cy)
+{
+	if ((sw->chunks.size + 1) * 2 > sw->map.size)
+	{
+		rebuild_chunk_map(sw);
+	}
+	if (sw->arena.top + sizeof(SandChunk) > sw->arena.capacity)
+	{
+		ERRORBOX("Sand world arena is too small to fit any more chunks!");
+	}
+	SandChunk empty = {};
+	empty.cx = cx;
+	empty.cy = cy;
+	empty.changed[0] = 1;	//nothing is known about the previous generations.
+	empty.changed[1] = 1;
+	commit_arena(&sw->arena, sizeof(SandChunk));
+	SandChunk* chunk = sw->chunks.add(&sw->arena, empty);
+	map_insert(sw, sw->chunks.size - 1);
+	return chunk;
+}
+
+static b32 chunk_has_sand(SandChunk* chunk, uint32 parity)
+{
+	uint64 any = 0;
+	for (uint32 r = 0; r < SAND_CHUNK_SIZE; r++)
+	{
+		any |= chunk->sand[parity][r];
+	}
+	return any != 0;
+}
+
+void init_sand_world(SandWorld* sw)
+{
+	reserve_arena(&sw->arena, SAND_WORLD_RESERVE);
+	add_monitoring(&sw->arena);
+
+	reserve_arena(&sw->map_arena, SAND_WORLD_MAP_RESERVE);
+	add_monitoring(&sw->map_arena);
+
+	sw->chunks.init(&sw->arena, "Sand World -> chunks");
+	sw->map.size = 0;
+	sw->parity = 0;
+	sw->grains = 0;
+	sw->awake_chunks = 0;
+	rebuild_chunk_map(sw);
+}
+
+void shutdown_sand_world(SandWorld* sw)
+{
+	sw->map.clear(&sw->map_arena);
+	sw->chunks.clear(&sw->arena);
+
+	remove_monitoring(&sw->map_arena);
+	release_arena(&sw->map_arena);
+	remove_monitoring(&sw->arena);
+	release_arena(&sw->arena);
+}
+
+void load_sand_world(SandWorld* sw, Hashtable* table)
+{
+	sw->chunks.clear(&sw->arena);
+	sw->chunks.init(&sw->arena, "Sand World -> chunks");
+	sw->parity = 0;
+	sw->grains = 0;
+	rebuild_chunk_map(sw);
+
+	SandChunk* chunk = NULL;	//grains next to each other usually land in the same chunk, so the last one is kept around.
+	LiveCellNode* node = table->node_list.front;
+	for (uint32 i = 0; i < table->node_list.size; i++)
+	{
+		if (node->type == CellType::SAND)
+		{
+			WorldPos pos = node_pos(table, node);
+			int64 cx = pos.x >> SAND_CHUNK_SIZE_BITS;
+			int64 cy = pos.y >> SAND_CHUNK_SIZE_BITS;
+			if (chunk == NULL || chunk->cx != cx || chunk->cy != cy)
+			{
+				chunk = find_chunk(sw, cx, cy);
+				if (chunk == NULL)
+				{
+					chunk = add_chunk(sw, cx, cy);
+				}
+			}
+			uint64 bit = 1ULL << (pos.x & (SAND_CHUNK_SIZE - 1));
+			uint64* row = &chunk->sand[0][pos.y & (SAND_CHUNK_SIZE - 1)];
+			if (!(*row & bit))
+			{
+				*row |= bit;
+				sw->grains++;
+			}
+		}
+		node++;
+	}
+}
+
+void sand_world_prepare_step(SandWorld* sw, Hashtable* table)
+{
+	if (sw->chunks.size == 0)
+	{
+		return;
+	}
+	uint32 cur = sw->parity;
+
+	//Grains can move one cell into any of the 8 chunks around theirs, and read up to 2 cells past the chunk border.
+	//NOTE: Only the chunks that existed before this step are checked, the added ones are empty.
+	uint32 chunk_count = sw->chunks.size;
+	for (uint32 i = 0; i < chunk_count; i++)
+	{
+		if (!chunk_has_sand(sw->chunks.front + i, cur))
+		{
+			continue;
+		}
+		int64 cx = sw->chunks[i].cx;
+		int64 cy = sw->chunks[i].cy;
+		for (int32 dy = -1; dy <= 1; dy++)
+		{
+			for (int32 dx = -1; dx <= 1; dx++)
+			{
+				if (find_chunk(sw, cx + dx, cy + dy) == NULL)
+				{
+					add_chunk(sw, cx + dx, cy + dy);
+				}
+			}
+		}
+	}
+
+	//copying the other cells of the table into the chunks they fall in. The ones outside every chunk can't be reached by any grain.
+	for (uint32 i = 0; i < sw->chunks.size; i++)
+	{
+		SandChunk* chunk = sw->chunks.front + i;
+		if (chunk->has_solid[cur])
+		{
+			pl_buffer_set(chunk->solid[cur], 0, sizeof(chunk->solid[cur]));
+			chunk->has_solid[cur] = 0;
+		}
+	}
+	SandChunk* chunk = NULL;
+	LiveCellNode* node = table->node_list.front;
+	for (uint32 i = 0; i < table->node_list.size; i++)
+	{
+		if (node->type != CellType::SAND && node->type != CellType::EMPTY)
+		{
+			WorldPos pos = node_pos(table, node);
+			int64 cx = pos.x >> SAND_CHUNK_SIZE_BITS;
+			int64 cy = pos.y >> SAND_CHUNK_SIZE_BITS;
+			if (chunk == NULL || chunk->cx != cx || chunk->cy != cy)
+			{
+				chunk = find_chunk(sw, cx, cy);
+			}
+			if (chunk != NULL)
+			{
+				chunk->solid[cur][pos.y & (SAND_CHUNK_SIZE - 1)] |= 1ULL << (pos.x & (SAND_CHUNK_SIZE - 1));
+				chunk->has_solid[cur] = 1;
+			}
+		}
+		node++;
+	}
+	for (uint32 i = 0; i < sw->chunks.size; i++)
+	{
+		chunk = sw->chunks.front + i;
+		uint64 diff = 0;
+		if (chunk->has_solid[cur] || chunk->has_solid[cur ^ 1])
+		{
+			for (uint32 r = 0; r < SAND_CHUNK_SIZE; r++)
+			{
+				diff |= chunk->solid[cur][r] ^ chunk->solid[cur ^ 1][r];
+			}
+		}
+		chunk->solid_changed[cur] = (diff != 0);
+	}
+}
+
+static uint64 zero_rows[SAND_CHUNK_SIZE] = {};
+
+uint32 sand_world_step_range(SandWorld* sw, uint32 begin, uint32 end)
+{
+	uint32 cur = sw->parity;
+	uint32 next = cur ^ 1;
+	uint32 awake_chunks = 0;
+
+	for (uint32 i = begin; i < end; i++)
+	{
+		SandChunk* chunk = sw->chunks.front + i;
+
+		//the 3x3 block of chunks around this one. Missing chunks are empty.
+		uint64* sand_around[3][3];	//[dy + 1][dx + 1]
+		uint64* solid_around[3][3];
+		uint8 neighborhood_changed = 0;
+		for (int32 dy = -1; dy <= 1; dy++)
+		{
+			for (int32 dx = -1; dx <= 1; dx++)
+			{
+				SandChunk* neighbor = (dx == 0 && dy == 0) ? chunk : find_chunk(sw, chunk->cx + dx, chunk->cy + dy);
+				sand_around[dy + 1][dx + 1] = neighbor ? neighbor->sand[cur] : zero_rows;
+				solid_around[dy + 1][dx + 1] = neighbor ? neighbor->solid[cur] : zero_rows;
+				//NOTE: The solid cells are the same as 2 generations ago if they didn't change in either of the last 2 generations.
+				neighborhood_changed |= neighbor ? (neighbor->changed[cur] | neighbor->solid_changed[cur] | neighbor->solid_changed[next]) : 0;
+			}
+		}
+
+		//Same inputs as 2 generations ago, so the output is the same as last generation's, which is still in the next buffer.
+		if (!neighborhood_changed)
+		{
+			chunk->changed[next] = 0;
+			continue;
+		}
+		awake_chunks++;
+
+		//Rows -1 to 64 of the chunk, each with the word of the chunk to the left and right. (the halo)
+		//occupied is sand or solid, grains only ever move into cells that aren't occupied.
+		uint64 sand[SAND_CHUNK_SIZE + 2][3];		//[row][left, center, right]
+		uint64 occupied[SAND_CHUNK_SIZE + 2][3];
+		for (uint32 r = 0; r < SAND_CHUNK_SIZE + 2; r++)
+		{
+			uint32 row_in_chunk = (r == 0) ? SAND_CHUNK_SIZE - 1 : ((r == SAND_CHUNK_SIZE + 1) ? 0 : r - 1);
+			uint32 around_row = (r == 0) ? 0 : ((r == SAND_CHUNK_SIZE + 1) ? 2 : 1);
+			for (uint32 c = 0; c < 3; c++)
+			{
+				sand[r][c] = sand_around[around_row][c][row_in_chunk];
+				occupied[r][c] = sand[r][c] | solid_around[around_row][c][row_in_chunk];
+			}
+		}
+
+		uint64* out = chunk->sand[next];
+		uint64 diff = 0;
+		for (uint32 r = 1; r <= SAND_CHUNK_SIZE; r++)
+		{
+			//words holding the cells 1 and 2 to the west (x - 1, x - 2) and east (x + 1, x + 2) of every bit.
+			uint64 sand_here = sand[r][1];
+			uint64 sand_east = (sand[r][1] >> 1) | (sand[r][2] << (SAND_CHUNK_SIZE - 1));
+			uint64 sand_east2 = (sand[r][1] >> 2) | (sand[r][2] << (SAND_CHUNK_SIZE - 2));
+			uint64 sand_west = (sand[r][1] << 1) | (sand[r][0] >> (SAND_CHUNK_SIZE - 1));
+			uint64 sand_above = sand[r + 1][1];
+			uint64 sand_above_east = (sand[r + 1][1] >> 1) | (sand[r + 1][2] << (SAND_CHUNK_SIZE - 1));
+			uint64 sand_above_west = (sand[r + 1][1] << 1) | (sand[r + 1][0] >> (SAND_CHUNK_SIZE - 1));
+
+			uint64 occupied_here = occupied[r][1];
+			uint64 occupied_east = (occupied[r][1] >> 1) | (occupied[r][2] << (SAND_CHUNK_SIZE - 1));
+			uint64 occupied_west = (occupied[r][1] << 1) | (occupied[r][0] >> (SAND_CHUNK_SIZE - 1));
+			uint64 occupied_west2 = (occupied[r][1] << 2) | (occupied[r][0] >> (SAND_CHUNK_SIZE - 2));
+			uint64 occupied_below = occupied[r - 1][1];
+			uint64 occupied_below_east = (occupied[r - 1][1] >> 1) | (occupied[r - 1][2] << (SAND_CHUNK_SIZE - 1));
+			uint64 occupied_below_east2 = (occupied[r - 1][1] >> 2) | (occupied[r - 1][2] << (SAND_CHUNK_SIZE - 2));
+			uint64 occupied_below_west = (occupied[r - 1][1] << 1) | (occupied[r - 1][0] >> (SAND_CHUNK_SIZE - 1));
+
+			//Grains of this row leaving: down always gets its cell. Down-left loses to the grain right above the target.
+			//Down-right also loses to the grain 2 cells east going down-left.
+			uint64 goes_down = ~occupied_below;
+			uint64 goes_down_left = occupied_below & ~occupied_below_west;
+			uint64 goes_down_right = occupied_below & occupied_below_west & ~occupied_below_east;
+			uint64 leaves = goes_down | (goes_down_left & ~sand_west) | (goes_down_right & ~sand_east & ~(sand_east2 & occupied_below_east2));
+
+			//Grains of the row above arriving in the free cells of this row, by the same priority.
+			uint64 from_above = sand_above;
+			uint64 from_above_east = sand_above_east & occupied_east & ~sand_above;
+			uint64 from_above_west = sand_above_west & occupied_west & occupied_west2 & ~sand_above & ~(sand_above_east & occupied_east);
+			uint64 arrives = ~occupied_here & (from_above | from_above_east | from_above_west);
+
+			uint64 result = (sand_here & ~leaves) | arrives;
+			diff |= result ^ out[r - 1];
+			out[r - 1] = result;
+		}
+		chunk->changed[next] = (diff != 0);
+	}
+	return awake_chunks;
+}
+
+void sand_world_finish_step(SandWorld* sw)
+{
+	if (sw->chunks.size == 0)
+	{
+		return;
+	}
+	sw->parity ^= 1;
+
+	//Keeping the chunks with grains (now or last generation) and the chunks around them, so settled piles don't wake up their neighborhood by re adding it.
+	//NOTE: A missing chunk has to look unchanged to the sleeping chunk check, so the ones that just changed are kept too.
+	for (uint32 i = 0; i < sw->chunks.size; i++)
+	{
+		sw->chunks[i].keep = sw->chunks[i].changed[sw->parity];
+	}
+	uint64 grains = 0;
+	for (uint32 i = 0; i < sw->chunks.size; i++)
+	{
+		SandChunk* chunk = sw->chunks.front + i;
+		uint64 any = 0;
+		uint64 any_previous = 0;
+		for (uint32 r = 0; r < SAND_CHUNK_SIZE; r++)
+		{
+			any |= chunk->sand[sw->parity][r];
+			any_previous |= chunk->sand[sw->parity ^ 1][r];
+			grains += popcount_64(chunk->sand[sw->parity][r]);
+		}
+		if (any || any_previous)
+		{
+			for (int32 dy = -1; dy <= 1; dy++)
+			{
+				for (int32 dx = -1; dx <= 1; dx++)
+				{
+					SandChunk* neighbor = find_chunk(sw, chunk->cx + dx, chunk->cy + dy);
+					if (neighbor)
+					{
+						neighbor->keep = 1;
+					}
+				}
+			}
+		}
+	}
+
+	uint32 kept = 0;
+	for (uint32 i = 0; i < sw->chunks.size; i++)
+	{
+		if (sw->chunks[i].keep)
+		{
+			if (kept != i)
+			{
+				sw->chunks[kept] = sw->chunks[i];
+			}
+			kept++;
+		}
+	}
+	MARENA_POP(&sw->arena, (sw->chunks.size - kept) * sizeof(SandChunk), "Sand World -> chunks");
+	sw->chunks.size = kept;
+	sw->grains = grains;
+	rebuild_chunk_map(sw);
+}
+
+void sand_world_export_range(SandWorld* sw, uint32 begin, uint32 end, MSlice<LiveCell>* out, MArena* out_arena)
+{
+	for (uint32 i = begin; i < end; i++)
+	{
+		SandChunk* chunk = sw->chunks.front + i;
+		commit_arena(out_arena, SAND_CHUNK_SIZE * SAND_CHUNK_SIZE * sizeof(LiveCell));	//enough for a full chunk.
+		int64 base_x = chunk->cx * SAND_CHUNK_SIZE;	//NOTE: Not a shift, chunk coordinates can be negative.
+		int64 base_y = chunk->cy * SAND_CHUNK_SIZE;
+		for (uint32 r = 0; r < SAND_CHUNK_SIZE; r++)
+		{
+			uint64 row = chunk->sand[sw->parity][r];
+			while (row)
+			{
+				uint32 b = bit_scan_forward_64(row);
+				LiveCell ad = { { base_x + b, base_y + r }, CellType::SAND };
+				out->add(out_arena, ad);
+				row &= row - 1;
+			}
+		}
+	}
+}
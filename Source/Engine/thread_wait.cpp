@@ -0,0 +1,35 @@
+#include "app_common.h"
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#else
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <limits.h>
+#endif
+
+//Blocking on a value (see wait_while_equal).
+//NOTE: WaitOnAddress and futex both check the value and go to sleep atomically, so a change (and wake) that happens right before the wait isn't missed.
+
+void wait_on_value(int32 volatile* value, int32 compare)
+{
+#ifdef _WIN32
+	WaitOnAddress((volatile VOID*)value, &compare, sizeof(int32), INFINITE);
+#else
+	syscall(SYS_futex, (int32*)value, FUTEX_WAIT_PRIVATE, compare, NULL, NULL, 0);
+#endif
+}
+
+void wake_value_waiters(int32 volatile* value)
+{
+#ifdef _WIN32
+	WakeByAddressAll((PVOID)value);
+#else
+	syscall(SYS_futex, (int32*)value, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#endif
+}
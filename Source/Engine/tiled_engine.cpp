@@ -0,0 +1,356 @@
+#include "grid_engines.h"
+
+//Virtual memory reserved for the tiles and their map, pages get committed as the world grows.
+#define TILE_WORLD_RESERVE Gigabytes(4)
+#define TILE_WORLD_MAP_RESERVE Megabytes(256)
+
+static FORCEDINLINE uint64 hash_tile(int64 tx, int64 ty)
+{
+	WorldPos pos = { tx, ty };
+	return hash_pos(pos);
+}
+
+static Tile* find_tile(TileWorld* tw, int64 tx, int64 ty)
+{
+	uint32 mask = tw->map.size - 1;
+	uint32 index = (uint32)hash_tile(tx, ty) & mask;
+	while (tw->map[index] != UINT32MAX)
+	{
+		Tile* tile = tw->tiles.front + tw->map[index];
+		if (tile->tx == tx && tile->ty == ty)
+		{
+			return tile;
+		}
+		index = (index + 1) & mask;
+	}
+	return NULL;
+}
+
+static void map_insert(TileWorld* tw, uint32 tile_index)
+{
+	Tile* tile = tw->tiles.front + tile_index;
+	uint32 mask = tw->map.size - 1;
+	uint32 index = (uint32)hash_tile(tile->tx, tile->ty) & mask;
+	while (tw->map[index] != UINT32MAX)
+	{
+		index = (index + 1) & mask;
+	}
+	tw->map[index] = tile_index;
+}
+
+//Rebuilds the map for the current tiles, sized for a load factor of at most 0.5 (with room to add as many tiles again).
+static void rebuild_tile_map(TileWorld* tw)
+{
+	if (tw->map.size != 0)
+	{
+		tw->map.clear(&tw->map_arena);
+	}
+	uint32 map_size = 64;
+	while (map_size < tw->tiles.size * 4)
+	{
+		map_size <<= 1;
+	}
+	if ((uint64)map_size * sizeof(uint32) > tw->map_arena.capacity)
+	{
+		ERRORBOX("Tile map arena is too small to fit the tile world!");
+	}
+	commit_arena(&tw->map_arena, (uint64)map_size * sizeof(uint32));
+	tw->map.init_and_allocate(&tw->map_arena, map_size, "Tile World -> map");
+	pl_buffer_set(tw->map.front, 0xFF, map_size * sizeof(uint32));
+	for (uint32 i = 0; i < tw->tiles.size; i++)
+	{
+		map_insert(tw, i);
+	}
+}
+
+static Tile* add_tile(TileWorld* tw, int64 tx, int64 ty)
+{
+	if ((tw->tiles.size + 1) * 2 > tw->map.size)
+	{
+		rebuild_tile_map(tw);
+	}
+	Tile empty = {};
+	empty.tx = tx;
+	empty.ty = ty;
+	commit_arena(&tw->arena, sizeof(Tile));
+	Tile* tile = tw->tiles.add(&tw->arena, empty);
+	map_insert(tw, tw->tiles.size - 1);
+	return tile;
+}
+
+void init_tile_world(TileWorld* tw)
+{
+	reserve_arena(&tw->arena, TILE_WORLD_RESERVE);
+	add_monitoring(&tw->arena);
+
+	reserve_arena(&tw->map_arena, TILE_WORLD_MAP_RESERVE);
+	add_monitoring(&tw->map_arena);
+
+	tw->tiles.init(&tw->arena, "Tile World -> tiles");
+	tw->map.size = 0;
+	tw->parity = 0;
+	tw->live_cells = 0;
+	tw->active_tiles = 0;
+	tw->unsettled_steps = 0;
+	rebuild_tile_map(tw);
+}
+
+void shutdown_tile_world(TileWorld* tw)
+{
+	tw->map.clear(&tw->map_arena);
+	tw->tiles.clear(&tw->arena);
+
+	remove_monitoring(&tw->map_arena);
+	release_arena(&tw->map_arena);
+	remove_monitoring(&tw->arena);
+	release_arena(&tw->arena);
+}
+
+void load_tile_world(TileWorld* tw, Hashtable* table)
+{
+	tw->tiles.clear(&tw->arena);
+	tw->tiles.init(&tw->arena, "Tile World -> tiles");
+	tw->parity = 0;
+	tw->live_cells = 0;
+	tw->unsettled_steps = 2;	//the first step fills the other buffer, the second one sets changed[] against a real generation.
+	rebuild_tile_map(tw);
+
+	Tile* tile = NULL;	//cells next to each other usually land in the same tile, so the last one is kept around.
+	LiveCellNode* node = table->node_list.front;
+	for (uint32 i = 0; i < table->node_list.size; i++)
+	{
+		if (node->type == CellType::CONWAY)
+		{
+			WorldPos pos = node_pos(table, node);
+			int64 tx = pos.x >> TILE_SIZE_BITS;
+			int64 ty = pos.y >> TILE_SIZE_BITS;
+			if (tile == NULL || tile->tx != tx || tile->ty != ty)
+			{
+				tile = find_tile(tw, tx, ty);
+				if (tile == NULL)
+				{
+					tile = add_tile(tw, tx, ty);
+				}
+			}
+			uint64 bit = 1ULL << (pos.x & (TILE_SIZE - 1));
+			uint64* row = &tile->rows[0][pos.y & (TILE_SIZE - 1)];
+			if (!(*row & bit))
+			{
+				*row |= bit;
+				tw->live_cells++;
+			}
+		}
+		node++;
+	}
+}
+
+void tile_world_prepare_step(TileWorld* tw)
+{
+	//NOTE: Only the tiles that existed before this step are checked, the added ones are empty.
+	uint32 tile_count = tw->tiles.size;
+	for (uint32 i = 0; i < tile_count; i++)
+	{
+		uint64* rows = tw->tiles[i].rows[tw->parity];
+		uint64 bottom = rows[0];
+		uint64 top = rows[TILE_SIZE - 1];
+		uint64 left = 0;	//non zero if any cell of the leftmost column is alive.
+		uint64 right = 0;	//non zero if any cell of the rightmost column is alive.
+		for (uint32 r = 0; r < TILE_SIZE; r++)
+		{
+			left |= rows[r] & 1ULL;
+			right |= rows[r] >> (TILE_SIZE - 1);
+		}
+
+		int64 tx = tw->tiles[i].tx;
+		int64 ty = tw->tiles[i].ty;
+		int32 need[3][3] = {};	//[dy + 1][dx + 1]
+		need[0][1] = (bottom != 0);
+		need[2][1] = (top != 0);
+		need[1][0] = (left != 0);
+		need[1][2] = (right != 0);
+		need[0][0] = (bottom & 1ULL) != 0;
+		need[0][2] = (bottom >> (TILE_SIZE - 1)) != 0;
+		need[2][0] = (top & 1ULL) != 0;
+		need[2][2] = (top >> (TILE_SIZE - 1)) != 0;
+
+		for (int32 dy = -1; dy <= 1; dy++)
+		{
+			for (int32 dx = -1; dx <= 1; dx++)
+			{
+				if (need[dy + 1][dx + 1] && find_tile(tw, tx + dx, ty + dy) == NULL)
+				{
+					add_tile(tw, tx + dx, ty + dy);
+				}
+			}
+		}
+	}
+}
+
+static FORCEDINLINE void full_add(uint64 a, uint64 b, uint64 c, uint64& sum, uint64& carry)
+{
+	uint64 t = a ^ b;
+	sum = t ^ c;
+	carry = (a & b) | (t & c);
+}
+
+static uint64 zero_rows[TILE_SIZE] = {};
+
+template<typename Rule>
+static uint32 step_tiles(TileWorld* tw, uint32 begin, uint32 end, LifeRule life_rule)
+{
+	Rule rule(life_rule);
+	uint32 cur = tw->parity;
+	uint32 next = cur ^ 1;
+	uint32 active_tiles = 0;
+
+	for (uint32 i = begin; i < end; i++)
+	{
+		Tile* tile = tw->tiles.front + i;
+
+		//the 3x3 block of tiles around this one. Missing tiles are empty.
+		uint64* around[3][3];	//[dy + 1][dx + 1]
+		uint8 neighborhood_changed = 0;
+		for (int32 dy = -1; dy <= 1; dy++)
+		{
+			for (int32 dx = -1; dx <= 1; dx++)
+			{
+				Tile* neighbor = (dx == 0 && dy == 0) ? tile : find_tile(tw, tile->tx + dx, tile->ty + dy);
+				around[dy + 1][dx + 1] = neighbor ? neighbor->rows[cur] : zero_rows;
+				neighborhood_changed |= neighbor ? neighbor->changed[cur] : 0;
+			}
+		}
+
+		//Same inputs as 2 generations ago, so the output is the same as last generation's, which is still in the next buffer. 
+		if (!neighborhood_changed && !tw->unsettled_steps)
+		{
+			tile->changed[next] = 0;
+			continue;
+		}
+		active_tiles++;
+
+		//Rows -1 to 64 of the tile, each with the word of the tile to the left and right. (the halo)
+		uint64 center[TILE_SIZE + 2];
+		uint64 left[TILE_SIZE + 2];
+		uint64 right[TILE_SIZE + 2];
+
+		center[0] = around[0][1][TILE_SIZE - 1];
+		left[0] = around[0][0][TILE_SIZE - 1];
+		right[0] = around[0][2][TILE_SIZE - 1];
+		for (uint32 r = 0; r < TILE_SIZE; r++)
+		{
+			center[r + 1] = around[1][1][r];
+			left[r + 1] = around[1][0][r];
+			right[r + 1] = around[1][2][r];
+		}
+		center[TILE_SIZE + 1] = around[2][1][0];
+		left[TILE_SIZE + 1] = around[2][0][0];
+		right[TILE_SIZE + 1] = around[2][2][0];
+
+		//words holding the left (x - 1) and right (x + 1) neighbor of every bit.
+		uint64 west[TILE_SIZE + 2];
+		uint64 east[TILE_SIZE + 2];
+		for (uint32 r = 0; r < TILE_SIZE + 2; r++)
+		{
+			west[r] = (center[r] << 1) | (left[r] >> (TILE_SIZE - 1));
+			east[r] = (center[r] >> 1) | (right[r] << (TILE_SIZE - 1));
+		}
+
+		uint64* out = tile->rows[next];
+		uint64 diff = 0;
+		for (uint32 r = 1; r <= TILE_SIZE; r++)
+		{
+			//counting the 8 neighbors of all 64 cells of the row at once.
+			uint64 below_sum, below_carry;
+			full_add(west[r - 1], center[r - 1], east[r - 1], below_sum, below_carry);
+			uint64 above_sum, above_carry;
+			full_add(west[r + 1], center[r + 1], east[r + 1], above_sum, above_carry);
+			uint64 mid_sum = west[r] ^ east[r];
+			uint64 mid_carry = west[r] & east[r];
+
+			uint64 ones, twos_a;
+			full_add(below_sum, above_sum, mid_sum, ones, twos_a);
+			uint64 twos_b, fours;
+			full_add(below_carry, above_carry, mid_carry, twos_b, fours);
+
+			uint64 twos = twos_a ^ twos_b;
+			uint64 fours_carry = twos_a & twos_b;
+			uint64 eights = fours & fours_carry;
+			fours ^= fours_carry;
+
+			uint64 result = life_rule_next_word(rule, ones, twos, fours, eights, center[r]);
+			diff |= result ^ out[r - 1];
+			out[r - 1] = result;
+		}
+		tile->changed[next] = (diff != 0);
+	}
+	return active_tiles;
+}
+
+typedef uint32 TileStepKernel(TileWorld* tw, uint32 begin, uint32 end, LifeRule life_rule);
+#define TILE_STEP_KERNEL(RULE) step_tiles<RULE>,
+static TileStepKernel* tile_step_kernels[] = { LIFE_RULE_KERNELS(TILE_STEP_KERNEL) step_tiles<DynamicLifeRule> };
+
+uint32 tile_world_step_range(TileWorld* tw, uint32 begin, uint32 end, LifeRule rule)
+{
+	return tile_step_kernels[life_rule_kernel(rule)](tw, begin, end, rule);
+}
+
+void tile_world_finish_step(TileWorld* tw)
+{
+	tw->parity ^= 1;
+	if (tw->unsettled_steps)
+	{
+		tw->unsettled_steps--;
+	}
+
+	//compacting the tile pool, dropping the tiles that have been empty for the last 3 generations.
+	//NOTE: A missing tile has to look unchanged to the stable tile check, and an added tile starts out with both buffers empty. 
+	uint32 kept = 0;
+	uint64 live_cells = 0;
+	for (uint32 i = 0; i < tw->tiles.size; i++)
+	{
+		Tile* tile = tw->tiles.front + i;
+		uint64 any = 0;
+		uint64 any_previous = 0;
+		for (uint32 r = 0; r < TILE_SIZE; r++)
+		{
+			any |= tile->rows[tw->parity][r];
+			any_previous |= tile->rows[tw->parity ^ 1][r];
+			live_cells += popcount_64(tile->rows[tw->parity][r]);
+		}
+		if (any || any_previous || tile->changed[tw->parity])
+		{
+			if (kept != i)
+			{
+				tw->tiles[kept] = *tile;
+			}
+			kept++;
+		}
+	}
+	MARENA_POP(&tw->arena, (tw->tiles.size - kept) * sizeof(Tile), "Tile World -> tiles");
+	tw->tiles.size = kept;
+	tw->live_cells = live_cells;
+	rebuild_tile_map(tw);
+}
+
+void tile_world_export_range(TileWorld* tw, uint32 begin, uint32 end, MSlice<LiveCell>* out, MArena* out_arena)
+{
+	for (uint32 i = begin; i < end; i++)
+	{
+		Tile* tile = tw->tiles.front + i;
+		commit_arena(out_arena, TILE_SIZE * TILE_SIZE * sizeof(LiveCell));	//enough for a full tile.
+		int64 base_x = tile->tx * TILE_SIZE;	//NOTE: Not a shift, tile coordinates can be negative.
+		int64 base_y = tile->ty * TILE_SIZE;
+		for (uint32 r = 0; r < TILE_SIZE; r++)
+		{
+			uint64 row = tile->rows[tw->parity][r];
+			while (row)
+			{
+				uint32 b = bit_scan_forward_64(row);
+				LiveCell ad = { { base_x + b, base_y + r }, CellType::CONWAY };
+				out->add(out_arena, ad);
+				row &= row - 1;
+			}
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#include "app_common.h"
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+//Virtual memory arenas (see commit_arena).
+//NOTE: Reserving only takes address space. Nothing counts against the memory of the process until it's committed.
+
+void* reserve_memory(uint64 size)
+{
+#ifdef _WIN32
+	void* base = VirtualAlloc(NULL, (SIZE_T)size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+	void* base = mmap(NULL, (size_t)size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED)
+	{
+		base = NULL;
+	}
+#endif
+	if (base == NULL)
+	{
+		ERRORBOX("Couldn't reserve address space for an arena!");
+	}
+	return base;
+}
+
+void commit_memory(void* base, uint64 size)
+{
+#ifdef _WIN32
+	b32 committed = VirtualAlloc(base, (SIZE_T)size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+	b32 committed = mprotect(base, (size_t)size, PROT_READ | PROT_WRITE) == 0;
+#endif
+	if (!committed)
+	{
+		ERRORBOX("Out of memory! Couldn't commit more pages of an arena.");
+	}
+}
+
+void release_memory(void* base, uint64 size)
+{
+#ifdef _WIN32
+	VirtualFree(base, 0, MEM_RELEASE);
+#else
+	munmap(base, (size_t)size);
+#endif
+}
+
+void reserve_arena(MArena* arena, uint64 capacity)
+{
+	arena->capacity = (capacity + ARENA_COMMIT_STEP - 1) & ~(uint64)(ARENA_COMMIT_STEP - 1);
+	arena->overflow_addon_size = 0;
+	arena->top = 0;
+	arena->base = reserve_memory(arena->capacity);
+}
+
+void release_arena(MArena* arena)
+{
+	release_memory(arena->base, arena->capacity);
+	arena->base = NULL;
+	arena->capacity = 0;
+	arena->top = 0;
+}
+
+void commit_arena_pages(MArena* arena, uint64 end)
+{
+	uint64 begin = (arena->top + ARENA_COMMIT_STEP - 1) & ~(uint64)(ARENA_COMMIT_STEP - 1);
+	end = (end + ARENA_COMMIT_STEP - 1) & ~(uint64)(ARENA_COMMIT_STEP - 1);
+	if (end > arena->capacity)
+	{
+		end = arena->capacity;	//pushing past the capacity is caught by the arena itself.
+	}
+	if (end > begin)
+	{
+		commit_memory((uint8*)arena->base + begin, end - begin);
+	}
+}